@@ -0,0 +1,388 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+/* Milliseconds to wait for command output before checking the queue again */
+#define BATCH_POLL_TIMEOUT 100
+
+/*
+ * Where the commands of a batch run come from: the string given to -c,
+ * or the lines of a script
+ */
+typedef struct {
+    const char *command;
+    FILE *script;
+    char *line;
+    size_t line_size;
+} BatchSource;
+
+/*
+ * Options shared by the batch modes. jobs is 0 unless -j was given.
+ */
+typedef struct {
+    int timestamps;
+    int events;
+    int jobs;
+    int completion_order;
+} BatchOptions;
+
+/*
+ * One command of a parallel run. Its output collects in stream until
+ * it finishes and is then held in output until it can be printed.
+ * The stream writes through &output, so a job never moves.
+ */
+typedef struct {
+    char *command;
+    FILE *stream;
+    char *output;
+    size_t output_len;
+    struct timespec started;
+    double seconds;
+    int exit_status;
+    int done;
+} BatchJob;
+
+/*
+ * Terminal running the jobs of one parallel lane
+ */
+typedef struct {
+    Terminal *term;
+    int job;
+    unsigned int finished;
+} BatchWorker;
+
+/*
+ * Get the next command of a batch. Blank script lines and lines starting
+ * with '#' are skipped.
+ * @param src: Source to read from
+ * @return: Command valid until the next call, or NULL when exhausted
+ */
+static const char* next_batch_command(BatchSource *src) {
+    if (src->command) {
+        const char *cmd = src->command;
+        src->command = NULL;
+        return cmd;
+    }
+    if (!src->script) return NULL;
+
+    ssize_t len;
+    while ((len = getline(&src->line, &src->line_size, src->script)) != -1) {
+        while (len > 0 && (src->line[len - 1] == '\n' || src->line[len - 1] == '\r')) {
+            src->line[--len] = '\0';
+        }
+
+        char *start = src->line;
+        while (*start == ' ' || *start == '\t') start++;
+        if (*start != '\0' && *start != '#') return start;
+    }
+    return NULL;
+}
+
+/*
+ * Run every command of a batch through the command queue of a terminal
+ * whose output is streamed to stdout
+ * @param src: Commands to run
+ * @param opts: Batch options
+ * @return: 0 if every command succeeded, else the last failing exit status
+ */
+static int run_batch(BatchSource *src, const BatchOptions *opts) {
+    headless_mode = 1;
+    init_terminal_manager();
+
+    Terminal *term = get_active_terminal();
+    term->history.echo = stdout;
+    term->history.echo_format = opts->events ? ECHO_EVENTS : ECHO_TEXT;
+    term->history.echo_timestamps = opts->timestamps;
+
+    unsigned int finished = 0;
+    int status = 0;
+    int more = 1;
+    while (1) {
+        /* Keep the queue topped up so the next command can be pre-spawned */
+        while (more && !is_queue_full(&term->cmd_queue)) {
+            const char *cmd = next_batch_command(src);
+            if (cmd) add_to_queue(&term->cmd_queue, cmd);
+            else more = 0;
+        }
+        if (!more && term->cmd_state != CMD_STATE_RUNNING &&
+            is_queue_empty(&term->cmd_queue)) {
+            break;
+        }
+
+        process_command_queue();
+        if (term->commands_finished != finished && term->exit_status != 0) {
+            status = term->exit_status;
+        }
+        finished = term->commands_finished;
+
+        fflush(stdout);
+        wait_for_command_activity(BATCH_POLL_TIMEOUT);
+        pump_command_output();
+        if (term->commands_finished != finished && term->exit_status != 0) {
+            status = term->exit_status;
+        }
+        finished = term->commands_finished;
+    }
+
+    fflush(stdout);
+    free_terminal_manager();
+    free_frecency_store();
+    return status;
+}
+
+/*
+ * Get the seconds elapsed since a monotonic time
+ * @param since: Start time
+ * @return: Elapsed seconds
+ */
+static double seconds_since(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+/*
+ * Hand the next command of a batch to an idle worker
+ * @param worker: Worker with no job
+ * @param jobs: Array of jobs, grown as needed
+ * @param job_count: Number of jobs so far
+ * @param job_capacity: Allocated size of the job array
+ * @param cmd: Command to run
+ * @param cwd: Directory every job starts in
+ * @return: 1 on success, 0 on allocation failure
+ */
+static int start_batch_job(BatchWorker *worker, BatchJob ***jobs, int *job_count,
+                           int *job_capacity, const char *cmd, const char *cwd) {
+    if (*job_count >= *job_capacity) {
+        int capacity = *job_capacity ? *job_capacity * 2 : 64;
+        BatchJob **grown = realloc(*jobs, capacity * sizeof(BatchJob*));
+        if (!grown) return 0;
+        *jobs = grown;
+        *job_capacity = capacity;
+    }
+
+    BatchJob *job = calloc(1, sizeof(BatchJob));
+    if (!job) return 0;
+    job->command = strdup(cmd);
+    job->stream = open_memstream(&job->output, &job->output_len);
+    if (!job->command || !job->stream) {
+        free(job->command);
+        if (job->stream) fclose(job->stream);
+        free(job->output);
+        free(job);
+        return 0;
+    }
+    (*jobs)[*job_count] = job;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+
+    /* A cd in one job must not leak into the next job of the same lane */
+    Terminal *term = worker->term;
+    snprintf(term->current_directory, sizeof(term->current_directory), "%s", cwd);
+    if (term == get_active_terminal()) chdir(cwd);
+
+    term->history.echo = job->stream;
+    worker->job = (*job_count)++;
+    worker->finished = term->commands_finished;
+    add_to_queue(&term->cmd_queue, job->command);
+    return 1;
+}
+
+/*
+ * Print the output of a finished job in one write
+ * @param job: Finished job
+ */
+static void emit_batch_job(BatchJob *job) {
+    fwrite(job->output, 1, job->output_len, stdout);
+    fflush(stdout);
+    free(job->output);
+    job->output = NULL;
+}
+
+/*
+ * Print the duration and exit status of every job
+ * @param jobs: Array of jobs
+ * @param job_count: Number of jobs
+ * @param seconds: Wall time of the whole run
+ */
+static void print_batch_summary(BatchJob **jobs, int job_count, double seconds) {
+    int failed = 0;
+
+    fprintf(stderr, "\n%5s  %4s  %10s  %s\n", "job", "exit", "seconds", "command");
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i]->exit_status != 0) failed++;
+        fprintf(stderr, "%5d  %4d  %10.3f  %s\n",
+                i + 1, jobs[i]->exit_status, jobs[i]->seconds, jobs[i]->command);
+    }
+    fprintf(stderr, "%d commands, %d failed, %.3f seconds\n", job_count, failed, seconds);
+}
+
+/*
+ * Run the commands of a batch on several terminals at once, each
+ * terminal taking the next command when its previous one finishes.
+ * Output of a command is buffered and printed whole, in input order or
+ * in the order commands finish.
+ * @param src: Commands to run
+ * @param opts: Batch options
+ * @return: 0 if every command succeeded, else the exit status of the last
+ *          failing command in input order
+ */
+static int run_parallel_batch(BatchSource *src, const BatchOptions *opts) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) strcpy(cwd, "/");
+
+    BatchWorker *workers = calloc(opts->jobs, sizeof(BatchWorker));
+    if (!workers) {
+        fprintf(stderr, "parrot run: out of memory\n");
+        return 1;
+    }
+
+    headless_mode = 1;
+    init_terminal_manager();
+    for (int i = 0; i < opts->jobs; i++) {
+        workers[i].term = i == 0 ? get_active_terminal() : add_terminal(cwd);
+        workers[i].job = -1;
+        if (!workers[i].term) {
+            fprintf(stderr, "parrot run: out of memory\n");
+            exit(1);
+        }
+        workers[i].term->history.echo_format = opts->events ? ECHO_EVENTS : ECHO_TEXT;
+        workers[i].term->history.echo_timestamps = opts->timestamps;
+    }
+
+    BatchJob **jobs = NULL;
+    int job_count = 0;
+    int job_capacity = 0;
+    int next_emit = 0;
+    int running = 0;
+    int more = 1;
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    while (1) {
+        for (int i = 0; i < opts->jobs && more; i++) {
+            if (workers[i].job >= 0) continue;
+
+            const char *cmd = next_batch_command(src);
+            if (!cmd) {
+                more = 0;
+            } else if (!start_batch_job(&workers[i], &jobs, &job_count, &job_capacity, cmd, cwd)) {
+                fprintf(stderr, "parrot run: out of memory\n");
+                more = 0;
+            } else {
+                running++;
+            }
+        }
+        if (running == 0) break;
+
+        process_command_queue();
+        wait_for_command_activity(BATCH_POLL_TIMEOUT);
+        pump_command_output();
+
+        for (int i = 0; i < opts->jobs; i++) {
+            BatchWorker *worker = &workers[i];
+            if (worker->job < 0 || worker->term->commands_finished == worker->finished) continue;
+
+            BatchJob *job = jobs[worker->job];
+            job->seconds = seconds_since(&job->started);
+            job->exit_status = worker->term->exit_status;
+            job->done = 1;
+            fclose(job->stream);
+            job->stream = NULL;
+            worker->term->history.echo = NULL;
+            worker->job = -1;
+            running--;
+
+            if (opts->completion_order) emit_batch_job(job);
+        }
+
+        while (!opts->completion_order && next_emit < job_count && jobs[next_emit]->done) {
+            emit_batch_job(jobs[next_emit++]);
+        }
+    }
+
+    print_batch_summary(jobs, job_count, seconds_since(&started));
+
+    int status = 0;
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i]->exit_status != 0) status = jobs[i]->exit_status;
+        free(jobs[i]->command);
+        free(jobs[i]->output);
+        free(jobs[i]);
+    }
+    free(jobs);
+    free(workers);
+    free_terminal_manager();
+    free_frecency_store();
+    return status;
+}
+
+/*
+ * Run commands without the ncurses interface:
+ *   parrot -c [-t] [--events jsonl] command
+ *   parrot run [-t] [--events jsonl] [-j N [--order input|completion]] script|-
+ * @param argc: Argument count, starting at the mode
+ * @param argv: Arguments, argv[0] being "-c" or "run"
+ * @return: Process exit status
+ */
+int run_batch_mode(int argc, char *argv[]) {
+    BatchOptions opts = {0};
+    BatchSource src = {0};
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--timestamps") == 0) {
+            opts.timestamps = 1;
+        } else if (strcmp(argv[i], "--events") == 0 && i + 1 < argc) {
+            if (strcmp(argv[++i], "jsonl") != 0) {
+                fprintf(stderr, "parrot %s: the only event format is 'jsonl'\n", argv[0]);
+                return 2;
+            }
+            opts.events = 1;
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            opts.jobs = atoi(value);
+            if (opts.jobs < 1) {
+                fprintf(stderr, "parrot %s: -j needs a positive number\n", argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--order") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "completion") == 0) {
+                opts.completion_order = 1;
+            } else if (strcmp(argv[i], "input") != 0) {
+                fprintf(stderr, "parrot %s: --order is 'input' or 'completion'\n", argv[0]);
+                return 2;
+            }
+        } else {
+            fprintf(stderr, "parrot %s: unknown option %s\n", argv[0], argv[i]);
+            return 2;
+        }
+    }
+    if (i != argc - 1) {
+        fprintf(stderr, "usage: parrot -c [-t] [--events jsonl] command\n"
+                        "       parrot run [-t] [--events jsonl] [-j N [--order input|completion]] script|-\n");
+        return 2;
+    }
+
+    if (strcmp(argv[0], "-c") == 0) {
+        src.command = argv[i];
+    } else if (strcmp(argv[i], "-") == 0) {
+        src.script = stdin;
+    } else if ((src.script = fopen(argv[i], "r")) == NULL) {
+        fprintf(stderr, "parrot run: %s: %s\n", argv[i], strerror(errno));
+        return 1;
+    }
+
+    int status = opts.jobs ? run_parallel_batch(&src, &opts) : run_batch(&src, &opts);
+
+    if (src.script && src.script != stdin) fclose(src.script);
+    free(src.line);
+    return status;
+}
@@ -0,0 +1,305 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <pthread.h>
+
+/* A measurement is repeated with more iterations until it lasts this long */
+#define BENCH_MIN_TIME_NS 200e6
+
+/* Largest factor the iteration count grows by between two attempts */
+#define BENCH_MAX_GROWTH 100
+
+unsigned long long bench_allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+static int json_output = 0;
+static int filter_count = 0;
+static char **filters = NULL;
+
+/* Timer of the running benchmark */
+static int timer_running = 0;
+static double timer_started = 0;
+static double timer_elapsed = 0;
+static unsigned long long timer_alloc_mark = 0;
+static unsigned long long timer_allocs = 0;
+
+/* Result being built */
+static const char *result_name = NULL;
+static const char *metric_keys[BENCH_MAX_METRICS];
+static double metric_values[BENCH_MAX_METRICS];
+static int metric_count = 0;
+
+/* Pseudo-terminal the screen writes to */
+static int screen_master = -1;
+static FILE *screen_output = NULL;
+static FILE *screen_input = NULL;
+static SCREEN *screen = NULL;
+static pthread_t screen_reader;
+
+/*
+ * Count allocations made by parrot code, linked with --wrap=malloc
+ */
+void *__wrap_malloc(size_t size) {
+    bench_allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    bench_allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    bench_allocations++;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    bench_allocations++;
+    return __real_strdup(s);
+}
+
+/*
+ * Parse the command line: --json selects JSON lines, other arguments
+ * select benchmarks whose names contain them
+ * @param argc: Argument count
+ * @param argv: Argument vector
+ */
+void bench_init(int argc, char *argv[]) {
+    filters = argv + 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) json_output = 1;
+        else filters[filter_count++] = argv[i];
+    }
+}
+
+/*
+ * Check whether a benchmark was selected on the command line
+ * @param name: Benchmark name
+ * @return: 1 if it should run
+ */
+int bench_selected(const char *name) {
+    if (filter_count == 0) return 1;
+    for (int i = 0; i < filter_count; i++) {
+        if (strstr(name, filters[i])) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Check whether results are printed as JSON lines
+ * @return: 1 for JSON, 0 for a table
+ */
+int bench_json_output(void) {
+    return json_output;
+}
+
+/*
+ * Monotonic time
+ * @return: Nanoseconds from an arbitrary start
+ */
+double bench_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/*
+ * Peak resident set size of the process
+ * @return: Kilobytes
+ */
+long bench_peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/*
+ * Pause the timer and the allocation count around setup work
+ */
+void bench_stop_timer(void) {
+    if (!timer_running) return;
+    timer_elapsed += bench_now_ns() - timer_started;
+    timer_allocs += bench_allocations - timer_alloc_mark;
+    timer_running = 0;
+}
+
+/*
+ * Resume the timer and the allocation count
+ */
+void bench_start_timer(void) {
+    if (timer_running) return;
+    timer_alloc_mark = bench_allocations;
+    timer_started = bench_now_ns();
+    timer_running = 1;
+}
+
+/*
+ * Measure an operation, growing the iteration count until a run lasts
+ * BENCH_MIN_TIME_NS, and report ns/op and allocations/op
+ * @param name: Benchmark name
+ * @param fn: Body running the operation a given number of times
+ * @param ctx: Argument for fn
+ */
+void bench_run(const char *name, BenchFunction fn, void *ctx) {
+    long long iterations = 1;
+
+    if (!bench_selected(name)) return;
+    for (;;) {
+        timer_elapsed = 0;
+        timer_allocs = 0;
+        bench_start_timer();
+        fn(ctx, iterations);
+        bench_stop_timer();
+        if (timer_elapsed >= BENCH_MIN_TIME_NS) break;
+
+        double growth = timer_elapsed > 0 ? 1.2 * BENCH_MIN_TIME_NS / timer_elapsed : BENCH_MAX_GROWTH;
+        if (growth > BENCH_MAX_GROWTH) growth = BENCH_MAX_GROWTH;
+        if (growth < 2) growth = 2;
+        iterations = (long long)(iterations * growth);
+    }
+
+    bench_begin_result(name);
+    bench_metric("ns_per_op", timer_elapsed / iterations);
+    bench_metric("allocs_per_op", (double)timer_allocs / iterations);
+    bench_metric("iterations", iterations);
+    bench_end_result();
+}
+
+/*
+ * Start a result row
+ * @param name: Benchmark name
+ */
+void bench_begin_result(const char *name) {
+    result_name = name;
+    metric_count = 0;
+}
+
+/*
+ * Add a metric to the current result
+ * @param key: Metric name, a JSON-safe identifier
+ * @param value: Value
+ */
+void bench_metric(const char *key, double value) {
+    if (metric_count == BENCH_MAX_METRICS) return;
+    metric_keys[metric_count] = key;
+    metric_values[metric_count] = value;
+    metric_count++;
+}
+
+/*
+ * Print the current result, as a JSON line or a table row
+ */
+void bench_end_result(void) {
+    char number[32];
+
+    if (json_output) {
+        JsonWriter w;
+        json_begin(&w, stdout);
+        json_text(&w, "{\"name\":");
+        json_string(&w, result_name);
+        for (int i = 0; i < metric_count; i++) {
+            json_text(&w, ",\"");
+            json_text(&w, metric_keys[i]);
+            json_text(&w, "\":");
+            snprintf(number, sizeof(number), "%.9g", metric_values[i]);
+            json_text(&w, number);
+        }
+        json_text(&w, "}\n");
+        json_flush(&w);
+    } else {
+        printf("%-44s", result_name);
+        for (int i = 0; i < metric_count; i++) {
+            printf(" %14.2f %s", metric_values[i], metric_keys[i]);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+/*
+ * Throw away what the screen writes, as a terminal emulator would
+ * consume it, so the writes never block
+ * @param arg: Unused
+ * @return: NULL once the pseudo-terminal is closed
+ */
+static void *read_screen_output(void *arg) {
+    char buffer[65536];
+    (void)arg;
+    while (read(screen_master, buffer, sizeof(buffer)) > 0) {
+    }
+    return NULL;
+}
+
+/*
+ * Start ncurses on a new pseudo-terminal of the given size, as the
+ * interface would on a real one
+ * @param rows: Screen height
+ * @param cols: Screen width
+ * @return: 1 on success, 0 with a message on stderr on failure
+ */
+int bench_open_screen(int rows, int cols) {
+    screen_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (screen_master < 0 || grantpt(screen_master) != 0 || unlockpt(screen_master) != 0) {
+        fprintf(stderr, "bench: cannot open a pseudo-terminal: %s\n", strerror(errno));
+        return 0;
+    }
+    int slave = open(ptsname(screen_master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        fprintf(stderr, "bench: cannot open %s: %s\n", ptsname(screen_master), strerror(errno));
+        return 0;
+    }
+    struct winsize size = {rows, cols, 0, 0};
+    ioctl(slave, TIOCSWINSZ, &size);
+
+    pthread_create(&screen_reader, NULL, read_screen_output, NULL);
+
+    screen_output = fdopen(slave, "w");
+    screen_input = fdopen(dup(slave), "r");
+    screen = newterm("xterm-256color", screen_output, screen_input);
+    if (!screen) {
+        fprintf(stderr, "bench: newterm failed\n");
+        return 0;
+    }
+    set_term(screen);
+    raw();
+    noecho();
+    timeout(0);
+    init_colors();
+    return 1;
+}
+
+/*
+ * Resize the pseudo-terminal and tell ncurses about it
+ * @param rows: New height
+ * @param cols: New width
+ */
+void bench_resize_screen(int rows, int cols) {
+    struct winsize size = {rows, cols, 0, 0};
+    ioctl(fileno(screen_output), TIOCSWINSZ, &size);
+    resizeterm(rows, cols);
+}
+
+/*
+ * End ncurses and close the pseudo-terminal
+ */
+void bench_close_screen(void) {
+    if (!screen) return;
+    endwin();
+    delscreen(screen);
+    fclose(screen_output);
+    fclose(screen_input);
+    pthread_join(screen_reader, NULL);
+    close(screen_master);
+    screen = NULL;
+    screen_output = screen_input = NULL;
+    screen_master = -1;
+}
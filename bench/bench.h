@@ -0,0 +1,38 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "terminal.h"
+
+/* Metrics one result can carry */
+#define BENCH_MAX_METRICS 12
+
+/*
+ * Benchmark body. It runs the measured operation iterations times and
+ * may pause the timer around its own setup with bench_stop_timer().
+ */
+typedef void (*BenchFunction)(void *ctx, long long iterations);
+
+/* Allocations made through malloc, calloc, realloc and strdup */
+extern unsigned long long bench_allocations;
+
+/* Harness */
+void bench_init(int argc, char *argv[]);
+int bench_selected(const char *name);
+int bench_json_output(void);
+void bench_stop_timer(void);
+void bench_start_timer(void);
+double bench_now_ns(void);
+long bench_peak_rss_kb(void);
+void bench_run(const char *name, BenchFunction fn, void *ctx);
+
+/* Results with arbitrary metrics, printed as a table row or a JSON line */
+void bench_begin_result(const char *name);
+void bench_metric(const char *key, double value);
+void bench_end_result(void);
+
+/* Pseudo-terminal backed ncurses screen */
+int bench_open_screen(int rows, int cols);
+void bench_resize_screen(int rows, int cols);
+void bench_close_screen(void);
+
+#endif
@@ -0,0 +1,209 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+/* Output written by each producer unless --bytes says otherwise */
+#define INGEST_DEFAULT_BYTES (64LL * 1024 * 1024)
+
+#define INGEST_ROWS 40
+#define INGEST_COLS 120
+
+/* Frames recorded per case, enough for several minutes of flood */
+#define INGEST_MAX_FRAMES (1 << 20)
+
+/* Producer kinds */
+typedef struct {
+    const char *name;
+    const char *kind;
+} IngestCase;
+
+static const IngestCase ingest_cases[] = {
+    {"ingest_fixed_lines", "lines"},
+    {"ingest_long_lines", "long"},
+    {"ingest_ansi", "ansi"},
+    {"ingest_progress_bar", "progress"},
+    {"ingest_binary", "binary"},
+};
+
+/*
+ * Fill a block with the output of one producer kind. The block is
+ * written repeatedly, so it always ends on a line boundary except for
+ * binary data.
+ * @param kind: Producer kind
+ * @param size: Receives the block size
+ * @return: Allocated block
+ */
+static char *make_producer_block(const char *kind, size_t *size) {
+    size_t capacity = 1024 * 1024;
+    char *block = malloc(capacity);
+    size_t len = 0;
+
+    if (!block) return NULL;
+    if (strcmp(kind, "lines") == 0) {
+        /* 80 bytes per line including the newline */
+        for (int i = 0; len + 80 <= capacity; i++) {
+            len += sprintf(block + len, "%08d lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eius\n", i);
+        }
+    } else if (strcmp(kind, "long") == 0) {
+        /* 256 KB lines, far longer than a history line */
+        for (size_t i = 0; i < capacity; i++) {
+            block[i] = (i + 1) % (256 * 1024) == 0 ? '\n' : 'a' + i % 26;
+        }
+        len = capacity;
+    } else if (strcmp(kind, "ansi") == 0) {
+        /* Compiler-style output with a colour change every word */
+        for (int i = 0; len + 160 <= capacity; i++) {
+            len += sprintf(block + len,
+                           "\033[1m%06d.c:%d:\033[0m \033[1;31merror:\033[0m \033[33mexpected\033[0m "
+                           "\033[32m';'\033[0m \033[2mbefore\033[0m \033[36m'}'\033[0m\n", i, i % 999);
+        }
+    } else if (strcmp(kind, "progress") == 0) {
+        /* A redrawn bar: one hundred carriage-return updates per finished line */
+        for (int i = 0; len + 80 <= capacity; i++) {
+            int percent = i % 101;
+            len += sprintf(block + len, "\r[%-50.*s] %3d%%", percent / 2,
+                           "##################################################", percent);
+            if (percent == 100) block[len++] = '\n';
+        }
+    } else {
+        unsigned int seed = 12345;
+        for (size_t i = 0; i < capacity; i++) {
+            seed = seed * 1103515245 + 12345;
+            block[i] = seed >> 16;
+        }
+        len = capacity;
+    }
+    *size = len;
+    return block;
+}
+
+/*
+ * Write a producer's output to stdout
+ * @param kind: Producer kind
+ * @param total: Bytes to write
+ * @return: Process exit status
+ */
+static int run_producer(const char *kind, long long total) {
+    size_t size;
+    char *block = make_producer_block(kind, &size);
+
+    if (!block) return 1;
+    while (total > 0) {
+        size_t chunk = total < (long long)size ? (size_t)total : size;
+        if (fwrite(block, 1, chunk, stdout) != chunk) return 1;
+        total -= chunk;
+    }
+    free(block);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
+/*
+ * Compare frame times for qsort
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Run one producer through execute_command() and the main loop, drawing
+ * a frame per iteration, and report throughput and frame times
+ * @param test: Case to run
+ * @param self: Path of this binary
+ * @param total: Bytes the producer writes
+ * @return: 0 on success
+ */
+static int run_ingest_case(const IngestCase *test, const char *self, long long total) {
+    char cmd[PATH_MAX + 64];
+    double *frames = malloc(INGEST_MAX_FRAMES * sizeof(double));
+    int frame_count = 0;
+
+    if (!frames || !bench_open_screen(INGEST_ROWS, INGEST_COLS)) return 1;
+    init_terminal_manager();
+
+    Terminal *term = get_active_terminal();
+    int lines_before = term->history.count;
+    snprintf(cmd, sizeof(cmd), "'%s' --produce %s %lld", self, test->kind, total);
+
+    double start = bench_now_ns();
+    execute_command(term, cmd);
+
+    double frame_start = start;
+    while (term->cmd_state != CMD_STATE_READY) {
+        update_real_time_display();
+        wait_for_command_activity(100);
+        pump_command_output();
+        process_command_queue();
+
+        double now = bench_now_ns();
+        if (frame_count < INGEST_MAX_FRAMES) frames[frame_count++] = now - frame_start;
+        frame_start = now;
+    }
+    double elapsed = bench_now_ns() - start;
+
+    qsort(frames, frame_count, sizeof(double), compare_doubles);
+    bench_begin_result(test->name);
+    bench_metric("mb_per_s", total / (elapsed / 1e9) / (1024 * 1024));
+    bench_metric("lines_per_s", (term->history.count - lines_before) / (elapsed / 1e9));
+    bench_metric("peak_rss_kb", bench_peak_rss_kb());
+    bench_metric("frames", frame_count);
+    bench_metric("frame_p50_ms", frame_count ? frames[frame_count / 2] / 1e6 : 0);
+    bench_metric("frame_p99_ms", frame_count ? frames[frame_count * 99 / 100] / 1e6 : 0);
+    bench_metric("frame_max_ms", frame_count ? frames[frame_count - 1] / 1e6 : 0);
+    bench_metric("exit_status", term->exit_status);
+    bench_end_result();
+
+    int failed = term->exit_status != 0;
+    free_terminal_manager();
+    bench_close_screen();
+    free(frames);
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    long long total = INGEST_DEFAULT_BYTES;
+    char self[PATH_MAX];
+    int failed = 0;
+
+    if (argc == 4 && strcmp(argv[1], "--produce") == 0) {
+        return run_producer(argv[2], atoll(argv[3]));
+    }
+
+    /* --bytes N is taken out before the remaining arguments select cases */
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--bytes") == 0) {
+            total = atoll(argv[i + 1]);
+            memmove(argv + i, argv + i + 2, (argc - i - 1) * sizeof(char *));
+            argc -= 2;
+            break;
+        }
+    }
+    bench_init(argc, argv);
+
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        fprintf(stderr, "ingest: cannot find own executable: %s\n", strerror(errno));
+        return 1;
+    }
+    self[len] = '\0';
+    headless_mode = 1;
+
+    /* Each case runs in its own process so peak RSS is its own */
+    for (size_t i = 0; i < sizeof(ingest_cases) / sizeof(ingest_cases[0]); i++) {
+        if (!bench_selected(ingest_cases[i].name)) continue;
+
+        pid_t pid = fork();
+        if (pid == 0) _exit(run_ingest_case(&ingest_cases[i], self, total));
+
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "ingest: %s failed\n", ingest_cases[i].name);
+            failed = 1;
+        }
+    }
+    return failed;
+}
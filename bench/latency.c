@@ -0,0 +1,388 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#define LATENCY_ROWS 40
+#define LATENCY_COLS 120
+
+#define LATENCY_DEFAULT_SAMPLES 200
+#define LATENCY_DEFAULT_TABS 64
+
+/* A key not echoed within this time counts as lost */
+#define LATENCY_TIMEOUT_MS 2000
+
+/* Pause between samples, so each key meets a settled screen */
+#define LATENCY_GAP_MS 20
+
+/* Output is considered settled after this long without a write */
+#define LATENCY_QUIET_MS 300
+
+/*
+ * Key typed for every sample. It appears nowhere else on the screen:
+ * not in the load command, the producer's digits, the tab bar or the
+ * alternate character set ncurses draws lines with.
+ */
+#define LATENCY_KEY 'z'
+
+/* Ctrl+U empties the input line between samples, Ctrl+T opens a tab in
+ * the background and Alt+- from the first tab wraps around to the last */
+#define LATENCY_KILL_LINE "\025"
+#define LATENCY_NEW_TAB "\024"
+#define LATENCY_LAST_TAB "\033-"
+
+/* Conditions the keys are typed in */
+typedef enum {
+    LATENCY_IDLE,
+    LATENCY_HEAVY_OUTPUT,
+    LATENCY_MANY_TABS
+} LatencyCondition;
+
+typedef struct {
+    const char *name;
+    LatencyCondition condition;
+} LatencyCase;
+
+static const LatencyCase latency_cases[] = {
+    {"latency_idle", LATENCY_IDLE},
+    {"latency_heavy_output", LATENCY_HEAVY_OUTPUT},
+    {"latency_many_tabs", LATENCY_MANY_TABS},
+};
+
+/* Parrot under test */
+typedef struct {
+    pid_t pid;
+    int master;
+} LatencySession;
+
+/*
+ * Write digits to stdout until the reader goes away
+ * @return: Process exit status
+ */
+static int run_producer(void) {
+    char line[LATENCY_COLS];
+
+    signal(SIGPIPE, SIG_DFL);
+    memset(line, '0', sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\n';
+    for (unsigned long i = 0;; i++) {
+        snprintf(line, 11, "%010lu", i);
+        line[10] = ' ';
+        if (fwrite(line, 1, sizeof(line), stdout) != sizeof(line)) return 0;
+    }
+}
+
+/*
+ * Start parrot on a new pseudo-terminal, the way a terminal emulator does
+ * @param parrot: Path of the parrot binary
+ * @param home: Directory used as HOME, runtime directory and working directory
+ * @param self: Path of this binary, run by the heavy output condition
+ * @param session: Receives the process and the pseudo-terminal master
+ * @return: 1 on success, 0 with a message on stderr on failure
+ */
+static int spawn_parrot(const char *parrot, const char *home, const char *self, LatencySession *session) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        fprintf(stderr, "latency: cannot open a pseudo-terminal: %s\n", strerror(errno));
+        return 0;
+    }
+    struct winsize size = {LATENCY_ROWS, LATENCY_COLS, 0, 0};
+    ioctl(master, TIOCSWINSZ, &size);
+    const char *slave_name = ptsname(master);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "latency: fork failed: %s\n", strerror(errno));
+        close(master);
+        return 0;
+    }
+    if (pid == 0) {
+        setsid();
+        int slave = open(slave_name, O_RDWR);
+        if (slave < 0) _exit(127);
+        ioctl(slave, TIOCSCTTY, 0);
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        if (slave > STDERR_FILENO) close(slave);
+        close(master);
+
+        setenv("TERM", "xterm-256color", 1);
+        setenv("HOME", home, 1);
+        setenv("XDG_RUNTIME_DIR", home, 1);
+        setenv("PARROT_BENCH_SELF", self, 1);
+        unsetenv("PARROT_SESSION");
+        unsetenv("PARROT_HISTFILE");
+        unsetenv("PARROT_DIRFILE");
+        unsetenv("PARROT_SNAPSHOT");
+        if (chdir(home) != 0) _exit(127);
+        execl(parrot, "parrot", (char *)NULL);
+        _exit(127);
+    }
+
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    session->pid = pid;
+    session->master = master;
+    return 1;
+}
+
+/*
+ * Read what parrot draws until a byte shows up, the time runs out or the
+ * output goes quiet
+ * @param session: Parrot under test
+ * @param byte: Byte to look for, or -1 for none
+ * @param timeout_ms: Longest time to read
+ * @param quiet_ms: Return after this long without output, or 0 to keep reading
+ * @param seen: Receives the time the byte was read, if found
+ * @return: 1 if the byte was found, 0 otherwise, -1 if parrot is gone
+ */
+static int read_screen(LatencySession *session, int byte, int timeout_ms, int quiet_ms, double *seen) {
+    char buffer[65536];
+    double deadline = bench_now_ns() + timeout_ms * 1e6;
+    struct pollfd pfd = {session->master, POLLIN, 0};
+
+    for (;;) {
+        double now = bench_now_ns();
+        if (now >= deadline) return 0;
+
+        int wait_ms = (int)((deadline - now) / 1e6) + 1;
+        if (quiet_ms > 0 && quiet_ms < wait_ms) wait_ms = quiet_ms;
+
+        int ready = poll(&pfd, 1, wait_ms);
+        if (ready < 0 && errno != EINTR) return -1;
+        if (ready == 0 && quiet_ms > 0) return 0;
+        if (ready <= 0) continue;
+
+        ssize_t n = read(session->master, buffer, sizeof(buffer));
+        if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            return -1;
+        }
+        if (byte >= 0 && memchr(buffer, byte, n)) {
+            if (seen) *seen = bench_now_ns();
+            return 1;
+        }
+    }
+}
+
+/*
+ * Type text into parrot
+ * @param session: Parrot under test
+ * @param text: Bytes to send
+ * @return: 1 on success, 0 if parrot is gone
+ */
+static int type_text(LatencySession *session, const char *text) {
+    size_t len = strlen(text);
+
+    while (len > 0) {
+        ssize_t n = write(session->master, text, len);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) return 0;
+            read_screen(session, -1, 1, 1, NULL);
+            continue;
+        }
+        text += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/*
+ * Quit parrot with the exit command, killing it if it does not go
+ * @param session: Parrot under test
+ */
+static void stop_parrot(LatencySession *session) {
+    int status;
+
+    type_text(session, LATENCY_KILL_LINE "exit\r");
+    for (int i = 0; i < 50; i++) {
+        if (waitpid(session->pid, &status, WNOHANG) == session->pid) {
+            close(session->master);
+            return;
+        }
+        read_screen(session, -1, 100, 100, NULL);
+    }
+    kill(session->pid, SIGKILL);
+    waitpid(session->pid, &status, 0);
+    close(session->master);
+}
+
+/*
+ * Bring parrot into a condition
+ * @param session: Parrot under test
+ * @param condition: Condition to set up
+ * @param tabs: Tabs opened for LATENCY_MANY_TABS
+ * @return: 1 on success, 0 if parrot is gone
+ */
+static int set_up_condition(LatencySession *session, LatencyCondition condition, int tabs) {
+    switch (condition) {
+        case LATENCY_HEAVY_OUTPUT:
+            /* The producer floods the active terminal while keys are typed */
+            if (!type_text(session, "\"$PARROT_BENCH_SELF\" --produce\r")) return 0;
+            return read_screen(session, -1, LATENCY_QUIET_MS, 0, NULL) >= 0;
+        case LATENCY_MANY_TABS:
+            /* Keys go to the last tab, so the tab bar scrolls */
+            for (int i = 1; i < tabs; i++) {
+                if (!type_text(session, LATENCY_NEW_TAB)) return 0;
+                if (read_screen(session, -1, LATENCY_TIMEOUT_MS, LATENCY_GAP_MS, NULL) < 0) return 0;
+            }
+            if (tabs > 1 && !type_text(session, LATENCY_LAST_TAB)) return 0;
+            return read_screen(session, -1, LATENCY_TIMEOUT_MS, LATENCY_QUIET_MS, NULL) >= 0;
+        default:
+            return 1;
+    }
+}
+
+/*
+ * Compare latencies for qsort
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Start parrot, type keys in one condition and report the time from
+ * writing each key to the master until its echo is read back
+ * @param test: Case to run
+ * @param parrot: Path of the parrot binary
+ * @param home: Directory used as HOME
+ * @param self: Path of this binary
+ * @param samples: Keys to time
+ * @param tabs: Tabs opened for LATENCY_MANY_TABS
+ * @return: 0 on success
+ */
+static int run_latency_case(const LatencyCase *test, const char *parrot, const char *home,
+                            const char *self, int samples, int tabs) {
+    LatencySession session;
+    double *latencies = malloc(samples * sizeof(double));
+    char key[2] = {LATENCY_KEY, '\0'};
+    int measured = 0;
+    int lost = 0;
+
+    if (!latencies || !spawn_parrot(parrot, home, self, &session)) {
+        free(latencies);
+        return 1;
+    }
+
+    /* Wait for the first screen, then for the condition to take hold */
+    int alive = read_screen(&session, -1, LATENCY_TIMEOUT_MS * 5, LATENCY_QUIET_MS, NULL) >= 0 &&
+                set_up_condition(&session, test->condition, tabs);
+
+    for (int i = 0; alive && i < samples; i++) {
+        double seen;
+        double start = bench_now_ns();
+
+        if (!type_text(&session, key)) break;
+        int found = read_screen(&session, LATENCY_KEY, LATENCY_TIMEOUT_MS, 0, &seen);
+        if (found < 0) break;
+        if (found) latencies[measured++] = seen - start;
+        else lost++;
+
+        /* Clear the key off the input line so the next one is the only one */
+        if (!type_text(&session, LATENCY_KILL_LINE)) break;
+        if (read_screen(&session, -1, LATENCY_GAP_MS, 0, NULL) < 0) break;
+    }
+    stop_parrot(&session);
+
+    if (measured + lost < samples) {
+        fprintf(stderr, "latency: %s: parrot exited after %d keys\n", test->name, measured + lost);
+        free(latencies);
+        return 1;
+    }
+
+    qsort(latencies, measured, sizeof(double), compare_doubles);
+    bench_begin_result(test->name);
+    bench_metric("p50_ms", measured ? latencies[measured / 2] / 1e6 : 0);
+    bench_metric("p99_ms", measured ? latencies[measured * 99 / 100] / 1e6 : 0);
+    bench_metric("max_ms", measured ? latencies[measured - 1] / 1e6 : 0);
+    bench_metric("keys", measured);
+    bench_metric("lost", lost);
+    bench_end_result();
+
+    free(latencies);
+    return lost > 0;
+}
+
+/*
+ * Remove one entry of the temporary HOME, called by nftw deepest first
+ */
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)ftw;
+    return type == FTW_DP ? rmdir(path) : unlink(path);
+}
+
+int main(int argc, char *argv[]) {
+    int samples = LATENCY_DEFAULT_SAMPLES;
+    int tabs = LATENCY_DEFAULT_TABS;
+    char self[PATH_MAX];
+    char parrot[PATH_MAX] = "";
+    char home[] = "/tmp/parrot-bench-XXXXXX";
+    int failed = 0;
+
+    if (argc == 2 && strcmp(argv[1], "--produce") == 0) {
+        return run_producer();
+    }
+
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        fprintf(stderr, "latency: cannot find own executable: %s\n", strerror(errno));
+        return 1;
+    }
+    self[len] = '\0';
+
+    /* Options are taken out before the remaining arguments select cases */
+    for (int i = 1; i < argc - 1;) {
+        if (strcmp(argv[i], "--samples") == 0) {
+            samples = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--tabs") == 0) {
+            tabs = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--parrot") == 0) {
+            snprintf(parrot, sizeof(parrot), "%s", argv[i + 1]);
+        } else {
+            i++;
+            continue;
+        }
+        memmove(argv + i, argv + i + 2, (argc - i - 1) * sizeof(char *));
+        argc -= 2;
+    }
+    bench_init(argc, argv);
+    if (samples < 1) samples = 1;
+
+    /* By default the parrot built next to the bench directory */
+    if (!parrot[0]) {
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s", self);
+        snprintf(parrot, sizeof(parrot), "%s/parrot", dirname(dirname(dir)));
+    }
+    if (access(parrot, X_OK) != 0) {
+        fprintf(stderr, "latency: %s: %s (build it with make, or pass --parrot)\n", parrot, strerror(errno));
+        return 1;
+    }
+
+    /* A scratch HOME keeps the user's history and sessions out of the run */
+    if (!mkdtemp(home)) return 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    for (size_t i = 0; i < sizeof(latency_cases) / sizeof(latency_cases[0]); i++) {
+        if (!bench_selected(latency_cases[i].name)) continue;
+        if (run_latency_case(&latency_cases[i], parrot, home, self, samples, tabs) != 0) {
+            fprintf(stderr, "latency: %s failed\n", latency_cases[i].name);
+            failed = 1;
+        }
+    }
+
+    nftw(home, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return failed;
+}
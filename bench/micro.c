@@ -0,0 +1,162 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Scrollback the drawing benchmarks start with */
+#define DRAW_HISTORY_LINES 10000
+#define DRAW_ROWS 40
+#define DRAW_COLS 120
+
+static const char *sample_line =
+    "src/engine/command.c:412: warning: comparison of integer expressions of different signedness";
+
+static const char *sample_escaped =
+    "\033[1;32mPASS\033[0m tests/queue_test.c \033[33m(412 ms)\033[0m \033[2mcached\033[0m";
+
+static const char *sample_path = "/home/bench/projects/parrot-shell/src/engine/ingestion_pipeline";
+
+static const char *sample_tokens[] = {
+    "/tmp", "./missing/file.c", "error:", "compiled", "/etc/passwd", "42", "FAILED"
+};
+
+/*
+ * Append lines to a history buffer
+ */
+static void bench_add_history_line(void *ctx, long long iterations) {
+    HistoryBuffer buf;
+    (void)ctx;
+
+    init_history_buffer(&buf);
+    for (long long i = 0; i < iterations; i++) {
+        add_history_line(&buf, sample_line, HISTORY_TYPE_NORMAL);
+    }
+    bench_stop_timer();
+    free_history_buffer(&buf);
+}
+
+/*
+ * Strip colour codes from a line of build output
+ */
+static void bench_strip_escape_codes(void *ctx, long long iterations) {
+    char line[256];
+    size_t len = strlen(sample_escaped) + 1;
+    (void)ctx;
+
+    for (long long i = 0; i < iterations; i++) {
+        memcpy(line, sample_escaped, len);
+        strip_escape_codes(line);
+    }
+}
+
+/*
+ * Shorten a deep path under HOME for the prompt
+ */
+static void bench_shorten_path(void *ctx, long long iterations) {
+    char path[PATH_MAX];
+    char output[PATH_MAX];
+    (void)ctx;
+
+    snprintf(path, sizeof(path), "%s", sample_path);
+    for (long long i = 0; i < iterations; i++) {
+        shorten_path(path, output, sizeof(output));
+    }
+}
+
+/*
+ * Classify words of output as paths, errors or text
+ */
+static void bench_classify_output_token(void *ctx, long long iterations) {
+    int count = sizeof(sample_tokens) / sizeof(sample_tokens[0]);
+    volatile int sink = 0;
+    (void)ctx;
+
+    for (long long i = 0; i < iterations; i++) {
+        sink += classify_output_token(sample_tokens[i % count]);
+    }
+}
+
+/*
+ * Queue a command and take it off again
+ */
+static void bench_queue_round_trip(void *ctx, long long iterations) {
+    CommandQueue queue;
+    (void)ctx;
+
+    init_command_queue(&queue);
+    for (long long i = 0; i < iterations; i++) {
+        add_to_queue(&queue, "make -j8 all");
+        free(get_from_queue(&queue));
+    }
+    free_command_queue(&queue);
+}
+
+/*
+ * Fill a full queue and drain it, as a burst of submitted commands does
+ */
+static void bench_queue_fill_drain(void *ctx, long long iterations) {
+    CommandQueue queue;
+    (void)ctx;
+
+    init_command_queue(&queue);
+    for (long long i = 0; i < iterations; i++) {
+        while (!is_queue_full(&queue)) add_to_queue(&queue, "make -j8 all");
+        while (!is_queue_empty(&queue)) free(get_from_queue(&queue));
+    }
+    free_command_queue(&queue);
+}
+
+/*
+ * Redraw an unchanged screen, the cost of every main loop iteration
+ */
+static void bench_draw_interface(void *ctx, long long iterations) {
+    Terminal *term = ctx;
+
+    for (long long i = 0; i < iterations; i++) {
+        draw_interface(&term->history, &term->input, 1);
+    }
+}
+
+/*
+ * Redraw while scrolling one line per frame, so every row changes
+ */
+static void bench_draw_interface_scroll(void *ctx, long long iterations) {
+    Terminal *term = ctx;
+
+    for (long long i = 0; i < iterations; i++) {
+        term->history.scroll_offset = i % 2;
+        draw_interface(&term->history, &term->input, 1);
+    }
+    term->history.scroll_offset = 0;
+}
+
+int main(int argc, char *argv[]) {
+    bench_init(argc, argv);
+    setenv("HOME", "/home/bench", 1);
+    headless_mode = 1;
+
+    bench_run("add_history_line", bench_add_history_line, NULL);
+    bench_run("strip_escape_codes", bench_strip_escape_codes, NULL);
+    bench_run("shorten_path", bench_shorten_path, NULL);
+    bench_run("classify_output_token", bench_classify_output_token, NULL);
+    bench_run("queue_round_trip", bench_queue_round_trip, NULL);
+    bench_run("queue_fill_drain", bench_queue_fill_drain, NULL);
+
+    if (bench_selected("draw_interface")) {
+        if (!bench_open_screen(DRAW_ROWS, DRAW_COLS)) return 1;
+        init_terminal_manager();
+
+        Terminal *term = get_active_terminal();
+        for (int i = 0; i < DRAW_HISTORY_LINES; i++) {
+            add_history_line(&term->history, sample_line, i % 10 ? HISTORY_TYPE_NORMAL : HISTORY_TYPE_COMMAND);
+        }
+        set_input_text(&term->input, "grep -rn draw_interface src/");
+
+        bench_run("draw_interface", bench_draw_interface, term);
+        bench_run("draw_interface_scroll", bench_draw_interface_scroll, term);
+
+        free_terminal_manager();
+        bench_close_screen();
+    }
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RENDER_ROWS 40
+#define RENDER_COLS 120
+
+/* Scrollback sizes run by default; --max-lines goes up to 10^7 */
+#define RENDER_MIN_LINES 10000
+#define RENDER_DEFAULT_MAX_LINES 1000000
+
+/* Frames measured per scenario */
+#define RENDER_FRAMES 300
+
+/* Commands the history search runs over */
+#define RENDER_SEARCH_COMMANDS 200
+
+/* Scenarios drawn for every scrollback size and pane count */
+typedef enum {
+    RENDER_STEADY,
+    RENDER_LINE_SCROLL,
+    RENDER_PAGE_SCROLL,
+    RENDER_SEARCH,
+    RENDER_RESIZE,
+    RENDER_PANE_SWITCH,
+    RENDER_SCENARIO_COUNT
+} RenderScenario;
+
+static const char *scenario_names[] = {
+    "steady", "line_scroll", "page_scroll", "search", "resize", "pane_switch"
+};
+
+static const char *sample_lines[] = {
+    "drwxr-xr-x  5 user user  4096 Mar  3 12:01 src",
+    "gcc -std=c99 -Wall -Wextra -O2 -c terminal.c -o terminal.o",
+    "terminal.c:412: warning: unused variable 'max_y'",
+    "/usr/include/stdio.h is a regular file",
+    "PASS queue_round_trip (0.02 s)",
+};
+
+/*
+ * Compare frame times for qsort
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Fill a terminal's scrollback with a mix of output and command lines
+ * @param term: Terminal to fill
+ * @param lines: Number of lines
+ */
+static void fill_scrollback(Terminal *term, long lines) {
+    int count = sizeof(sample_lines) / sizeof(sample_lines[0]);
+    char line[128];
+
+    for (long i = 0; i < lines; i++) {
+        if (i % 50 == 0) {
+            snprintf(line, sizeof(line), "[12:00:00] make -C build/%ld", i);
+            add_history_line(&term->history, line, HISTORY_TYPE_COMMAND);
+        } else {
+            add_history_line(&term->history, sample_lines[i % count], HISTORY_TYPE_NORMAL);
+        }
+    }
+}
+
+/*
+ * Lay out terminals as the split commands do: one pane, a split pair,
+ * or two split pairs in two tabs
+ * @param panes: 1, 2 or 4
+ * @param lines: Scrollback of each pane
+ */
+static void build_panes(int panes, long lines) {
+    init_terminal_manager();
+    fill_scrollback(get_active_terminal(), lines);
+
+    for (int i = 1; i < panes; i++) {
+        if (i % 2 == 1) create_split_terminal(SPLIT_VERTICAL);
+        else create_new_terminal();
+        Terminal *term = get_first_terminal();
+        while (get_next_terminal(term)) term = get_next_terminal(term);
+        fill_scrollback(term, lines);
+        switch_terminal(term->id);
+    }
+    switch_terminal(get_first_terminal()->id);
+
+    Terminal *term = get_active_terminal();
+    for (int i = 0; i < RENDER_SEARCH_COMMANDS; i++) {
+        char cmd[64];
+        snprintf(cmd, sizeof(cmd), i % 2 ? "make -C build/%d" : "git log --oneline -n %d", i);
+        add_to_cmd_history(&term->input, cmd, term->current_directory);
+    }
+}
+
+/*
+ * Draw frames of one scenario and report their times
+ * @param name: Result name
+ * @param scenario: What changes between frames
+ */
+static void run_scenario(const char *name, RenderScenario scenario) {
+    double frames[RENDER_FRAMES];
+    int page = RENDER_ROWS - 3;
+
+    Terminal *active = get_active_terminal();
+    if (scenario == RENDER_SEARCH) {
+        start_history_search(&active->input);
+        memcpy(active->input.search_query, "make", 4);
+    }
+
+    for (int i = 0; i < RENDER_FRAMES; i++) {
+        double start = bench_now_ns();
+        active = get_active_terminal();
+
+        switch (scenario) {
+            case RENDER_LINE_SCROLL:
+                scroll_terminal_up(&active->history);
+                break;
+            case RENDER_PAGE_SCROLL:
+                /* There is no page key; a page is as many single-line scrolls */
+                for (int j = 0; j < page; j++) scroll_terminal_up(&active->history);
+                break;
+            case RENDER_SEARCH:
+                active->input.search_len = 3 + i % 2;
+                update_history_search(&active->input);
+                break;
+            case RENDER_RESIZE:
+                if (i % 2) bench_resize_screen(RENDER_ROWS, RENDER_COLS);
+                else bench_resize_screen(RENDER_ROWS - 10, RENDER_COLS - 30);
+                break;
+            case RENDER_PANE_SWITCH:
+                next_terminal();
+                active = get_active_terminal();
+                break;
+            default:
+                break;
+        }
+        draw_interface(&active->history, &active->input, 1);
+        frames[i] = bench_now_ns() - start;
+    }
+
+    if (scenario == RENDER_SEARCH) end_history_search(&active->input, 0);
+    if (scenario == RENDER_RESIZE) bench_resize_screen(RENDER_ROWS, RENDER_COLS);
+    for (Terminal *term = get_first_terminal(); term; term = get_next_terminal(term)) {
+        term->history.scroll_offset = 0;
+    }
+    switch_terminal(get_first_terminal()->id);
+
+    double total = 0;
+    for (int i = 0; i < RENDER_FRAMES; i++) total += frames[i];
+    qsort(frames, RENDER_FRAMES, sizeof(double), compare_doubles);
+
+    bench_begin_result(name);
+    bench_metric("frame_mean_ms", total / RENDER_FRAMES / 1e6);
+    bench_metric("frame_p50_ms", frames[RENDER_FRAMES / 2] / 1e6);
+    bench_metric("frame_p99_ms", frames[RENDER_FRAMES * 99 / 100] / 1e6);
+    bench_metric("frame_max_ms", frames[RENDER_FRAMES - 1] / 1e6);
+    bench_end_result();
+}
+
+int main(int argc, char *argv[]) {
+    static const int pane_counts[] = {1, 2, 4};
+    long max_lines = RENDER_DEFAULT_MAX_LINES;
+    char home[] = "/tmp/parrot-bench-XXXXXX";
+
+    /* --max-lines N is taken out before the remaining arguments select results */
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--max-lines") == 0) {
+            max_lines = atol(argv[i + 1]);
+            memmove(argv + i, argv + i + 2, (argc - i - 1) * sizeof(char *));
+            argc -= 2;
+            break;
+        }
+    }
+    bench_init(argc, argv);
+
+    /* An empty HOME keeps the user's command history out of the search */
+    if (!mkdtemp(home)) return 1;
+    setenv("HOME", home, 1);
+    headless_mode = 1;
+
+    if (!bench_open_screen(RENDER_ROWS, RENDER_COLS)) return 1;
+    for (long lines = RENDER_MIN_LINES; lines <= max_lines; lines *= 10) {
+        for (size_t p = 0; p < sizeof(pane_counts) / sizeof(pane_counts[0]); p++) {
+            int panes = pane_counts[p];
+            char prefix[64];
+            char name[96];
+            int built = 0;
+
+            snprintf(prefix, sizeof(prefix), "render_%ld_lines_%d_pane%s", lines, panes, panes > 1 ? "s" : "");
+            for (int s = 0; s < RENDER_SCENARIO_COUNT; s++) {
+                if (s == RENDER_PANE_SWITCH && panes == 1) continue;
+                snprintf(name, sizeof(name), "%s_%s", prefix, scenario_names[s]);
+                if (!bench_selected(name)) continue;
+                if (!built) {
+                    build_panes(panes, lines);
+                    built = 1;
+                }
+                run_scenario(name, s);
+            }
+            if (built) free_terminal_manager();
+        }
+    }
+    bench_close_screen();
+    free_history_search();
+    close_history_store();
+
+    char path[sizeof(home) + 32];
+    snprintf(path, sizeof(path), "%s/.parrot_history", home);
+    unlink(path);
+    rmdir(home);
+    return 0;
+}
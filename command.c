@@ -0,0 +1,1065 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <poll.h>
+
+/* Upper bound on child output consumed per terminal per pump */
+#define COMMAND_OUTPUT_BUDGET (64 * 1024)
+
+/* Size of the buffer collecting an unfinished line of command output */
+#define PARTIAL_LINE_SIZE (MAX_LINE_LENGTH * 2)
+
+/* Seconds a hung-up child of a closed terminal gets before SIGKILL */
+#define RELEASE_GRACE_SECONDS 5
+
+/*
+ * Resolved program for a command that can be exec'd without /bin/sh
+ */
+typedef struct {
+    char buffer[MAX_CMD_INPUT];
+    char *argv[MAX_CMD_INPUT / 2 + 1];
+    char path[PATH_MAX];
+    int direct;
+} SpawnPlan;
+
+/*
+ * Child of a closed terminal that was hung up and still has to be reaped
+ */
+typedef struct {
+    pid_t pid;
+    time_t released;
+    int killed;
+} ReleasedProcess;
+
+int headless_mode = 0;
+void (*interactive_command_handler)(Terminal *term, const char *cmd) = NULL;
+
+static ReleasedProcess *released_processes = NULL;
+static int released_count = 0;
+static int released_capacity = 0;
+
+/*
+ * Add command to a terminal's queue
+ * @param term: Terminal whose queue receives the command
+ * @param cmd: Command string to queue
+ */
+void add_command_to_queue(Terminal *term, const char *cmd) {
+    if (add_to_queue(&term->cmd_queue, cmd)) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), 
+                 "Command added to queue. Queue size: %d/%d", 
+                 term->cmd_queue.count, COMMAND_QUEUE_SIZE
+                );
+        add_history_line(&term->history, msg, HISTORY_TYPE_NORMAL);
+        prespawn_next_command(term);
+    } else {
+        add_history_line(&term->history, 
+                         "Command queue is full! Maximum 10 commands allowed.", 
+                         HISTORY_TYPE_RAW
+                        );
+        term->input.is_locked = 1;
+    }
+}
+
+/*
+ * Advance the queue of one terminal by a single command
+ * @param term: Terminal whose queue is advanced
+ */
+static void advance_command_queue(Terminal *term) {
+    Terminal *active = get_active_terminal();
+    char *next_cmd;
+    
+    if (term->cmd_state == CMD_STATE_RUNNING) return;
+    
+    if (is_queue_empty(&term->cmd_queue)) {
+        term->cmd_state = CMD_STATE_READY;
+        return;
+    }
+    
+    /* Interactive programs take over the screen, so wait for their tab */
+    if (term != active && !headless_mode && 
+        is_interactive_command(term->cmd_queue.commands[term->cmd_queue.head])) {
+        term->cmd_state = CMD_STATE_QUEUED;
+        return;
+    }
+    
+    if ((next_cmd = get_from_queue(&term->cmd_queue)) == NULL) return;
+    if (term->cmd_queue.state == QUEUE_NORMAL) {
+        term->input.is_locked = 0;
+    }
+    
+    if (term->history.echo_format == ECHO_EVENTS) {
+        write_command_start_event(term, next_cmd);
+    }
+    
+    /* Builtins such as cd act on the process directory */
+    if (term != active && chdir(term->current_directory) != 0) {
+        char msg[PATH_MAX + 256];
+        snprintf(msg, sizeof(msg), "%s: %s, command not run: %.128s",
+                 term->current_directory, strerror(errno), next_cmd);
+        add_history_line(&term->history, msg, HISTORY_TYPE_NORMAL);
+        term->exit_status = 1;
+        cancel_prespawned_command(term);
+    } else {
+        execute_command(term, next_cmd);
+        if (term != active && chdir(active->current_directory) != 0) {
+            char msg[PATH_MAX + 128];
+            snprintf(msg, sizeof(msg), "Cannot return to %s: %s",
+                     active->current_directory, strerror(errno));
+            add_history_line(&active->history, msg, HISTORY_TYPE_NORMAL);
+        }
+    }
+    free(next_cmd);
+    
+    if (term->cmd_state != CMD_STATE_RUNNING) {
+        term->cmd_state = is_queue_empty(&term->cmd_queue) ? 
+                          CMD_STATE_READY : CMD_STATE_QUEUED;
+        term->commands_finished++;
+        if (term->history.echo_format == ECHO_EVENTS) {
+            write_command_end_event(term, -1, NULL);
+        }
+    }
+}
+
+/*
+ * Advance every terminal's queue by at most one command. Called once per
+ * main loop iteration, so the screen is redrawn between queued commands
+ * and queue length never affects stack depth.
+ */
+void process_command_queue() {
+    for (Terminal *term = get_first_terminal(); term; term = get_next_terminal(term)) {
+        advance_command_queue(term);
+    }
+}
+
+/*
+ * Check if command is currently running in active terminal
+ * @return: 1 if command running, 0 otherwise
+ */
+int is_command_running() {
+    Terminal* active = get_active_terminal();
+    return active->cmd_state == CMD_STATE_RUNNING;
+}
+
+/*
+ * Stop command running in a terminal (emulate Ctrl+C)
+ * @param term: Terminal whose command is interrupted
+ */
+void stop_current_command(Terminal *term) {
+    if (term->cmd_state == CMD_STATE_RUNNING && (term->current_process > 0 || replaying_session())) {
+        if (term->current_process > 0) kill(term->current_process, SIGINT);
+        add_history_line(&term->history, 
+                         "Command interrupted (SIGINT sent)", 
+                         HISTORY_TYPE_NORMAL
+                        );
+    } else {
+        add_history_line(&term->history, 
+                         "No command is currently running", 
+                         HISTORY_TYPE_NORMAL
+                        );
+    }
+}
+
+/*
+ * Reset process bookkeeping for a terminal
+ * @param term: Terminal to initialize
+ */
+void init_command_process(Terminal *term) {
+    term->cmd_state = CMD_STATE_READY;
+    term->current_process = 0;
+    term->output_fd = -1;
+    term->partial_line = NULL;
+    term->partial_len = 0;
+    term->error_fd = -1;
+    term->error_line = NULL;
+    term->error_len = 0;
+    term->prespawn.pid = 0;
+    term->prespawn.gate_fd = -1;
+    term->prespawn.output_fd = -1;
+    term->prespawn.error_fd = -1;
+    term->prespawn.command = NULL;
+    term->exit_status = 0;
+    term->commands_finished = 0;
+}
+
+/*
+ * Remember a hung-up child so pump_command_output reaps it later
+ * @param pid: Process that was sent SIGHUP
+ */
+static void add_released_process(pid_t pid) {
+    if (waitpid(pid, NULL, WNOHANG) != 0) return;
+    
+    if (released_count == released_capacity) {
+        int capacity = released_capacity ? released_capacity * 2 : 8;
+        ReleasedProcess *grown = realloc(released_processes, capacity * sizeof(ReleasedProcess));
+        if (!grown) {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            return;
+        }
+        released_processes = grown;
+        released_capacity = capacity;
+    }
+    released_processes[released_count].pid = pid;
+    released_processes[released_count].released = time(NULL);
+    released_processes[released_count].killed = 0;
+    released_count++;
+}
+
+/*
+ * Reap released children that exited, and kill the ones that outlived
+ * RELEASE_GRACE_SECONDS after their hangup
+ */
+static void reap_released_processes(void) {
+    time_t now = time(NULL);
+    
+    for (int i = 0; i < released_count; ) {
+        ReleasedProcess *proc = &released_processes[i];
+        pid_t done = waitpid(proc->pid, NULL, WNOHANG);
+        if (done == proc->pid || (done == -1 && errno == ECHILD)) {
+            released_processes[i] = released_processes[--released_count];
+            continue;
+        }
+        if (!proc->killed && now - proc->released >= RELEASE_GRACE_SECONDS) {
+            kill(proc->pid, SIGKILL);
+            proc->killed = 1;
+        }
+        i++;
+    }
+}
+
+/*
+ * Hang up running and pre-spawned children of a terminal being discarded.
+ * Children still running are reaped later by pump_command_output.
+ * @param term: Terminal whose processes are released
+ */
+void release_command_process(Terminal *term) {
+    cancel_prespawned_command(term);
+    
+    if (term->output_fd >= 0) {
+        close(term->output_fd);
+        term->output_fd = -1;
+    }
+    if (term->error_fd >= 0) {
+        close(term->error_fd);
+        term->error_fd = -1;
+    }
+    if (term->current_process > 0) {
+        kill(term->current_process, SIGHUP);
+        add_released_process(term->current_process);
+        term->current_process = 0;
+    }
+    term->cmd_state = CMD_STATE_READY;
+    
+    free(term->partial_line);
+    term->partial_line = NULL;
+    term->partial_len = 0;
+    free(term->error_line);
+    term->error_line = NULL;
+    term->error_len = 0;
+}
+
+/*
+ * Check whether command is a builtin handled by execute_command itself
+ * @param cmd: Command string to check
+ * @return: 1 if builtin, 0 otherwise
+ */
+int is_builtin_command(const char *cmd) {
+    if (strchr(cmd, '\n') != NULL) return 0;
+    return strcmp(cmd, "stop") == 0 || 
+           strcmp(cmd, "manual") == 0 ||
+           strcmp(cmd, "cd") == 0 || 
+           strncmp(cmd, "cd ", 3) == 0 ||
+           strcmp(cmd, "j") == 0 || 
+           strncmp(cmd, "j ", 2) == 0 ||
+           strcmp(cmd, "snapshot") == 0 || 
+           strncmp(cmd, "snapshot ", 9) == 0;
+}
+
+/*
+ * Check whether command needs the real terminal (curses is suspended)
+ * @param cmd: Command string to check
+ * @return: 1 if interactive, 0 otherwise
+ */
+int is_interactive_command(const char *cmd) {
+    const char* interactive_commands[] = {
+        "vim", "nvim", "nano", "ranger", "parrot", "htop", "top", "sudo", "ssh", "man", "less", "more", NULL
+    };
+    
+    for (int i = 0; interactive_commands[i] != NULL; i++) {
+        if (strncmp(cmd, interactive_commands[i], 
+                    strlen(interactive_commands[i])) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Resolve a simple command to an argv and program path so it can be
+ * exec'd directly; anything using shell syntax is left to /bin/sh
+ * @param cmd: Command string to resolve
+ * @param plan: SpawnPlan to fill
+ */
+static void prepare_spawn_plan(const char *cmd, SpawnPlan *plan) {
+    plan->direct = 0;
+    if (strlen(cmd) >= sizeof(plan->buffer)) return;
+    if (strpbrk(cmd, "|&;<>()$`\\\"'*?[]#~!\n") != NULL) return;
+    
+    strncpy(plan->buffer, cmd, sizeof(plan->buffer) - 1);
+    plan->buffer[sizeof(plan->buffer) - 1] = '\0';
+    
+    int argc = 0;
+    int max_args = (int)(sizeof(plan->argv) / sizeof(plan->argv[0])) - 1;
+    char *save = NULL;
+    char *token = strtok_r(plan->buffer, " \t", &save);
+    while (token != NULL && argc < max_args) {
+        plan->argv[argc++] = token;
+        token = strtok_r(NULL, " \t", &save);
+    }
+    plan->argv[argc] = NULL;
+    
+    /* Variable assignments are shell syntax */
+    if (argc == 0 || strchr(plan->argv[0], '=') != NULL) return;
+    
+    if (strchr(plan->argv[0], '/') != NULL) {
+        if (access(plan->argv[0], X_OK) == 0) {
+            snprintf(plan->path, sizeof(plan->path), "%s", plan->argv[0]);
+            plan->direct = 1;
+        }
+        return;
+    }
+    
+    const char *dir = getenv("PATH");
+    while (dir && *dir) {
+        const char *end = strchr(dir, ':');
+        int len = end ? (int)(end - dir) : (int)strlen(dir);
+        struct stat st;
+        
+        snprintf(plan->path, sizeof(plan->path), 
+                 "%.*s/%s", 
+                 len > 0 ? len : 1, 
+                 len > 0 ? dir : ".", 
+                 plan->argv[0]
+                );
+        if (stat(plan->path, &st) == 0 && S_ISREG(st.st_mode) && 
+            access(plan->path, X_OK) == 0) {
+            plan->direct = 1;
+            return;
+        }
+        dir = end ? end + 1 : NULL;
+    }
+}
+
+/*
+ * Add a spawn failure message with errno description to history
+ * @param history: History buffer for the message, NULL to stay silent
+ * @param what: Description of the failed step
+ */
+static void report_spawn_error(HistoryBuffer *history, const char *what) {
+    if (!history) return;
+    
+    char error_msg[128];
+    snprintf(error_msg, sizeof(error_msg), 
+             "%s: %s", 
+             what, 
+             strerror(errno)
+            );
+    add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
+}
+
+/*
+ * Fork a child for command with stdout/stderr captured in a pipe
+ * @param term: Terminal the command belongs to
+ * @param cmd: Command string to run
+ * @param gate_fd: Receives the write end of a start gate, NULL to exec at once
+ * @param output_fd: Receives the non-blocking read end of the output pipe
+ * @param error_fd: Receives a separate pipe for stderr, NULL to merge it into output_fd
+ * @param history: History buffer for error messages, NULL to stay silent
+ * @return: Child pid, or -1 on failure
+ */
+static pid_t spawn_command_process(Terminal *term, const char *cmd, int *gate_fd, 
+                                   int *output_fd, int *error_fd, HistoryBuffer *history) {
+    SpawnPlan plan;
+    prepare_spawn_plan(cmd, &plan);
+    
+    int pipefd[2];
+    int gatefd[2];
+    int errfd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        report_spawn_error(history, "Failed to create pipe");
+        return -1;
+    }
+    if (error_fd && pipe2(errfd, O_CLOEXEC) == -1) {
+        report_spawn_error(history, "Failed to create pipe");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+    if (gate_fd && pipe2(gatefd, O_CLOEXEC) == -1) {
+        report_spawn_error(history, "Failed to create pipe");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        if (error_fd) {
+            close(errfd[0]);
+            close(errfd[1]);
+        }
+        return -1;
+    }
+    
+    pid_t pid = fork();
+    if (pid == -1) {
+        report_spawn_error(history, "Failed to fork process");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        if (error_fd) {
+            close(errfd[0]);
+            close(errfd[1]);
+        }
+        if (gate_fd) {
+            close(gatefd[0]);
+            close(gatefd[1]);
+        }
+        return -1;
+    }
+    
+    if (pid == 0) {
+        close(pipefd[0]);
+        
+        dup2(pipefd[1], STDOUT_FILENO);
+        dup2(error_fd ? errfd[1] : pipefd[1], STDERR_FILENO);
+        close(pipefd[1]);
+        if (error_fd) {
+            close(errfd[0]);
+            close(errfd[1]);
+        }
+        
+        if (gate_fd) {
+            char go = 0;
+            ssize_t n;
+            
+            close(gatefd[1]);
+            if (chdir(term->current_directory) != 0) _exit(127);
+            do {
+                n = read(gatefd[0], &go, 1);
+            } while (n == -1 && errno == EINTR);
+            if (n != 1) _exit(0);
+            close(gatefd[0]);
+        }
+        
+        if (plan.direct) execv(plan.path, plan.argv);
+        execl("/bin/sh", "sh", "-c", cmd, NULL);
+        
+        _exit(127);
+    }
+    
+    close(pipefd[1]);
+    fcntl(pipefd[0], F_SETFL, fcntl(pipefd[0], F_GETFL) | O_NONBLOCK);
+    *output_fd = pipefd[0];
+    
+    if (error_fd) {
+        close(errfd[1]);
+        fcntl(errfd[0], F_SETFL, fcntl(errfd[0], F_GETFL) | O_NONBLOCK);
+        *error_fd = errfd[0];
+    }
+    
+    if (gate_fd) {
+        close(gatefd[0]);
+        *gate_fd = gatefd[1];
+    }
+    return pid;
+}
+
+/*
+ * Pre-spawn the command at the head of the queue while another one runs,
+ * so fork and PATH resolution are paid before its predecessor exits
+ * @param term: Terminal whose queue is inspected
+ */
+void prespawn_next_command(Terminal *term) {
+    if (term->cmd_state != CMD_STATE_RUNNING || term->prespawn.pid > 0) return;
+    if (is_queue_empty(&term->cmd_queue) || replaying_session()) return;
+    
+    const char *next = term->cmd_queue.commands[term->cmd_queue.head];
+    if (strlen(next) == 0 || strlen(next) >= MAX_CMD_INPUT || is_builtin_command(next) || 
+        is_interactive_command(next)) {
+        return;
+    }
+    
+    int gate_fd, output_fd, error_fd = -1;
+    int split = term->history.echo_format == ECHO_EVENTS;
+    pid_t pid = spawn_command_process(term, next, &gate_fd, &output_fd, 
+                                      split ? &error_fd : NULL, NULL);
+    if (pid == -1) return;
+    
+    term->prespawn.pid = pid;
+    term->prespawn.gate_fd = gate_fd;
+    term->prespawn.output_fd = output_fd;
+    term->prespawn.error_fd = error_fd;
+    term->prespawn.command = strdup(next);
+}
+
+/*
+ * Kill a pre-spawned child that will not be used
+ * @param term: Terminal owning the pre-spawned child
+ */
+void cancel_prespawned_command(Terminal *term) {
+    PendingSpawn *spawn = &term->prespawn;
+    if (spawn->pid <= 0) return;
+    
+    kill(spawn->pid, SIGKILL);
+    waitpid(spawn->pid, NULL, 0);
+    close(spawn->gate_fd);
+    close(spawn->output_fd);
+    if (spawn->error_fd >= 0) close(spawn->error_fd);
+    
+    spawn->pid = 0;
+    spawn->gate_fd = -1;
+    spawn->output_fd = -1;
+    spawn->error_fd = -1;
+    free(spawn->command);
+    spawn->command = NULL;
+}
+
+/*
+ * Release the pre-spawned child if it was prepared for cmd
+ * @param term: Terminal owning the pre-spawned child
+ * @param cmd: Command about to be executed
+ * @param pid: Receives the child pid
+ * @param output_fd: Receives the child output pipe
+ * @param error_fd: Receives the child stderr pipe, -1 if merged into output_fd
+ * @return: 1 if the child was released, 0 if cmd must be spawned normally
+ */
+static int adopt_prespawned_command(Terminal *term, const char *cmd, 
+                                    pid_t *pid, int *output_fd, int *error_fd) {
+    PendingSpawn *spawn = &term->prespawn;
+    if (spawn->pid <= 0) return 0;
+    
+    if (!spawn->command || strcmp(spawn->command, cmd) != 0) {
+        cancel_prespawned_command(term);
+        return 0;
+    }
+    
+    char go = 'g';
+    if (write(spawn->gate_fd, &go, 1) != 1) {
+        cancel_prespawned_command(term);
+        return 0;
+    }
+    close(spawn->gate_fd);
+    
+    *pid = spawn->pid;
+    *output_fd = spawn->output_fd;
+    *error_fd = spawn->error_fd;
+    
+    spawn->pid = 0;
+    spawn->gate_fd = -1;
+    spawn->output_fd = -1;
+    spawn->error_fd = -1;
+    free(spawn->command);
+    spawn->command = NULL;
+    return 1;
+}
+
+/*
+ * Move the pending partial line of child output into history
+ * @param term: Terminal receiving the line
+ * @param stream: OUTPUT_STDOUT, or OUTPUT_STDERR when stderr has its own pipe
+ */
+static void flush_partial_line(Terminal *term, int stream) {
+    char *line = stream == OUTPUT_STDERR ? term->error_line : term->partial_line;
+    int *len = stream == OUTPUT_STDERR ? &term->error_len : &term->partial_len;
+    
+    line[*len] = '\0';
+    strip_escape_codes(line);
+    if (term->history.echo_format == ECHO_EVENTS) {
+        write_output_event(&term->history, stream, line);
+    } else {
+        add_history_line(&term->history, line, HISTORY_TYPE_NORMAL);
+    }
+    *len = 0;
+}
+
+/*
+ * Split a chunk of child output into history lines, keeping the unfinished
+ * tail for the next chunk
+ * @param term: Terminal receiving the output
+ * @param stream: Stream the output came from
+ * @param data: Output bytes
+ * @param len: Number of bytes
+ */
+static void ingest_command_output(Terminal *term, int stream, const char *data, size_t len) {
+    char **line = stream == OUTPUT_STDERR ? &term->error_line : &term->partial_line;
+    int *line_len = stream == OUTPUT_STDERR ? &term->error_len : &term->partial_len;
+    int room = PARTIAL_LINE_SIZE - 1;
+    
+    if (!*line) {
+        *line = malloc(PARTIAL_LINE_SIZE);
+        if (!*line) return;
+    }
+    term->last_active = time(NULL);
+    
+    while (len > 0) {
+        const char *newline = memchr(data, '\n', len);
+        size_t chunk = newline ? (size_t)(newline - data) : len;
+        
+        while (chunk > 0) {
+            size_t space = room - *line_len;
+            size_t take = chunk < space ? chunk : space;
+            memcpy(*line + *line_len, data, take);
+            *line_len += take;
+            data += take;
+            len -= take;
+            chunk -= take;
+            if (*line_len >= room) flush_partial_line(term, stream);
+        }
+        
+        if (newline) {
+            if (*line_len > 0) flush_partial_line(term, stream);
+            data++;
+            len--;
+        }
+    }
+}
+
+/*
+ * Read whatever output a running command has produced on one stream
+ * @param term: Terminal whose command output is read
+ * @param stream: OUTPUT_STDOUT for output_fd, OUTPUT_STDERR for error_fd
+ */
+static void read_command_output(Terminal *term, int stream) {
+    int *fd = stream == OUTPUT_STDERR ? &term->error_fd : &term->output_fd;
+    char buffer[4096];
+    size_t budget = COMMAND_OUTPUT_BUDGET;
+    
+    while (budget > 0) {
+        ssize_t bytes_read = read(*fd, buffer, sizeof(buffer));
+        if (bytes_read > 0) {
+            record_command_output(term, stream, buffer, bytes_read);
+            ingest_command_output(term, stream, buffer, bytes_read);
+            budget -= (size_t)bytes_read < budget ? (size_t)bytes_read : budget;
+            continue;
+        }
+        if (bytes_read == -1 && errno == EINTR) continue;
+        if (bytes_read == -1 && errno == EAGAIN) return;
+        
+        if (stream == OUTPUT_STDERR ? term->error_len > 0 : term->partial_len > 0) {
+            flush_partial_line(term, stream);
+        }
+        close(*fd);
+        *fd = -1;
+        return;
+    }
+}
+
+/*
+ * Report exit status of a finished command and mark terminal ready
+ * @param term: Terminal whose command finished
+ * @param status: Status from waitpid
+ * @param usage: Resources used by the command
+ */
+static void finish_command(Terminal *term, int status, const struct rusage *usage) {
+    term->cmd_state = is_queue_empty(&term->cmd_queue) ? 
+                      CMD_STATE_READY : CMD_STATE_QUEUED;
+    term->current_process = 0;
+    term->last_active = time(NULL);
+    term->exit_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    term->commands_finished++;
+    record_command_exit(term, status);
+    
+    if (term->history.echo_format == ECHO_EVENTS) {
+        write_command_end_event(term, status, usage);
+        return;
+    }
+    
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        char status_msg[128];
+        snprintf(status_msg, sizeof(status_msg), 
+                 "Command exited with status: %d", 
+                 WEXITSTATUS(status)
+                );
+        add_history_line(&term->history, status_msg, HISTORY_TYPE_NORMAL);
+    } else if (WIFSIGNALED(status)) {
+        char signal_msg[128];
+        snprintf(signal_msg, sizeof(signal_msg), 
+                 "Command terminated by signal: %d", 
+                 WTERMSIG(status)
+                );
+        add_history_line(&term->history, signal_msg, HISTORY_TYPE_NORMAL);
+    }
+}
+
+/*
+ * Feed recorded output of a replayed command to its terminal
+ * @param term: Terminal running the replayed command
+ * @param stream: Stream the output came from
+ * @param data: Output bytes
+ * @param len: Number of bytes
+ */
+void replay_command_output(Terminal *term, int stream, const char *data, size_t len) {
+    ingest_command_output(term, stream, data, len);
+}
+
+/*
+ * Finish a replayed command with its recorded status
+ * @param term: Terminal running the replayed command
+ * @param status: Recorded status from wait4
+ */
+void replay_command_exit(Terminal *term, int status) {
+    if (term->partial_len > 0) flush_partial_line(term, OUTPUT_STDOUT);
+    if (term->error_len > 0) flush_partial_line(term, OUTPUT_STDERR);
+    finish_command(term, status, NULL);
+}
+
+/*
+ * Wait until keyboard input or command output is available
+ * @param timeout_ms: Maximum time to wait in milliseconds
+ * @return: Number of ready descriptors, 0 on timeout
+ */
+int wait_for_command_activity(int timeout_ms) {
+    static struct pollfd *fds = NULL;
+    static int fds_capacity = 0;
+    int nfds = 0;
+    
+    if (fds_capacity < terminal_manager.terminal_count * 2 + 2 + CONTROL_MAX_CLIENTS) {
+        int capacity = terminal_manager.terminal_count * 2 + 2 + CONTROL_MAX_CLIENTS + 8;
+        struct pollfd *grown = realloc(fds, capacity * sizeof(struct pollfd));
+        if (!grown) return -1;
+        fds = grown;
+        fds_capacity = capacity;
+    }
+    
+    /* History search or suggestion index still loading, keep the loop spinning */
+    if (history_search_pending() || suggestion_seed_pending()) timeout_ms = 0;
+    timeout_ms = replay_poll_timeout(timeout_ms);
+    
+    if (!headless_mode) {
+        fds[nfds].fd = STDIN_FILENO;
+        fds[nfds].events = POLLIN;
+        nfds++;
+    }
+    nfds += add_control_poll_fds(fds + nfds);
+    
+    Terminal *active = get_active_terminal();
+    for (Terminal *term = get_first_terminal(); term; term = get_next_terminal(term)) {
+        if (term->error_fd >= 0) {
+            fds[nfds].fd = term->error_fd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        if (term->output_fd >= 0) {
+            fds[nfds].fd = term->output_fd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        } else if (term->current_process > 0 && term->error_fd < 0 && timeout_ms > 10) {
+            /* Output closed but child not reaped yet */
+            timeout_ms = 10;
+        }
+        
+        /* Queue advancement pending, only redraw before the next step */
+        if (term->cmd_state == CMD_STATE_QUEUED && term == active) {
+            timeout_ms = 0;
+        }
+    }
+    
+    return poll(fds, nfds, timeout_ms);
+}
+
+/*
+ * Ingest output of running commands and reap the ones that finished,
+ * along with children left behind by closed terminals
+ */
+void pump_command_output(void) {
+    if (released_count > 0) reap_released_processes();
+    
+    for (Terminal *term = get_first_terminal(); term; term = get_next_terminal(term)) {
+        if (term->current_process <= 0) continue;
+        
+        if (term->output_fd >= 0) read_command_output(term, OUTPUT_STDOUT);
+        if (term->error_fd >= 0) read_command_output(term, OUTPUT_STDERR);
+        if (term->output_fd >= 0 || term->error_fd >= 0) continue;
+        
+        int status = 0;
+        struct rusage usage;
+        memset(&usage, 0, sizeof(usage));
+        pid_t done = wait4(term->current_process, &status, WNOHANG, &usage);
+        if (done == term->current_process || (done == -1 && errno == ECHILD)) {
+            finish_command(term, status, &usage);
+        }
+    }
+}
+
+/*
+ * Add the timestamped command, and continuation lines of a multi-line
+ * command, to history
+ * @param history: History buffer to add to
+ * @param cmd: Command string being executed
+ */
+static void add_command_lines(HistoryBuffer *history, const char *cmd) {
+    char timestamped_cmd[512];
+    time_t now = time(NULL);
+    struct tm *t = localtime(&now);
+    char time_buf[32];
+    
+    strftime(time_buf, sizeof(time_buf), "[%H:%M:%S]", t);
+    
+    const char *line_end = strchr(cmd, '\n');
+    snprintf(timestamped_cmd, sizeof(timestamped_cmd), 
+             "%s %.*s", 
+             time_buf, 
+             line_end ? (int)(line_end - cmd) : (int)strlen(cmd), 
+             cmd
+            );
+    add_history_line(history, timestamped_cmd, HISTORY_TYPE_COMMAND);
+    
+    /* Continuation lines of a multi-line command, aligned under the first */
+    while (line_end) {
+        const char *line = line_end + 1;
+        line_end = strchr(line, '\n');
+        snprintf(timestamped_cmd, sizeof(timestamped_cmd), 
+                 "%*s %.*s", 
+                 (int)strlen(time_buf), "", 
+                 line_end ? (int)(line_end - line) : (int)strlen(line), 
+                 line
+                );
+        add_history_line(history, timestamped_cmd, HISTORY_TYPE_RAW);
+    }
+}
+
+/*
+ * Execute command with proper process management
+ * @param term: Terminal the command runs in
+ * @param cmd: Command string to execute
+ */
+void execute_command(Terminal *term, const char *cmd) {
+    term->exit_status = 0;
+    if (strlen(cmd) == 0) return;
+    
+    HistoryBuffer *history = &term->history;
+    InputState *input = &term->input;
+    
+    /* Handle stop command */
+    if (strcmp(cmd, "stop") == 0) {
+        stop_current_command(term);
+        return;
+    }
+    
+    /* Handle manual command */
+    if (strcmp(cmd, "manual") == 0) {
+        add_history_line(history, "Parrot Terminal Usage:", HISTORY_TYPE_RAW);
+        add_history_line(history, "======================", HISTORY_TYPE_RAW);
+        add_history_line(history, "Shift+T: Create new terminal", HISTORY_TYPE_RAW);
+        add_history_line(history, "Shift+W: Close current terminal", HISTORY_TYPE_RAW);
+        add_history_line(history, "Alt+1-9: Switch to terminal 1-9", HISTORY_TYPE_RAW);
+        add_history_line(history, "Alt+/-: Switch to next/previous terminal", HISTORY_TYPE_RAW);
+        add_history_line(history, "Alt+Arrows: Switch between split panes", HISTORY_TYPE_RAW);
+        add_history_line(history, "Arrow Keys: Scroll terminal history", HISTORY_TYPE_RAW);
+        add_history_line(history, "Shift+Up/Down: Navigate command history", HISTORY_TYPE_RAW);
+        add_history_line(history, "Ctrl+R: Reverse search command history (again for next match)", HISTORY_TYPE_RAW);
+        add_history_line(history, "Tab: Complete command or path (again to list candidates)", HISTORY_TYPE_RAW);
+        add_history_line(history, "Right/End at end of line: Accept dimmed history suggestion", HISTORY_TYPE_RAW);
+        add_history_line(history, "Alt+Enter: Insert a new line for multi-line commands", HISTORY_TYPE_RAW);
+        add_history_line(history, "Ctrl+Left/Right, Alt+B/F: Move by word; Ctrl+A/E: Line start/end", HISTORY_TYPE_RAW);
+        add_history_line(history, "Ctrl+K/U: Kill to line end/start, Alt+D/Alt+Backspace: Kill word, Ctrl+Y: Yank", HISTORY_TYPE_RAW);
+        add_history_line(history, "Ctrl+L: Redraw the screen", HISTORY_TYPE_RAW);
+        add_history_line(history, "Ctrl+\\ in 'parrot attach': Detach, leaving terminals and commands running", HISTORY_TYPE_RAW);
+        add_history_line(history, "Type 'snapshot [file]' to save all terminals; 'parrot --restore [file]' reopens them", HISTORY_TYPE_RAW);
+        add_history_line(history, "Type 'j pattern' to jump to a frequently used directory ('j' lists them)", HISTORY_TYPE_RAW);
+        add_history_line(history, "Type 'stop' to interrupt running command", HISTORY_TYPE_RAW);
+        add_history_line(history, "Type 'exit' to quit", HISTORY_TYPE_RAW);
+        add_history_line(history, "Note: Commands queue automatically when another is running", HISTORY_TYPE_RAW);
+        add_history_line(history, "Queue size: 10 commands max", HISTORY_TYPE_RAW);
+        return;
+    }
+    
+    /* Check if another command is running */
+    if (term->cmd_state == CMD_STATE_RUNNING) {
+        add_command_to_queue(term, cmd);
+        return;
+    }
+    
+    /* Add to command history */
+    if (input->cmd_history_count == 0 || 
+        strcmp(cmd, get_cmd_history(input, input->cmd_history_count - 1)) != 0) {
+        add_to_cmd_history(input, cmd, term->current_directory);
+    }
+    
+    /* Multi-line commands always go to the shell */
+    int multi_line = strchr(cmd, '\n') != NULL;
+    
+    /* Handle cd command specially */
+    if (strncmp(cmd, "cd ", 3) == 0 && !multi_line) {
+        const char* dir = cmd + 3;
+        char clean_dir[PATH_MAX];
+        strncpy(clean_dir, dir, sizeof(clean_dir) - 1);
+        clean_dir[sizeof(clean_dir) - 1] = '\0';
+        
+        char *start = clean_dir;
+        while (*start == ' ') start++;
+        char *end = start + strlen(start) - 1;
+        while (end > start && (*end == ' ' || *end == '\n')) {
+            *end = '\0';
+            end--;
+        }
+        
+        /* Completion escapes spaces and metacharacters as the shell would */
+        char *dst = start;
+        for (char *src = start; *src; src++) {
+            if (*src == '\\' && src[1]) src++;
+            *dst++ = *src;
+        }
+        *dst = '\0';
+        
+        if (strcmp(start, "~") == 0) {
+            const char* home = getenv("HOME");
+            if (home) strcpy(clean_dir, home);
+        } else if (strncmp(start, "~/", 2) == 0) {
+            const char* home = getenv("HOME");
+            if (home) {
+                char full_path[PATH_MAX];
+                snprintf(full_path, sizeof(full_path), 
+                         "%s%s", 
+                         home, 
+                         start + 1
+                        );
+                strcpy(clean_dir, full_path);
+            }
+        }
+        
+        if (chdir(clean_dir) != 0) {
+            char error_msg[128];
+            snprintf(error_msg, sizeof(error_msg), 
+                     "cd: %s: %s", 
+                     clean_dir, 
+                     strerror(errno)
+                    );
+            add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
+            term->exit_status = 1;
+        } else {
+            getcwd(term->current_directory, sizeof(term->current_directory));
+            record_directory_visit(term->current_directory);
+        }
+        return;
+    } else if (strcmp(cmd, "cd") == 0) {
+        const char* home = getenv("HOME");
+        if (home) {
+            if (chdir(home) != 0) {
+                char error_msg[128];
+                snprintf(error_msg, sizeof(error_msg), 
+                         "cd: %s: %s", 
+                         home, 
+                         strerror(errno)
+                        );
+                add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
+                term->exit_status = 1;
+            } else {
+                getcwd(term->current_directory, sizeof(term->current_directory));
+                record_directory_visit(term->current_directory);
+            }
+        }
+        return;
+    }
+    
+    /* Handle j command: jump to the best ranked matching directory */
+    if (strcmp(cmd, "j") == 0) {
+        list_frecent_directories(history, 10);
+        return;
+    } else if (strncmp(cmd, "j ", 2) == 0 && !multi_line) {
+        char target[PATH_MAX];
+        char error_msg[MAX_LINE_LENGTH];
+        
+        if (!find_frecent_directory(cmd + 2, target, sizeof(target))) {
+            snprintf(error_msg, sizeof(error_msg), 
+                     "j: no directory matches '%s'", 
+                     cmd + 2
+                    );
+            add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
+            term->exit_status = 1;
+        } else if (chdir(target) != 0) {
+            snprintf(error_msg, sizeof(error_msg), 
+                     "j: %.*s: %s", 
+                     (int)sizeof(error_msg) - 64, 
+                     target, 
+                     strerror(errno)
+                    );
+            add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
+            term->exit_status = 1;
+        } else {
+            getcwd(term->current_directory, sizeof(term->current_directory));
+            record_directory_visit(term->current_directory);
+            add_history_line(history, term->current_directory, HISTORY_TYPE_NORMAL);
+        }
+        return;
+    }
+    
+    /* Handle snapshot command: save every terminal to a file */
+    if (strcmp(cmd, "snapshot") == 0 || (strncmp(cmd, "snapshot ", 9) == 0 && !multi_line)) {
+        char path[PATH_MAX];
+        char msg[PATH_MAX + 128];
+        
+        if (cmd[8] == ' ') {
+            snprintf(path, sizeof(path), "%s", cmd + 9);
+        } else if (!snapshot_default_path(path, sizeof(path))) {
+            add_history_line(history, "snapshot: HOME is not set", HISTORY_TYPE_NORMAL);
+            term->exit_status = 1;
+            return;
+        }
+        if (!save_snapshot(path, msg, sizeof(msg))) term->exit_status = 1;
+        add_history_line(history, msg, HISTORY_TYPE_NORMAL);
+        return;
+    }
+    
+    /* Add timestamped command to history, unless only its output is wanted */
+    if (!history->echo) add_command_lines(history, cmd);
+    
+    /* A replay has no record of what happened inside an interactive application */
+    if (is_interactive_command(cmd) && replaying_session()) {
+        add_history_line(history, "Interactive application skipped in replay", HISTORY_TYPE_NORMAL);
+        return;
+    }
+    
+    /* Interactive applications get the terminal from the interface */
+    if (is_interactive_command(cmd) && !headless_mode && interactive_command_handler) {
+        interactive_command_handler(term, cmd);
+        return;
+    }
+    
+    /* A replayed command runs without a process; continue_replay() feeds it */
+    if (replaying_session()) {
+        term->cmd_state = CMD_STATE_RUNNING;
+        term->current_process = 0;
+        term->output_fd = -1;
+        term->partial_len = 0;
+        term->error_fd = -1;
+        term->error_len = 0;
+        return;
+    }
+    
+    /* Start regular command; its output is ingested by pump_command_output() */
+    pid_t pid;
+    int output_fd, error_fd = -1;
+    if (!adopt_prespawned_command(term, cmd, &pid, &output_fd, &error_fd)) {
+        int split = history->echo_format == ECHO_EVENTS;
+        pid = spawn_command_process(term, cmd, NULL, &output_fd, 
+                                    split ? &error_fd : NULL, history);
+        if (pid == -1) {
+            term->exit_status = 127;
+            return;
+        }
+    }
+    
+    term->cmd_state = CMD_STATE_RUNNING;
+    term->current_process = pid;
+    term->output_fd = output_fd;
+    term->partial_len = 0;
+    term->error_fd = error_fd;
+    term->error_len = 0;
+    
+    prespawn_next_command(term);
+}
@@ -0,0 +1,505 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/* Number of directory listings kept in the cache */
+#define COMPLETION_DIR_CACHE 8
+
+/* Candidates listed when Tab cannot extend the word */
+#define COMPLETION_LIST_MAX 64
+
+/* Characters escaped with a backslash when a completed name is inserted */
+#define SHELL_SPECIAL_CHARS "|&;<>()$`\\\"'*?[]#~!{}="
+
+/*
+ * Sorted set of names stored back to back in one arena
+ */
+typedef struct {
+    char *arena;
+    size_t arena_size;
+    size_t arena_capacity;
+    size_t *offsets;
+    const char **names;
+    int count;
+    int capacity;
+} NameIndex;
+
+/*
+ * Cached listing of one directory, valid while its mtime is unchanged
+ */
+typedef struct {
+    char *path;
+    struct timespec mtime;
+    unsigned long last_used;
+    NameIndex names;
+} DirectoryListing;
+
+/*
+ * Executables found on PATH, valid while PATH and every directory's
+ * mtime are unchanged
+ */
+typedef struct {
+    char *path_env;
+    struct timespec *mtimes;
+    int dir_count;
+    NameIndex names;
+} ExecutableIndex;
+
+static const char *builtin_commands[] = {
+    "cd", "exit", "j", "manual", "snapshot", "stop", NULL
+};
+
+static DirectoryListing dir_cache[COMPLETION_DIR_CACHE];
+static unsigned long dir_cache_clock = 0;
+static ExecutableIndex exec_index = {0};
+
+/*
+ * Append name to the index (unsorted until finish_name_index)
+ * @param index: NameIndex to extend
+ * @param name: Name to add
+ * @return: 1 on success, 0 on allocation failure
+ */
+static int add_index_name(NameIndex *index, const char *name) {
+    size_t len = strlen(name) + 1;
+
+    if (index->arena_size + len > index->arena_capacity) {
+        size_t capacity = index->arena_capacity ? index->arena_capacity * 2 : 4096;
+        while (capacity < index->arena_size + len) capacity *= 2;
+        char *arena = realloc(index->arena, capacity);
+        if (!arena) return 0;
+        index->arena = arena;
+        index->arena_capacity = capacity;
+    }
+    if (index->count >= index->capacity) {
+        int capacity = index->capacity ? index->capacity * 2 : 256;
+        size_t *offsets = realloc(index->offsets, capacity * sizeof(size_t));
+        if (!offsets) return 0;
+        index->offsets = offsets;
+        index->capacity = capacity;
+    }
+
+    memcpy(index->arena + index->arena_size, name, len);
+    index->offsets[index->count++] = index->arena_size;
+    index->arena_size += len;
+    return 1;
+}
+
+/*
+ * Compare two name pointers for qsort
+ */
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/*
+ * Sort names and drop duplicates
+ * @param index: NameIndex to finish
+ */
+static void finish_name_index(NameIndex *index) {
+    free(index->names);
+    index->names = malloc((index->count + 1) * sizeof(char*));
+    if (!index->names) {
+        index->count = 0;
+        return;
+    }
+
+    for (int i = 0; i < index->count; i++) {
+        index->names[i] = index->arena + index->offsets[i];
+    }
+    qsort(index->names, index->count, sizeof(char*), compare_names);
+
+    int unique = 0;
+    for (int i = 0; i < index->count; i++) {
+        if (unique == 0 || strcmp(index->names[unique - 1], index->names[i]) != 0) {
+            index->names[unique++] = index->names[i];
+        }
+    }
+    index->count = unique;
+
+    free(index->offsets);
+    index->offsets = NULL;
+    index->capacity = 0;
+}
+
+/*
+ * Release all memory of a name index
+ * @param index: NameIndex to clear
+ */
+static void free_name_index(NameIndex *index) {
+    free(index->arena);
+    free(index->offsets);
+    free(index->names);
+    memset(index, 0, sizeof(*index));
+}
+
+/*
+ * Find the range of names starting with prefix
+ * @param index: Sorted NameIndex
+ * @param prefix: Prefix to look up
+ * @param len: Prefix length
+ * @param first: Receives index of the first match
+ * @return: Number of matching names
+ */
+static int find_prefix_range(const NameIndex *index, const char *prefix, size_t len, int *first) {
+    int lo = 0, hi = index->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strncmp(index->names[mid], prefix, len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *first = lo;
+
+    hi = index->count;
+    int start = lo;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strncmp(index->names[mid], prefix, len) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - start;
+}
+
+/*
+ * Check whether two timestamps differ
+ */
+static int timespec_changed(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec != b->tv_sec || a->tv_nsec != b->tv_nsec;
+}
+
+/*
+ * Rebuild the PATH executable index if PATH or any of its directories changed
+ */
+static void refresh_executable_index(void) {
+    const char *path_env = getenv("PATH");
+    if (!path_env) path_env = "";
+
+    int dir_count = 1;
+    for (const char *p = path_env; *p; p++) {
+        if (*p == ':') dir_count++;
+    }
+
+    struct timespec mtimes[dir_count];
+    char *dirs = strdup(path_env);
+    if (!dirs) return;
+
+    int i = 0;
+    char *save = NULL;
+    for (char *dir = strtok_r(dirs, ":", &save); dir; dir = strtok_r(NULL, ":", &save)) {
+        struct stat st;
+        if (stat(dir, &st) == 0) mtimes[i] = st.st_mtim;
+        else mtimes[i].tv_sec = mtimes[i].tv_nsec = 0;
+        i++;
+    }
+    dir_count = i;
+    free(dirs);
+
+    int valid = exec_index.path_env && strcmp(exec_index.path_env, path_env) == 0 &&
+                exec_index.dir_count == dir_count;
+    for (i = 0; valid && i < dir_count; i++) {
+        if (timespec_changed(&exec_index.mtimes[i], &mtimes[i])) valid = 0;
+    }
+    if (valid) return;
+
+    free_name_index(&exec_index.names);
+    free(exec_index.path_env);
+    free(exec_index.mtimes);
+    exec_index.path_env = strdup(path_env);
+    exec_index.mtimes = malloc((dir_count + 1) * sizeof(struct timespec));
+    exec_index.dir_count = dir_count;
+    if (!exec_index.path_env || !exec_index.mtimes) {
+        exec_index.dir_count = 0;
+        return;
+    }
+    memcpy(exec_index.mtimes, mtimes, dir_count * sizeof(struct timespec));
+
+    dirs = strdup(path_env);
+    if (!dirs) return;
+    for (char *dir = strtok_r(dirs, ":", &save); dir; dir = strtok_r(NULL, ":", &save)) {
+        DIR *d = opendir(dir);
+        if (!d) continue;
+
+        int dir_fd = dirfd(d);
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            if (entry->d_type != DT_REG && entry->d_type != DT_LNK &&
+                entry->d_type != DT_UNKNOWN) {
+                continue;
+            }
+            if (faccessat(dir_fd, entry->d_name, X_OK, 0) != 0) continue;
+            add_index_name(&exec_index.names, entry->d_name);
+        }
+        closedir(d);
+    }
+    free(dirs);
+
+    for (i = 0; builtin_commands[i]; i++) {
+        add_index_name(&exec_index.names, builtin_commands[i]);
+    }
+    finish_name_index(&exec_index.names);
+}
+
+/*
+ * Get the cached listing of a directory, reading it if missing or stale
+ * @param path: Directory path
+ * @return: Sorted NameIndex, or NULL if the directory cannot be read
+ */
+static const NameIndex* get_directory_listing(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) return NULL;
+
+    DirectoryListing *slot = &dir_cache[0];
+    for (int i = 0; i < COMPLETION_DIR_CACHE; i++) {
+        DirectoryListing *listing = &dir_cache[i];
+        if (listing->path && strcmp(listing->path, path) == 0) {
+            slot = listing;
+            break;
+        }
+        if (listing->last_used < slot->last_used) slot = listing;
+    }
+
+    slot->last_used = ++dir_cache_clock;
+    if (slot->path && strcmp(slot->path, path) == 0 &&
+        !timespec_changed(&slot->mtime, &st.st_mtim)) {
+        return &slot->names;
+    }
+
+    free(slot->path);
+    free_name_index(&slot->names);
+    slot->path = strdup(path);
+    slot->mtime = st.st_mtim;
+
+    DIR *d = opendir(path);
+    if (!d) {
+        free(slot->path);
+        slot->path = NULL;
+        return NULL;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (!add_index_name(&slot->names, entry->d_name)) break;
+    }
+    closedir(d);
+
+    finish_name_index(&slot->names);
+    return &slot->names;
+}
+
+/*
+ * Length of the common prefix of a range of sorted names
+ * @param names: Sorted names
+ * @param first: Index of the first name
+ * @param count: Number of names
+ * @return: Length of the common prefix
+ */
+static size_t common_prefix_length(const char **names, int first, int count) {
+    /* In a sorted range the first and last name differ the most */
+    const char *a = names[first];
+    const char *b = names[first + count - 1];
+    size_t len = 0;
+    while (a[len] && a[len] == b[len]) len++;
+    return len;
+}
+
+/*
+ * Show candidates in the terminal history when Tab cannot extend the word
+ * @param history: History buffer for the listing
+ * @param names: Sorted names
+ * @param first: Index of the first candidate
+ * @param count: Number of candidates
+ * @param dir: Directory to mark subdirectories in, or NULL
+ */
+static void list_candidates(HistoryBuffer *history, const char **names, int first,
+                            int count, const char *dir) {
+    char line[MAX_LINE_LENGTH];
+    size_t used = 0;
+    int shown = count < COMPLETION_LIST_MAX ? count : COMPLETION_LIST_MAX;
+
+    line[0] = '\0';
+    for (int i = first; i < first + shown; i++) {
+        char name[NAME_MAX + 2];
+        snprintf(name, sizeof(name), "%s", names[i]);
+
+        if (dir) {
+            char full[PATH_MAX];
+            struct stat st;
+            snprintf(full, sizeof(full), "%s/%s", dir, names[i]);
+            if (stat(full, &st) == 0 && S_ISDIR(st.st_mode)) strcat(name, "/");
+        }
+
+        size_t len = strlen(name);
+        if (used > 0 && used + len + 2 >= 80) {
+            add_history_line(history, line, HISTORY_TYPE_NORMAL);
+            used = 0;
+            line[0] = '\0';
+        }
+        used += snprintf(line + used, sizeof(line) - used, "%s%s", used > 0 ? "  " : "", name);
+    }
+    if (used > 0) add_history_line(history, line, HISTORY_TYPE_NORMAL);
+
+    if (count > shown) {
+        snprintf(line, sizeof(line), "... and %d more", count - shown);
+        add_history_line(history, line, HISTORY_TYPE_NORMAL);
+    }
+}
+
+/*
+ * Insert a completed name, backslash-escaping characters the shell would
+ * otherwise split on or interpret
+ * @param input: InputState to edit
+ * @param text: Name text
+ * @param length: Number of bytes to insert
+ */
+static void insert_escaped_name(InputState *input, const char *text, size_t length) {
+    char *escaped = malloc(length * 2 + 1);
+    size_t used = 0;
+    if (!escaped) return;
+
+    for (size_t i = 0; i < length; i++) {
+        if (isspace((unsigned char)text[i]) || strchr(SHELL_SPECIAL_CHARS, text[i])) {
+            escaped[used++] = '\\';
+        }
+        escaped[used++] = text[i];
+    }
+    insert_input_text(input, escaped, (int)used);
+    free(escaped);
+}
+
+/*
+ * Complete the word before the cursor (Tab). The first word completes
+ * from builtins and PATH executables, any other word from directory
+ * entries. A unique match is inserted in full, several matches are
+ * extended to their common prefix and listed when nothing can be added.
+ * Backslash escapes in the word are honoured and added to inserted text.
+ * @param input: InputState to edit
+ * @param history: History buffer for candidate listings
+ */
+void complete_input(InputState *input, HistoryBuffer *history) {
+    int word_start = input->cursor_pos;
+    while (word_start > 0 && (!isspace((unsigned char)input_char_at(input, word_start - 1)) ||
+                              (word_start > 1 && input_char_at(input, word_start - 2) == '\\'))) {
+        word_start--;
+    }
+
+    /* The first word of the current line names the command */
+    int first_word = 1;
+    for (int i = word_start - 1; i >= 0 && input_char_at(input, i) != '\n'; i--) {
+        if (!isspace((unsigned char)input_char_at(input, i))) first_word = 0;
+    }
+
+    char word[MAX_CMD_INPUT];
+    int word_len = 0;
+    if (input->cursor_pos - word_start >= (int)sizeof(word)) return;
+    for (int i = word_start; i < input->cursor_pos; i++) {
+        char c = input_char_at(input, i);
+        if (c == '\\' && i + 1 < input->cursor_pos) c = input_char_at(input, ++i);
+        word[word_len++] = c;
+    }
+    word[word_len] = '\0';
+
+    const NameIndex *index;
+    const char *prefix;
+    char dir[PATH_MAX];
+    int is_command = first_word && strchr(word, '/') == NULL;
+
+    if (is_command) {
+        refresh_executable_index();
+        index = &exec_index.names;
+        prefix = word;
+        dir[0] = '\0';
+    } else {
+        char *slash = strrchr(word, '/');
+        prefix = slash ? slash + 1 : word;
+
+        const char *cwd = get_active_terminal()->current_directory;
+        if (!slash) {
+            snprintf(dir, sizeof(dir), "%s", cwd);
+        } else if (word[0] == '~' && (word + 1 == slash || word[1] == '/')) {
+            const char *home = getenv("HOME");
+            snprintf(dir, sizeof(dir), "%s%.*s", home ? home : "", (int)(slash - word - 1), word + 1);
+            if (dir[0] == '\0') snprintf(dir, sizeof(dir), "/");
+        } else if (slash == word) {
+            snprintf(dir, sizeof(dir), "/");
+        } else if (word[0] == '/') {
+            snprintf(dir, sizeof(dir), "%.*s", (int)(slash - word), word);
+        } else {
+            int len = snprintf(dir, sizeof(dir), "%s/%.*s", cwd, (int)(slash - word), word);
+            if (len >= (int)sizeof(dir)) return;
+        }
+
+        index = get_directory_listing(dir);
+        if (!index) return;
+    }
+
+    size_t prefix_len = strlen(prefix);
+    int first;
+    int count = find_prefix_range(index, prefix, prefix_len, &first);
+    if (count == 0) return;
+
+    /*
+     * Hidden entries only when asked for. A non-empty prefix already
+     * decides this; for an empty one the dot entries form one sorted block.
+     */
+    const char **names = index->names;
+    const char **visible = NULL;
+    if (!is_command && prefix_len == 0) {
+        int dot_first;
+        int dot_count = find_prefix_range(index, ".", 1, &dot_first);
+        if (dot_count == count) return;
+        if (dot_count > 0) {
+            visible = malloc((count - dot_count) * sizeof(char*));
+            if (!visible) return;
+            memcpy(visible, names, dot_first * sizeof(char*));
+            memcpy(visible + dot_first, names + dot_first + dot_count,
+                   (count - dot_first - dot_count) * sizeof(char*));
+            names = visible;
+            first = 0;
+            count -= dot_count;
+        }
+    }
+
+    const char *match = names[first];
+    size_t common = count == 1 ? strlen(match) : common_prefix_length(names, first, count);
+
+    if (common > prefix_len) {
+        insert_escaped_name(input, match + prefix_len, common - prefix_len);
+    }
+
+    if (count == 1) {
+        struct stat st;
+        char full[PATH_MAX];
+        snprintf(full, sizeof(full), "%s/%s", dir, match);
+        if (!is_command && stat(full, &st) == 0 && S_ISDIR(st.st_mode)) {
+            insert_input_text(input, "/", 1);
+        } else {
+            insert_input_text(input, " ", 1);
+        }
+    } else if (common == prefix_len) {
+        list_candidates(history, names, first, count, is_command ? NULL : dir);
+    }
+
+    free(visible);
+}
+
+/*
+ * Release completion caches
+ */
+void free_completion_cache(void) {
+    for (int i = 0; i < COMPLETION_DIR_CACHE; i++) {
+        free(dir_cache[i].path);
+        free_name_index(&dir_cache[i].names);
+        dir_cache[i].path = NULL;
+        dir_cache[i].last_used = 0;
+    }
+    free_name_index(&exec_index.names);
+    free(exec_index.path_env);
+    free(exec_index.mtimes);
+    memset(&exec_index, 0, sizeof(exec_index));
+}
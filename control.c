@@ -0,0 +1,719 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Longest request line a client may send */
+#define CONTROL_REQUEST_SIZE 65536
+
+/* Most scrollback lines returned by one request or carried by one notification */
+#define CONTROL_MAX_LINES 10000
+#define CONTROL_BATCH_LINES 256
+
+/* Unsent bytes after which a subscriber gets no new batches until it reads */
+#define CONTROL_BACKLOG_LIMIT (256 * 1024)
+
+/* JSON-RPC error codes */
+#define RPC_PARSE_ERROR -32700
+#define RPC_INVALID_REQUEST -32600
+#define RPC_METHOD_NOT_FOUND -32601
+#define RPC_INVALID_PARAMS -32602
+#define RPC_QUEUE_FULL -32000
+
+/*
+ * Build the socket path of a named session. Sockets live in
+ * $XDG_RUNTIME_DIR/parrot, or /tmp/parrot-<uid>, created mode 0700. A
+ * directory that is not ours alone is refused.
+ * @param name: Session name
+ * @param path: Receives the socket path
+ * @param size: Size of path
+ * @return: 0 on success, -1 with errno set if the name or directory is unusable
+ */
+int session_socket_path(const char *name, char *path, size_t size) {
+    char dir[PATH_MAX];
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+
+    if (!name[0] || strchr(name, '/')) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (runtime && runtime[0]) {
+        snprintf(dir, sizeof(dir), "%s/parrot", runtime);
+    } else {
+        snprintf(dir, sizeof(dir), "/tmp/parrot-%d", (int)getuid());
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return -1;
+
+    /* Another user could have created it to plant or replace our socket */
+    struct stat st;
+    if (lstat(dir, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() ||
+        (st.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+        errno = EACCES;
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    if (strlen(dir) + 1 + strlen(name) >= sizeof(addr.sun_path) ||
+        strlen(dir) + 1 + strlen(name) >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(path, size, "%s/%s", dir, name);
+    return 0;
+}
+
+/*
+ * Create the listening socket of a new session
+ * @return: Listening descriptor, or -1 on error
+ */
+int listen_session(const char *path) {
+    struct sockaddr_un addr;
+    size_t len = strlen(path);
+    if (len >= sizeof(addr.sun_path)) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, len + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+/*
+ * Connection to the control socket. Responses and notifications collect
+ * in out until the socket accepts them; subscribed is the ID of the
+ * terminal whose output is forwarded, next_line the first line not sent.
+ */
+typedef struct {
+    int fd;
+    char *in;
+    size_t in_len;
+    FILE *out;
+    char *out_data;
+    size_t out_len;
+    size_t out_sent;
+    int subscribed;
+    int next_line;
+} ControlClient;
+
+static int control_fd = -1;
+static char control_path[PATH_MAX];
+static ControlClient clients[CONTROL_MAX_CLIENTS];
+
+/*
+ * Skip JSON whitespace
+ * @param p: Position in the request
+ * @return: First position that is not whitespace
+ */
+static const char* skip_space(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+/*
+ * Skip one JSON value of any type
+ * @param p: Start of the value
+ * @return: Position after the value, or NULL if it is malformed
+ */
+static const char* skip_value(const char *p) {
+    int depth = 0;
+
+    do {
+        p = skip_space(p);
+        if (*p == '"') {
+            for (p++; *p != '"'; p++) {
+                if (*p == '\0') return NULL;
+                if (*p == '\\' && *++p == '\0') return NULL;
+            }
+            p++;
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+            p++;
+            continue;
+        } else if (*p == '}' || *p == ']') {
+            if (depth == 0) return NULL;
+            depth--;
+            p++;
+        } else {
+            const char *start = p;
+            while (*p && !strchr(",:}] \t\r\n", *p)) p++;
+            if (p == start) return NULL;
+        }
+        p = skip_space(p);
+        if (depth > 0 && (*p == ',' || *p == ':')) p++;
+    } while (depth > 0);
+    return p;
+}
+
+/*
+ * Find a member of a JSON object by name
+ * @param object: Object text starting at '{'
+ * @param key: Member name, without escapes
+ * @return: Start of the member's value, or NULL if absent
+ */
+static const char* find_member(const char *object, const char *key) {
+    size_t key_len = strlen(key);
+    const char *p = skip_space(object);
+    if (*p != '{') return NULL;
+    p = skip_space(p + 1);
+
+    while (*p == '"') {
+        const char *name = p + 1;
+        const char *end = skip_value(p);
+        if (!end || *end != ':') return NULL;
+
+        const char *value = skip_space(end + 1);
+        if (strncmp(name, key, key_len) == 0 && name[key_len] == '"') return value;
+        p = skip_value(value);
+        if (!p || *p != ',') return NULL;
+        p = skip_space(p + 1);
+    }
+    return NULL;
+}
+
+/*
+ * Read a JSON integer
+ * @param value: Start of the value
+ * @param out: Receives the number
+ * @return: 1 on success, 0 if the value is not an integer
+ */
+static int read_int(const char *value, long *out) {
+    char *end;
+    if (!value || !(*value == '-' || (*value >= '0' && *value <= '9'))) return 0;
+    *out = strtol(value, &end, 10);
+    return end != value && !strchr(".eE", *end);
+}
+
+/*
+ * Encode a code point as UTF-8
+ * @param cp: Code point
+ * @param out: Receives up to 4 bytes
+ * @return: Number of bytes written
+ */
+static int encode_utf8(uint32_t cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F);
+    out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+/*
+ * Read a JSON string, decoding its escapes to UTF-8
+ * @param value: Start of the value
+ * @param out: Receives the text
+ * @param size: Size of out
+ * @return: 1 on success, 0 if malformed or too long
+ */
+static int read_string(const char *value, char *out, size_t size) {
+    size_t len = 0;
+
+    if (!value || *value != '"') return 0;
+    for (const char *p = value + 1; *p != '"'; p++) {
+        uint32_t cp = (unsigned char)*p;
+        int escaped = cp == '\\';
+        if (cp == '\0') return 0;
+        if (escaped) {
+            p++;
+            switch (*p) {
+                case 'n': cp = '\n'; break;
+                case 't': cp = '\t'; break;
+                case 'r': cp = '\r'; break;
+                case 'b': cp = '\b'; break;
+                case 'f': cp = '\f'; break;
+                case '"': case '\\': case '/': cp = *p; break;
+                case 'u': {
+                    char hex[5] = {0};
+                    for (int i = 0; i < 4; i++) {
+                        if (!p[1 + i]) return 0;
+                        hex[i] = p[1 + i];
+                    }
+                    cp = strtoul(hex, NULL, 16);
+                    p += 4;
+                    if (cp >= 0xD800 && cp < 0xDC00 && p[1] == '\\' && p[2] == 'u') {
+                        for (int i = 0; i < 4; i++) {
+                            if (!p[3 + i]) return 0;
+                            hex[i] = p[3 + i];
+                        }
+                        uint32_t low = strtoul(hex, NULL, 16);
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                    break;
+                }
+                default: return 0;
+            }
+        }
+
+        /* Raw bytes of the request are copied as they are */
+        char bytes[4];
+        int n = 1;
+        bytes[0] = cp;
+        if (escaped) n = encode_utf8(cp, bytes);
+        if (len + n >= size) return 0;
+        memcpy(out + len, bytes, n);
+        len += n;
+    }
+    out[len] = '\0';
+    return 1;
+}
+
+/*
+ * Name the execution state of a terminal
+ * @param term: Terminal to describe
+ * @return: "ready", "running" or "queued"
+ */
+static const char* state_name(Terminal *term) {
+    if (term->cmd_state == CMD_STATE_RUNNING) return "running";
+    if (term->cmd_state == CMD_STATE_QUEUED || !is_queue_empty(&term->cmd_queue)) return "queued";
+    return "ready";
+}
+
+/*
+ * Start a response, echoing the request ID
+ * @param w: Writer to start
+ * @param client: Client receiving the response
+ * @param id: Raw JSON text of the request ID
+ * @param id_len: Length of id
+ */
+static void begin_response(JsonWriter *w, ControlClient *client, const char *id, size_t id_len) {
+    json_begin(w, client->out);
+    json_text(w, "{\"jsonrpc\":\"2.0\",\"id\":");
+    if (id_len > 0) json_raw(w, id, id_len);
+    else json_text(w, "null");
+}
+
+/*
+ * Finish a response or notification and queue it on the client
+ * @param w: Writer holding the message
+ * @param client: Client receiving it
+ */
+static void end_message(JsonWriter *w, ControlClient *client) {
+    json_raw(w, "}\n", 2);
+    json_flush(w);
+    fflush(client->out);
+}
+
+/*
+ * Queue an error response
+ * @param client: Client receiving the error
+ * @param id: Raw JSON text of the request ID
+ * @param id_len: Length of id
+ * @param code: JSON-RPC error code
+ * @param message: Error description
+ */
+static void send_error(ControlClient *client, const char *id, size_t id_len,
+                       int code, const char *message) {
+    JsonWriter w;
+    begin_response(&w, client, id, id_len);
+    json_text(&w, ",\"error\":{\"code\":");
+    json_int(&w, code);
+    json_text(&w, ",\"message\":");
+    json_string(&w, message);
+    json_text(&w, "}");
+    end_message(&w, client);
+}
+
+/*
+ * Write the summary of a terminal as a JSON object
+ * @param w: Writer
+ * @param term: Terminal to describe
+ */
+static void write_terminal_summary(JsonWriter *w, Terminal *term) {
+    json_text(w, "{\"terminal\":");
+    json_int(w, term->id);
+    json_text(w, ",\"active\":");
+    json_text(w, term == get_active_terminal() ? "true" : "false");
+    json_text(w, ",\"cwd\":");
+    json_string(w, term->current_directory);
+    json_text(w, ",\"state\":\"");
+    json_text(w, state_name(term));
+    json_text(w, "\",\"queued\":");
+    json_int(w, term->cmd_queue.count);
+    json_text(w, ",\"lines\":");
+    json_int(w, term->history.count);
+    json_text(w, "}");
+}
+
+/*
+ * Handle one request line
+ * @param client: Client that sent it
+ * @param request: NUL-terminated request
+ */
+static void handle_control_request(ControlClient *client, const char *request) {
+    JsonWriter w;
+    char method[32];
+    const char *id = find_member(request, "id");
+    const char *id_end = id ? skip_value(id) : NULL;
+    size_t id_len = id_end ? (size_t)(id_end - id) : 0;
+
+    if (*skip_space(request) != '{' || !skip_value(request)) {
+        send_error(client, NULL, 0, RPC_PARSE_ERROR, "Parse error");
+        return;
+    }
+    if (!read_string(find_member(request, "method"), method, sizeof(method))) {
+        send_error(client, id, id_len, RPC_INVALID_REQUEST, "Missing method");
+        return;
+    }
+
+    /* Every method but list addresses a terminal, the active one by default */
+    const char *params = find_member(request, "params");
+    Terminal *term = get_active_terminal();
+    long value;
+    if (params && read_int(find_member(params, "terminal"), &value)) {
+        term = find_terminal((int)value);
+        if (!term) {
+            send_error(client, id, id_len, RPC_INVALID_PARAMS, "No such terminal");
+            return;
+        }
+    }
+
+    if (strcmp(method, "list") == 0) {
+        begin_response(&w, client, id, id_len);
+        json_text(&w, ",\"result\":[");
+        for (Terminal *t = get_first_terminal(); t; t = get_next_terminal(t)) {
+            if (t != get_first_terminal()) json_raw(&w, ",", 1);
+            write_terminal_summary(&w, t);
+        }
+        json_text(&w, "]");
+        end_message(&w, client);
+    } else if (strcmp(method, "submit") == 0) {
+        char command[MAX_CMD_INPUT];
+        if (!params || !read_string(find_member(params, "command"), command, sizeof(command)) ||
+            command[0] == '\0') {
+            send_error(client, id, id_len, RPC_INVALID_PARAMS, "Missing command");
+            return;
+        }
+        if (!add_to_queue(&term->cmd_queue, command)) {
+            send_error(client, id, id_len, RPC_QUEUE_FULL, "Command queue is full");
+            return;
+        }
+        if (term->cmd_state == CMD_STATE_RUNNING) prespawn_next_command(term);
+        begin_response(&w, client, id, id_len);
+        json_text(&w, ",\"result\":{\"terminal\":");
+        json_int(&w, term->id);
+        json_text(&w, ",\"position\":");
+        json_int(&w, term->cmd_queue.count);
+        json_text(&w, "}");
+        end_message(&w, client);
+    } else if (strcmp(method, "state") == 0) {
+        begin_response(&w, client, id, id_len);
+        json_text(&w, ",\"result\":{\"terminal\":");
+        json_int(&w, term->id);
+        json_text(&w, ",\"cwd\":");
+        json_string(&w, term->current_directory);
+        json_text(&w, ",\"state\":\"");
+        json_text(&w, state_name(term));
+        json_text(&w, "\",\"pid\":");
+        json_int(&w, term->cmd_state == CMD_STATE_RUNNING ? term->current_process : 0);
+        json_text(&w, ",\"last_exit\":");
+        json_int(&w, term->exit_status);
+        json_text(&w, ",\"finished\":");
+        json_uint(&w, term->commands_finished);
+        json_text(&w, ",\"lines\":");
+        json_int(&w, term->history.count);
+        json_text(&w, ",\"queue\":[");
+        for (int i = 0; i < term->cmd_queue.count; i++) {
+            if (i > 0) json_raw(&w, ",", 1);
+            json_string(&w, term->cmd_queue.commands[(term->cmd_queue.head + i) % COMMAND_QUEUE_SIZE]);
+        }
+        json_text(&w, "]}");
+        end_message(&w, client);
+    } else if (strcmp(method, "scrollback") == 0) {
+        long start = 0, count = 100;
+        HistoryBuffer *history = &term->history;
+        if (params) read_int(find_member(params, "start"), &start);
+        if (params) read_int(find_member(params, "count"), &count);
+
+        /* Negative starts count back from the newest line */
+        wake_history_buffer(history);
+        if (start < 0) start = history->count + start;
+        if (start < 0) start = 0;
+        if (start > history->count) start = history->count;
+        if (count < 0) count = 0;
+        if (count > CONTROL_MAX_LINES) count = CONTROL_MAX_LINES;
+        if (count > history->count - start) count = history->count - start;
+
+        begin_response(&w, client, id, id_len);
+        json_text(&w, ",\"result\":{\"terminal\":");
+        json_int(&w, term->id);
+        json_text(&w, ",\"start\":");
+        json_int(&w, start);
+        json_text(&w, ",\"total\":");
+        json_int(&w, history->count);
+        json_text(&w, ",\"lines\":[");
+        for (long i = start; i < start + count; i++) {
+            if (i > start) json_raw(&w, ",", 1);
+            json_text(&w, "{\"type\":");
+            json_int(&w, history->line_types[i]);
+            json_text(&w, ",\"time\":");
+            json_int(&w, history->timestamps[i]);
+            json_text(&w, ",\"text\":");
+            json_string(&w, history->lines[i]);
+            json_text(&w, "}");
+        }
+        json_text(&w, "]}");
+        end_message(&w, client);
+    } else if (strcmp(method, "subscribe") == 0) {
+        long from = term->history.count;
+        if (params) read_int(find_member(params, "from"), &from);
+        if (from < 0 || from > term->history.count) from = term->history.count;
+
+        client->subscribed = term->id;
+        client->next_line = from;
+        begin_response(&w, client, id, id_len);
+        json_text(&w, ",\"result\":{\"terminal\":");
+        json_int(&w, term->id);
+        json_text(&w, ",\"next\":");
+        json_int(&w, from);
+        json_text(&w, "}");
+        end_message(&w, client);
+    } else if (strcmp(method, "unsubscribe") == 0) {
+        client->subscribed = -1;
+        begin_response(&w, client, id, id_len);
+        json_text(&w, ",\"result\":true");
+        end_message(&w, client);
+    } else {
+        send_error(client, id, id_len, RPC_METHOD_NOT_FOUND, "Method not found");
+    }
+}
+
+/*
+ * Queue output notifications for a subscriber, CONTROL_BATCH_LINES lines
+ * at a time, until it has caught up or its backlog is full. Lines are
+ * never dropped: a slow subscriber is simply served later.
+ * @param client: Subscribed client
+ */
+static void forward_subscribed_output(ControlClient *client) {
+    Terminal *term = find_terminal(client->subscribed);
+    JsonWriter w;
+
+    if (!term) {
+        json_begin(&w, client->out);
+        json_text(&w, "{\"jsonrpc\":\"2.0\",\"method\":\"closed\",\"params\":{\"terminal\":");
+        json_int(&w, client->subscribed);
+        json_text(&w, "}");
+        end_message(&w, client);
+        client->subscribed = -1;
+        return;
+    }
+
+    HistoryBuffer *history = &term->history;
+    while (history->spill == NULL && client->next_line < history->count &&
+           client->out_len - client->out_sent < CONTROL_BACKLOG_LIMIT) {
+        int end = client->next_line + CONTROL_BATCH_LINES;
+        if (end > history->count) end = history->count;
+
+        json_begin(&w, client->out);
+        json_text(&w, "{\"jsonrpc\":\"2.0\",\"method\":\"output\",\"params\":{\"terminal\":");
+        json_int(&w, term->id);
+        json_text(&w, ",\"first\":");
+        json_int(&w, client->next_line);
+        json_text(&w, ",\"lines\":[");
+        for (int i = client->next_line; i < end; i++) {
+            if (i > client->next_line) json_raw(&w, ",", 1);
+            json_string(&w, history->lines[i]);
+        }
+        json_text(&w, "]}");
+        end_message(&w, client);
+        client->next_line = end;
+    }
+}
+
+/*
+ * Disconnect a client and release its buffers
+ * @param client: Client to drop
+ */
+static void drop_client(ControlClient *client) {
+    close(client->fd);
+    client->fd = -1;
+    free(client->in);
+    client->in = NULL;
+    if (client->out) fclose(client->out);
+    client->out = NULL;
+    free(client->out_data);
+    client->out_data = NULL;
+}
+
+/*
+ * Send as much queued output as the socket takes. The buffer is reset
+ * once everything queued has gone out.
+ * @param client: Client with output queued
+ * @return: 0 on success, -1 if the client went away
+ */
+static int send_client_output(ControlClient *client) {
+    /* Nothing queued, so there is no buffer to start over */
+    if (client->out_len == 0) return 0;
+
+    while (client->out_sent < client->out_len) {
+        ssize_t sent = send(client->fd, client->out_data + client->out_sent,
+                            client->out_len - client->out_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (sent <= 0) return -1;
+        client->out_sent += sent;
+    }
+
+    /* Everything went out, start the buffer over */
+    fclose(client->out);
+    free(client->out_data);
+    client->out_data = NULL;
+    client->out_len = 0;
+    client->out_sent = 0;
+    client->out = open_memstream(&client->out_data, &client->out_len);
+    return client->out ? 0 : -1;
+}
+
+/*
+ * Read requests from a client and handle every complete line
+ * @param client: Client whose socket is readable
+ * @return: 0 on success, -1 if the client went away or misbehaved
+ */
+static int read_client_requests(ControlClient *client) {
+    while (1) {
+        ssize_t got = recv(client->fd, client->in + client->in_len,
+                           CONTROL_REQUEST_SIZE - 1 - client->in_len, MSG_DONTWAIT);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (got <= 0) return -1;
+        client->in_len += got;
+
+        char *line = client->in;
+        char *newline;
+        while ((newline = memchr(line, '\n', client->in + client->in_len - line)) != NULL) {
+            *newline = '\0';
+            if (*skip_space(line) != '\0') handle_control_request(client, line);
+            line = newline + 1;
+        }
+        client->in_len -= line - client->in;
+        memmove(client->in, line, client->in_len);
+
+        if (client->in_len >= CONTROL_REQUEST_SIZE - 1) return -1;
+    }
+}
+
+/*
+ * Accept a pending connection if there is a free client slot
+ */
+static void accept_control_client(void) {
+    int fd = accept4(control_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        ControlClient *client = &clients[i];
+        if (client->fd >= 0) continue;
+
+        memset(client, 0, sizeof(*client));
+        client->fd = fd;
+        client->subscribed = -1;
+        client->in = malloc(CONTROL_REQUEST_SIZE);
+        client->out = open_memstream(&client->out_data, &client->out_len);
+        if (!client->in || !client->out) drop_client(client);
+        return;
+    }
+    close(fd);
+}
+
+/*
+ * Open the control socket at $XDG_RUNTIME_DIR/parrot/control.<pid> and
+ * export its path as PARROT_CONTROL, so commands run inside the terminal
+ * can drive it. Failure leaves the terminal without a control socket.
+ */
+void init_control_socket(void) {
+    char name[32];
+
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) clients[i].fd = -1;
+
+    snprintf(name, sizeof(name), "control.%d", (int)getpid());
+    if (session_socket_path(name, control_path, sizeof(control_path)) != 0) return;
+    unlink(control_path);
+
+    control_fd = listen_session(control_path);
+    if (control_fd < 0) return;
+    fcntl(control_fd, F_SETFL, fcntl(control_fd, F_GETFL) | O_NONBLOCK);
+    setenv("PARROT_CONTROL", control_path, 1);
+}
+
+/*
+ * Add the control socket and its clients to a poll set
+ * @param fds: Room for CONTROL_MAX_CLIENTS + 1 entries
+ * @return: Number of entries added
+ */
+int add_control_poll_fds(struct pollfd *fds) {
+    int nfds = 0;
+    if (control_fd < 0) return 0;
+
+    fds[nfds].fd = control_fd;
+    fds[nfds].events = POLLIN;
+    nfds++;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) continue;
+        fds[nfds].fd = clients[i].fd;
+        fds[nfds].events = POLLIN;
+        if (clients[i].out_sent < clients[i].out_len) fds[nfds].events |= POLLOUT;
+        nfds++;
+    }
+    return nfds;
+}
+
+/*
+ * Accept connections, handle requests, forward subscribed output and
+ * send what the clients can take. Called once per main loop iteration.
+ */
+void process_control_requests(void) {
+    if (control_fd < 0) return;
+
+    accept_control_client();
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        ControlClient *client = &clients[i];
+        if (client->fd < 0) continue;
+
+        if (read_client_requests(client) != 0) {
+            drop_client(client);
+            continue;
+        }
+        if (client->subscribed >= 0) forward_subscribed_output(client);
+        if (send_client_output(client) != 0) drop_client(client);
+    }
+}
+
+/*
+ * Disconnect every client and remove the control socket
+ */
+void close_control_socket(void) {
+    if (control_fd < 0) return;
+
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) drop_client(&clients[i]);
+    }
+    close(control_fd);
+    control_fd = -1;
+    unlink(control_path);
+    unsetenv("PARROT_CONTROL");
+}
@@ -0,0 +1,383 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Smallest allocation for an input buffer */
+#define GAP_BUFFER_MIN 128
+
+/* Text removed by the last kill command, shared by all terminals */
+static char *kill_buffer = NULL;
+static int kill_length = 0;
+
+/*
+ * Initialize an empty gap buffer
+ * @param gb: GapBuffer to initialize
+ */
+void init_gap_buffer(GapBuffer *gb) {
+    gb->data = NULL;
+    gb->capacity = 0;
+    gb->gap_start = 0;
+    gb->gap_end = 0;
+    gb->text = NULL;
+    gb->text_capacity = 0;
+    gb->text_valid = 0;
+}
+
+/*
+ * Free gap buffer memory
+ * @param gb: GapBuffer to free
+ */
+void free_gap_buffer(GapBuffer *gb) {
+    free(gb->data);
+    free(gb->text);
+    init_gap_buffer(gb);
+}
+
+/*
+ * Drop the cached text copy, and the whole allocation if the buffer
+ * is empty. Used for terminals that have been idle for a while.
+ * @param gb: GapBuffer to shrink
+ */
+void shrink_gap_buffer(GapBuffer *gb) {
+    free(gb->text);
+    gb->text = NULL;
+    gb->text_capacity = 0;
+    gb->text_valid = 0;
+
+    if (gb->gap_start == 0 && gb->gap_end == gb->capacity) {
+        free(gb->data);
+        gb->data = NULL;
+        gb->capacity = 0;
+        gb->gap_end = 0;
+    }
+}
+
+/*
+ * Number of characters stored in the buffer
+ */
+static int gap_length(const GapBuffer *gb) {
+    return gb->capacity - (gb->gap_end - gb->gap_start);
+}
+
+/*
+ * Make room for at least n more characters, doubling the allocation
+ * @return: 1 on success, 0 on allocation failure
+ */
+static int gap_reserve(GapBuffer *gb, int n) {
+    if (gb->gap_end - gb->gap_start >= n) return 1;
+
+    int length = gap_length(gb);
+    int capacity = gb->capacity ? gb->capacity * 2 : GAP_BUFFER_MIN;
+    while (capacity < length + n) capacity *= 2;
+
+    char *data = malloc(capacity);
+    if (!data) return 0;
+
+    int tail = gb->capacity - gb->gap_end;
+    if (gb->data) {
+        memcpy(data, gb->data, gb->gap_start);
+        memcpy(data + capacity - tail, gb->data + gb->gap_end, tail);
+        free(gb->data);
+    }
+    gb->data = data;
+    gb->gap_end = capacity - tail;
+    gb->capacity = capacity;
+    return 1;
+}
+
+/*
+ * Move the gap so that it starts at pos
+ * @param gb: GapBuffer to rearrange
+ * @param pos: Text position for the gap
+ */
+static void gap_move(GapBuffer *gb, int pos) {
+    if (pos < gb->gap_start) {
+        int n = gb->gap_start - pos;
+        memmove(gb->data + gb->gap_end - n, gb->data + pos, n);
+        gb->gap_start -= n;
+        gb->gap_end -= n;
+    } else if (pos > gb->gap_start) {
+        int n = pos - gb->gap_start;
+        memmove(gb->data + gb->gap_start, gb->data + gb->gap_end, n);
+        gb->gap_start += n;
+        gb->gap_end += n;
+    }
+}
+
+/*
+ * Mirror buffer positions into the InputState fields read elsewhere
+ */
+static void sync_input_state(InputState *input) {
+    input->cursor_pos = input->buffer.gap_start;
+    input->input_len = gap_length(&input->buffer);
+    input->buffer.text_valid = 0;
+}
+
+/*
+ * Get the input as one NUL-terminated string. The copy is cached until
+ * the next edit and stays owned by the input.
+ * @param input: InputState to read
+ * @return: Input text
+ */
+const char* get_input_text(InputState *input) {
+    GapBuffer *gb = &input->buffer;
+    if (gb->text_valid) return gb->text;
+
+    int length = gap_length(gb);
+    if (length + 1 > gb->text_capacity) {
+        int capacity = gb->text_capacity ? gb->text_capacity : GAP_BUFFER_MIN;
+        while (capacity < length + 1) capacity *= 2;
+        char *text = realloc(gb->text, capacity);
+        if (!text) return "";
+        gb->text = text;
+        gb->text_capacity = capacity;
+    }
+
+    if (gb->data) {
+        memcpy(gb->text, gb->data, gb->gap_start);
+        memcpy(gb->text + gb->gap_start, gb->data + gb->gap_end, gb->capacity - gb->gap_end);
+    }
+    gb->text[length] = '\0';
+    gb->text_valid = 1;
+    return gb->text;
+}
+
+/*
+ * Get one character of the input
+ * @param input: InputState to read
+ * @param pos: Position from 0 to input_len - 1
+ * @return: Character at pos
+ */
+char input_char_at(InputState *input, int pos) {
+    GapBuffer *gb = &input->buffer;
+    return pos < gb->gap_start ? gb->data[pos] : gb->data[pos + gb->gap_end - gb->gap_start];
+}
+
+/*
+ * Insert text at the cursor
+ * @param input: InputState to edit
+ * @param text: Text to insert
+ * @param len: Length of text
+ */
+void insert_input_text(InputState *input, const char *text, int len) {
+    if (len <= 0 || !gap_reserve(&input->buffer, len)) return;
+
+    memcpy(input->buffer.data + input->buffer.gap_start, text, len);
+    input->buffer.gap_start += len;
+    sync_input_state(input);
+}
+
+/*
+ * Delete the text between two positions
+ * @param input: InputState to edit
+ * @param from: First position to delete
+ * @param to: Position after the last one to delete
+ */
+void delete_input_text(InputState *input, int from, int to) {
+    if (from < 0) from = 0;
+    if (to > input->input_len) to = input->input_len;
+    if (from >= to) return;
+
+    gap_move(&input->buffer, from);
+    input->buffer.gap_end += to - from;
+    sync_input_state(input);
+}
+
+/*
+ * Move the cursor
+ * @param input: InputState to edit
+ * @param pos: New cursor position, clamped to the input
+ */
+void move_input_cursor(InputState *input, int pos) {
+    if (pos < 0) pos = 0;
+    if (pos > input->input_len) pos = input->input_len;
+
+    gap_move(&input->buffer, pos);
+    input->cursor_pos = pos;
+}
+
+/*
+ * Replace the whole input and put the cursor at its end
+ * @param input: InputState to edit
+ * @param text: New input text
+ */
+void set_input_text(InputState *input, const char *text) {
+    input->buffer.gap_start = 0;
+    input->buffer.gap_end = input->buffer.capacity;
+    sync_input_state(input);
+    insert_input_text(input, text, strlen(text));
+}
+
+/*
+ * Empty the input
+ * @param input: InputState to clear
+ */
+void clear_input(InputState *input) {
+    set_input_text(input, "");
+    input->display_start = 0;
+}
+
+/*
+ * Find the start of the UTF-8 character before pos
+ * @param input: InputState to scan
+ * @param pos: Position after the character
+ * @return: Position of its first byte
+ */
+int input_prev_char(InputState *input, int pos) {
+    if (pos <= 0) return 0;
+    pos--;
+    for (int n = 0; n < 3 && pos > 0 && (input_char_at(input, pos) & 0xC0) == 0x80; n++) {
+        pos--;
+    }
+    return pos;
+}
+
+/*
+ * Find the end of the UTF-8 character at pos
+ * @param input: InputState to scan
+ * @param pos: Position of the character
+ * @return: Position after its last byte
+ */
+int input_next_char(InputState *input, int pos) {
+    if (pos >= input->input_len) return input->input_len;
+    pos++;
+    for (int n = 0; n < 3 && pos < input->input_len && (input_char_at(input, pos) & 0xC0) == 0x80; n++) {
+        pos++;
+    }
+    return pos;
+}
+
+/*
+ * Check whether a character belongs to a word for word motions.
+ * Bytes of multibyte characters count as word characters.
+ */
+static int is_word_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || ((unsigned char)c & 0x80);
+}
+
+/*
+ * Find the start of the word before pos
+ * @param input: InputState to scan
+ * @param pos: Position to start from
+ * @return: Position of the word start
+ */
+int find_word_start(InputState *input, int pos) {
+    while (pos > 0 && !is_word_char(input_char_at(input, pos - 1))) pos--;
+    while (pos > 0 && is_word_char(input_char_at(input, pos - 1))) pos--;
+    return pos;
+}
+
+/*
+ * Find the end of the word after pos
+ * @param input: InputState to scan
+ * @param pos: Position to start from
+ * @return: Position after the word end
+ */
+int find_word_end(InputState *input, int pos) {
+    while (pos < input->input_len && !is_word_char(input_char_at(input, pos))) pos++;
+    while (pos < input->input_len && is_word_char(input_char_at(input, pos))) pos++;
+    return pos;
+}
+
+/*
+ * Find the start of the line containing pos
+ * @param input: InputState to scan
+ * @param pos: Position inside the line
+ * @return: Position of the first character of the line
+ */
+int find_line_start(InputState *input, int pos) {
+    while (pos > 0 && input_char_at(input, pos - 1) != '\n') pos--;
+    return pos;
+}
+
+/*
+ * Find the end of the line containing pos
+ * @param input: InputState to scan
+ * @param pos: Position inside the line
+ * @return: Position of the newline ending the line, or input_len
+ */
+int find_line_end(InputState *input, int pos) {
+    while (pos < input->input_len && input_char_at(input, pos) != '\n') pos++;
+    return pos;
+}
+
+/*
+ * Delete text and keep it for yank
+ * @param input: InputState to edit
+ * @param from: First position to kill
+ * @param to: Position after the last one to kill
+ */
+void kill_input_text(InputState *input, int from, int to) {
+    if (from < 0) from = 0;
+    if (to > input->input_len) to = input->input_len;
+    if (from >= to) return;
+
+    char *text = malloc(to - from);
+    if (!text) return;
+    for (int i = from; i < to; i++) {
+        text[i - from] = input_char_at(input, i);
+    }
+
+    free(kill_buffer);
+    kill_buffer = text;
+    kill_length = to - from;
+    delete_input_text(input, from, to);
+}
+
+/*
+ * Insert the last killed text at the cursor
+ * @param input: InputState to edit
+ */
+void yank_input_text(InputState *input) {
+    if (kill_buffer) insert_input_text(input, kill_buffer, kill_length);
+}
+
+/*
+ * Release the kill buffer
+ */
+void free_kill_buffer(void) {
+    free(kill_buffer);
+    kill_buffer = NULL;
+    kill_length = 0;
+}
+
+/*
+ * Initialize input state structure
+ * @param input: InputState to initialize
+ */
+void init_input_state(InputState *input) {
+    init_gap_buffer(&input->buffer);
+    input->cursor_pos = 0;
+    input->input_len = 0;
+    input->display_start = 0;
+    input->cmd_history_head = 0;
+    input->cmd_history_count = 0;
+    input->cmd_history_pos = 0;
+    input->is_locked = 0;
+    input->search_active = 0;
+    input->search_len = 0;
+    input->search_saved = NULL;
+    input->suggest_node = NULL;
+    input->suggest_edge_pos = 0;
+    input->suggest_generation = 0;
+    input->suggestion = NULL;
+    input->cmd_history = NULL;
+}
+
+/*
+ * Free input state resources
+ * @param input: InputState to free
+ */
+void free_input_state(InputState *input) {
+    for (int i = 0; i < input->cmd_history_count; i++) {
+        free(input->cmd_history[(input->cmd_history_head + i) % MAX_CMD_HISTORY]);
+    }
+    input->cmd_history_count = 0;
+    free(input->cmd_history);
+    input->cmd_history = NULL;
+    free(input->search_saved);
+    input->search_saved = NULL;
+    free_gap_buffer(&input->buffer);
+}
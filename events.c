@@ -0,0 +1,260 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static const char *stream_names[] = {"stdout", "stderr", "parrot"};
+
+/* IDs are shared by all terminals so parallel commands can be told apart */
+static unsigned int last_command_id = 0;
+
+/*
+ * Start building JSON text for a stream
+ * @param w: Writer to initialize
+ * @param out: Stream the text goes to
+ */
+void json_begin(JsonWriter *w, FILE *out) {
+    w->out = out;
+    w->len = 0;
+}
+
+/*
+ * Write out the buffered JSON text
+ * @param w: Writer to flush
+ */
+void json_flush(JsonWriter *w) {
+    fwrite(w->data, 1, w->len, w->out);
+    w->len = 0;
+}
+
+/*
+ * Append bytes as they are
+ * @param w: Writer
+ * @param s: Bytes to append
+ * @param n: Number of bytes
+ */
+void json_raw(JsonWriter *w, const char *s, size_t n) {
+    if (w->len + n > sizeof(w->data)) {
+        json_flush(w);
+        if (n > sizeof(w->data)) {
+            fwrite(s, 1, n, w->out);
+            return;
+        }
+    }
+    memcpy(w->data + w->len, s, n);
+    w->len += n;
+}
+
+/*
+ * Append a NUL-terminated literal
+ * @param w: Writer
+ * @param s: Text to append
+ */
+void json_text(JsonWriter *w, const char *s) {
+    json_raw(w, s, strlen(s));
+}
+
+/*
+ * Append an unsigned integer
+ * @param w: Writer
+ * @param value: Number to append
+ */
+void json_uint(JsonWriter *w, unsigned long long value) {
+    char digits[24];
+    int pos = sizeof(digits);
+
+    do {
+        digits[--pos] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    json_raw(w, digits + pos, sizeof(digits) - pos);
+}
+
+/*
+ * Append a signed integer
+ * @param w: Writer
+ * @param value: Number to append
+ */
+void json_int(JsonWriter *w, long long value) {
+    if (value < 0) {
+        json_raw(w, "-", 1);
+        json_uint(w, -(unsigned long long)value);
+    } else {
+        json_uint(w, value);
+    }
+}
+
+/*
+ * Append seconds with microsecond precision
+ * @param w: Writer
+ * @param seconds: Whole seconds
+ * @param micros: Microseconds, 0 to 999999
+ */
+void json_seconds(JsonWriter *w, long long seconds, long micros) {
+    char frac[7];
+
+    frac[0] = '.';
+    for (int i = 6; i >= 1; i--) {
+        frac[i] = '0' + micros % 10;
+        micros /= 10;
+    }
+    json_int(w, seconds);
+    json_raw(w, frac, sizeof(frac));
+}
+
+/*
+ * Append a quoted, escaped string. Runs of plain bytes are copied at
+ * once; bytes that are not valid UTF-8 become U+FFFD.
+ * @param w: Writer
+ * @param s: NUL-terminated text
+ */
+void json_string(JsonWriter *w, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    int len = strlen(s);
+    int start = 0;
+
+    json_raw(w, "\"", 1);
+    for (int i = 0; i < len; ) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80) {
+            i++;
+            continue;
+        }
+        if (c >= 0x80) {
+            uint32_t cp;
+            int n = utf8_decode(s + i, len - i, &cp);
+            if (n > 1) {
+                i += n;
+                continue;
+            }
+        }
+
+        json_raw(w, s + start, i - start);
+        if (c == '"') json_raw(w, "\\\"", 2);
+        else if (c == '\\') json_raw(w, "\\\\", 2);
+        else if (c == '\t') json_raw(w, "\\t", 2);
+        else if (c == '\r') json_raw(w, "\\r", 2);
+        else if (c == '\n') json_raw(w, "\\n", 2);
+        else if (c >= 0x80) json_raw(w, "\\ufffd", 6);
+        else {
+            char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            json_raw(w, escape, sizeof(escape));
+        }
+        start = ++i;
+    }
+    json_raw(w, s + start, len - start);
+    json_raw(w, "\"", 1);
+}
+
+/*
+ * Start an event object with its name, wall clock time and command ID
+ * @param w: Writer to initialize
+ * @param out: Stream the event goes to
+ * @param name: Event name
+ * @param command: Command ID
+ */
+static void begin_event(JsonWriter *w, FILE *out, const char *name, unsigned int command) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    json_begin(w, out);
+    json_text(w, "{\"event\":\"");
+    json_text(w, name);
+    json_text(w, "\",\"time\":");
+    json_seconds(w, now.tv_sec, now.tv_nsec / 1000);
+    json_text(w, ",\"command\":");
+    json_uint(w, command);
+}
+
+/*
+ * Close an event object and write it out
+ * @param w: Writer holding the event
+ */
+static void end_event(JsonWriter *w) {
+    json_raw(w, "}\n", 2);
+    json_flush(w);
+}
+
+/*
+ * Emit the event for a command leaving the queue, and give the command
+ * the ID its output and end events refer to
+ * @param term: Terminal about to run the command
+ * @param cmd: Command string
+ */
+void write_command_start_event(Terminal *term, const char *cmd) {
+    JsonWriter w;
+
+    term->history.echo_command = ++last_command_id;
+    clock_gettime(CLOCK_MONOTONIC, &term->command_started);
+
+    begin_event(&w, term->history.echo, "start", term->history.echo_command);
+    json_text(&w, ",\"terminal\":");
+    json_int(&w, term->id);
+    json_text(&w, ",\"cwd\":");
+    json_string(&w, term->current_directory);
+    json_text(&w, ",\"cmd\":");
+    json_string(&w, cmd);
+    end_event(&w);
+}
+
+/*
+ * Emit one line of output of the current command
+ * @param history: Echoing history buffer of the command's terminal
+ * @param stream: OUTPUT_STDOUT, OUTPUT_STDERR or OUTPUT_PARROT for messages
+ * @param text: Line without its newline
+ */
+void write_output_event(HistoryBuffer *history, int stream, const char *text) {
+    JsonWriter w;
+
+    begin_event(&w, history->echo, "output", history->echo_command);
+    json_text(&w, ",\"stream\":\"");
+    json_text(&w, stream_names[stream]);
+    json_text(&w, "\",\"line\":");
+    json_string(&w, text);
+    end_event(&w);
+}
+
+/*
+ * Emit the event for a finished command with its exit status, duration
+ * and resource usage
+ * @param term: Terminal whose command finished
+ * @param status: Status from wait4, or -1 for a builtin
+ * @param usage: Resources used by the child, NULL for a builtin
+ */
+void write_command_end_event(Terminal *term, int status, const struct rusage *usage) {
+    JsonWriter w;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long long elapsed = (now.tv_sec - term->command_started.tv_sec) * 1000000LL +
+                        (now.tv_nsec - term->command_started.tv_nsec) / 1000;
+
+    begin_event(&w, term->history.echo, "end", term->history.echo_command);
+    json_text(&w, ",\"exit\":");
+    json_int(&w, term->exit_status);
+    if (status >= 0 && WIFSIGNALED(status)) {
+        json_text(&w, ",\"signal\":");
+        json_int(&w, WTERMSIG(status));
+    }
+    json_text(&w, ",\"seconds\":");
+    json_seconds(&w, elapsed / 1000000, elapsed % 1000000);
+
+    if (usage) {
+        json_text(&w, ",\"rusage\":{\"user\":");
+        json_seconds(&w, usage->ru_utime.tv_sec, usage->ru_utime.tv_usec);
+        json_text(&w, ",\"system\":");
+        json_seconds(&w, usage->ru_stime.tv_sec, usage->ru_stime.tv_usec);
+        json_text(&w, ",\"maxrss_kb\":");
+        json_int(&w, usage->ru_maxrss);
+        json_text(&w, ",\"minflt\":");
+        json_int(&w, usage->ru_minflt);
+        json_text(&w, ",\"majflt\":");
+        json_int(&w, usage->ru_majflt);
+        json_text(&w, ",\"nvcsw\":");
+        json_int(&w, usage->ru_nvcsw);
+        json_text(&w, ",\"nivcsw\":");
+        json_int(&w, usage->ru_nivcsw);
+        json_text(&w, "}");
+    }
+    end_event(&w);
+}
@@ -0,0 +1,812 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+
+/* Seconds after which an unvisited directory's weight halves */
+#define FRECENCY_HALF_LIFE (3.0 * 24 * 60 * 60)
+
+/* Directories kept in the store; the weakest are dropped when it is compacted */
+#define FRECENCY_MAX_DIRS 1000
+
+/* Visit records appended to the store file before it is compacted */
+#define FRECENCY_COMPACT_VISITS 1000
+
+/* Bytes of the store file read per call while loading new records */
+#define FRECENCY_READ_SIZE 65536
+
+/*
+ * Visited directory. The score is log2(weight) + visit_time / half-life,
+ * which orders entries exactly like their decayed weight at any moment,
+ * so it never has to be recomputed as time passes. The lowercased copy
+ * of the path has each '/' turned into a terminator and holds the keys.
+ */
+typedef struct {
+    char *path;
+    char *lower;
+    double score;
+} FrecencyEntry;
+
+/*
+ * Lowercased path component pointing back at its directory
+ */
+typedef struct {
+    const char *key;
+    int entry;
+} FrecencyKey;
+
+/*
+ * Directory store with a lookup index. The index holds every path
+ * component sorted by name, plus a segment tree answering "best entry
+ * in a range of keys", so a prefix match costs two binary searches and
+ * a visit to a known directory updates the tree in place.
+ *
+ * The file starts with "score<TAB>path" lines written when it was last
+ * compacted, followed by "@time<TAB>path" lines appended for each visit.
+ * Records other processes appended are picked up from file_end on.
+ */
+typedef struct {
+    FrecencyEntry *entries;
+    int count;
+    int capacity;
+    int *slots;
+    int slot_capacity;
+    int index_valid;
+    FrecencyKey *keys;
+    int key_count;
+    int key_capacity;
+    int *tree;
+    int fd;
+    off_t file_end;
+    int visit_records;
+} FrecencyStore;
+
+static FrecencyStore frecency_store = { .fd = -1 };
+
+/*
+ * Resolve the directory store path from PARROT_DIRFILE or HOME
+ * @param path: Buffer for the path
+ * @param size: Size of path buffer
+ * @return: 1 if a path is available, 0 otherwise
+ */
+static int frecency_store_path(char *path, size_t size) {
+    const char *file = getenv("PARROT_DIRFILE");
+    if (file) {
+        if (file[0] == '\0') return 0;
+        snprintf(path, size, "%s", file);
+        return 1;
+    }
+
+    const char *home = getenv("HOME");
+    if (!home) return 0;
+    snprintf(path, size, "%s/.parrot_dirs", home);
+    return 1;
+}
+
+/*
+ * Score units of a moment
+ * @param when: Time
+ * @return: Score at which the weight is 1 at that moment
+ */
+static double score_at(time_t when) {
+    return (double)when / FRECENCY_HALF_LIFE;
+}
+
+/*
+ * Pick the better of two entries, either of which may be -1
+ */
+static int better_entry(int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    return frecency_store.entries[a].score >= frecency_store.entries[b].score ? a : b;
+}
+
+/*
+ * Hash a path for the slot table
+ */
+static unsigned int hash_path(const char *path) {
+    unsigned int hash = 2166136261u;
+    for (; *path; path++) {
+        hash = (hash ^ (unsigned char)*path) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Put an entry into the slot table, which has room for it
+ * @param index: Entry to place
+ */
+static void place_entry_slot(int index) {
+    unsigned int mask = frecency_store.slot_capacity - 1;
+    unsigned int slot = hash_path(frecency_store.entries[index].path) & mask;
+    while (frecency_store.slots[slot] >= 0) slot = (slot + 1) & mask;
+    frecency_store.slots[slot] = index;
+}
+
+/*
+ * Rebuild the slot table for the current entries, growing it so it is
+ * never more than half full
+ * @return: 1 on success, 0 on allocation failure
+ */
+static int rebuild_entry_slots(void) {
+    int capacity = frecency_store.slot_capacity ? frecency_store.slot_capacity : 128;
+    while (capacity < (frecency_store.count + 1) * 2) capacity *= 2;
+
+    if (capacity != frecency_store.slot_capacity) {
+        int *slots = realloc(frecency_store.slots, capacity * sizeof(int));
+        if (!slots) return 0;
+        frecency_store.slots = slots;
+        frecency_store.slot_capacity = capacity;
+    }
+    memset(frecency_store.slots, -1, capacity * sizeof(int));
+    for (int i = 0; i < frecency_store.count; i++) {
+        place_entry_slot(i);
+    }
+    return 1;
+}
+
+/*
+ * Find the entry of a path
+ * @param path: Directory path
+ * @return: Entry index, or -1 if the path is not in the store
+ */
+static int find_entry(const char *path) {
+    if (frecency_store.slot_capacity == 0) return -1;
+
+    unsigned int mask = frecency_store.slot_capacity - 1;
+    for (unsigned int slot = hash_path(path) & mask; frecency_store.slots[slot] >= 0;
+         slot = (slot + 1) & mask) {
+        int index = frecency_store.slots[slot];
+        if (strcmp(frecency_store.entries[index].path, path) == 0) return index;
+    }
+    return -1;
+}
+
+/*
+ * Compare component keys, then their entries, so a key of a given entry
+ * has exactly one place
+ */
+static int compare_keys(const void *a, const void *b) {
+    const FrecencyKey *x = a;
+    const FrecencyKey *y = b;
+    int order = strcmp(x->key, y->key);
+    if (order) return order;
+    return (x->entry > y->entry) - (x->entry < y->entry);
+}
+
+/*
+ * Position of a key in the sorted keys, or where it would be inserted
+ */
+static int key_position(const FrecencyKey *key) {
+    int lo = 0, hi = frecency_store.key_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compare_keys(&frecency_store.keys[mid], key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Visit the component keys of an entry
+ * @param index: Entry
+ * @param visit: Called with each key
+ */
+static void for_each_entry_key(int index, void (*visit)(const FrecencyKey *key)) {
+    const FrecencyEntry *entry = &frecency_store.entries[index];
+    for (const char *p = entry->path; *p; p++) {
+        if (*p == '/' && p[1] && p[1] != '/') {
+            FrecencyKey key = { entry->lower + (p - entry->path) + 1, index };
+            visit(&key);
+        }
+    }
+}
+
+/*
+ * Recompute the segment tree above one key
+ * @param position: Position of the key
+ */
+static void update_tree(int position) {
+    int n = frecency_store.key_count;
+    int node = position + n;
+    frecency_store.tree[node] = frecency_store.keys[position].entry;
+    for (node /= 2; node >= 1; node /= 2) {
+        frecency_store.tree[node] = better_entry(frecency_store.tree[2 * node],
+                                                 frecency_store.tree[2 * node + 1]);
+    }
+}
+
+/*
+ * Rebuild the segment tree over all keys. Leaves are at key_count + i,
+ * and node i holds the best entry of nodes 2i and 2i + 1.
+ * @return: 1 on success, 0 on allocation failure
+ */
+static int build_tree(void) {
+    int n = frecency_store.key_count;
+    int *tree = realloc(frecency_store.tree, (2 * n + 1) * sizeof(int));
+    if (!tree) return 0;
+    frecency_store.tree = tree;
+
+    tree[0] = -1;
+    for (int i = 0; i < n; i++) tree[n + i] = frecency_store.keys[i].entry;
+    for (int i = n - 1; i >= 1; i--) {
+        tree[i] = better_entry(tree[2 * i], tree[2 * i + 1]);
+    }
+    return 1;
+}
+
+/*
+ * Make room for more keys
+ * @param count: Keys needed in total
+ * @return: 1 on success, 0 on allocation failure
+ */
+static int reserve_keys(int count) {
+    if (count <= frecency_store.key_capacity) return 1;
+
+    int capacity = frecency_store.key_capacity ? frecency_store.key_capacity : 256;
+    while (capacity < count) capacity *= 2;
+    FrecencyKey *keys = realloc(frecency_store.keys, capacity * sizeof(FrecencyKey));
+    if (!keys) return 0;
+    frecency_store.keys = keys;
+    frecency_store.key_capacity = capacity;
+    return 1;
+}
+
+/*
+ * Append a key, for a full rebuild that sorts afterwards
+ */
+static void append_key(const FrecencyKey *key) {
+    frecency_store.keys[frecency_store.key_count++] = *key;
+}
+
+/*
+ * Insert a key at its sorted place
+ */
+static void insert_key(const FrecencyKey *key) {
+    int position = key_position(key);
+    memmove(&frecency_store.keys[position + 1], &frecency_store.keys[position],
+            (frecency_store.key_count - position) * sizeof(FrecencyKey));
+    frecency_store.keys[position] = *key;
+    frecency_store.key_count++;
+}
+
+/*
+ * Refresh the tree above a key whose entry changed score
+ */
+static void update_key(const FrecencyKey *key) {
+    int position = key_position(key);
+    if (position < frecency_store.key_count) update_tree(position);
+}
+
+/*
+ * Count the component keys of an entry
+ */
+static int entry_key_count(int index) {
+    int count = 0;
+    for (const char *p = frecency_store.entries[index].path; *p; p++) {
+        if (*p == '/' && p[1] && p[1] != '/') count++;
+    }
+    return count;
+}
+
+/*
+ * Rebuild the sorted component keys and the tree over them
+ */
+static void build_frecency_index(void) {
+    if (frecency_store.index_valid) return;
+
+    int key_count = 0;
+    for (int i = 0; i < frecency_store.count; i++) key_count += entry_key_count(i);
+
+    frecency_store.key_count = 0;
+    if (!reserve_keys(key_count)) return;
+    for (int i = 0; i < frecency_store.count; i++) for_each_entry_key(i, append_key);
+    qsort(frecency_store.keys, frecency_store.key_count, sizeof(FrecencyKey), compare_keys);
+
+    frecency_store.index_valid = build_tree();
+}
+
+/*
+ * Add a new entry's keys to a valid index
+ * @param index: Entry just added
+ */
+static void index_new_entry(int index) {
+    if (!frecency_store.index_valid) return;
+
+    if (!reserve_keys(frecency_store.key_count + entry_key_count(index))) {
+        frecency_store.index_valid = 0;
+        return;
+    }
+    for_each_entry_key(index, insert_key);
+    frecency_store.index_valid = build_tree();
+}
+
+/*
+ * Append an entry to the in-memory store
+ * @return: Index of the new entry, or -1 on allocation failure
+ */
+static int add_frecency_entry(const char *path, double score) {
+    if (frecency_store.count >= frecency_store.capacity) {
+        int capacity = frecency_store.capacity ? frecency_store.capacity * 2 : 64;
+        FrecencyEntry *entries = realloc(frecency_store.entries,
+                                         capacity * sizeof(FrecencyEntry));
+        if (!entries) return -1;
+        frecency_store.entries = entries;
+        frecency_store.capacity = capacity;
+    }
+    if ((frecency_store.count + 1) * 2 > frecency_store.slot_capacity &&
+        !rebuild_entry_slots()) {
+        return -1;
+    }
+
+    size_t len = strlen(path);
+    char *copy = malloc(len + 1);
+    char *lower = malloc(len + 1);
+    if (!copy || !lower) {
+        free(copy);
+        free(lower);
+        return -1;
+    }
+    memcpy(copy, path, len + 1);
+    for (size_t i = 0; i <= len; i++) {
+        lower[i] = path[i] == '/' ? '\0' : tolower((unsigned char)path[i]);
+    }
+
+    int index = frecency_store.count++;
+    frecency_store.entries[index].path = copy;
+    frecency_store.entries[index].lower = lower;
+    frecency_store.entries[index].score = score;
+    place_entry_slot(index);
+    index_new_entry(index);
+    return index;
+}
+
+/*
+ * Give an entry a new score, keeping the index valid
+ * @param index: Entry
+ * @param score: New score
+ */
+static void set_entry_score(int index, double score) {
+    frecency_store.entries[index].score = score;
+    if (frecency_store.index_valid) for_each_entry_key(index, update_key);
+}
+
+/*
+ * Drop every entry, leaving the store empty
+ */
+static void clear_frecency_entries(void) {
+    for (int i = 0; i < frecency_store.count; i++) {
+        free(frecency_store.entries[i].path);
+        free(frecency_store.entries[i].lower);
+    }
+    frecency_store.count = 0;
+    frecency_store.key_count = 0;
+    frecency_store.index_valid = 0;
+    if (frecency_store.slot_capacity) rebuild_entry_slots();
+}
+
+/*
+ * Remove an entry, keeping the others in place except the last one.
+ * Entry indices change, so the index is rebuilt on its next use.
+ * @param index: Entry to remove
+ */
+static void remove_frecency_entry(int index) {
+    free(frecency_store.entries[index].path);
+    free(frecency_store.entries[index].lower);
+    frecency_store.entries[index] = frecency_store.entries[--frecency_store.count];
+    frecency_store.index_valid = 0;
+    rebuild_entry_slots();
+}
+
+/*
+ * Add a visit to a directory at a given time
+ * @param path: Absolute directory path
+ * @param when: Time of the visit
+ */
+static void apply_directory_visit(const char *path, time_t when) {
+    double now = score_at(when);
+    int index = find_entry(path);
+
+    if (index < 0) {
+        add_frecency_entry(path, now);
+    } else {
+        /* Decay the old weight to the visit, then add this visit */
+        double weight = exp2(frecency_store.entries[index].score - now);
+        set_entry_score(index, now + log2(weight + 1.0));
+    }
+}
+
+/*
+ * Apply one line of the store file
+ * @param line: Line without its newline
+ */
+static void apply_frecency_line(char *line) {
+    char *tab = strchr(line, '\t');
+    if (!tab || tab[1] != '/') return;
+    *tab = '\0';
+
+    if (line[0] == '@') {
+        apply_directory_visit(tab + 1, (time_t)strtoll(line + 1, NULL, 10));
+        frecency_store.visit_records++;
+        return;
+    }
+
+    double score = strtod(line, NULL);
+    int index = find_entry(tab + 1);
+    if (index < 0) add_frecency_entry(tab + 1, score);
+    else set_entry_score(index, score);
+}
+
+/*
+ * Apply the complete lines added to the store file since it was last read
+ */
+static void read_frecency_records(void) {
+    static char buffer[FRECENCY_READ_SIZE + 1];
+
+    for (;;) {
+        ssize_t got = pread(frecency_store.fd, buffer, FRECENCY_READ_SIZE, frecency_store.file_end);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return;
+        buffer[got] = '\0';
+
+        char *line = buffer;
+        char *newline;
+        while ((newline = memchr(line, '\n', buffer + got - line)) != NULL) {
+            *newline = '\0';
+            apply_frecency_line(line);
+            line = newline + 1;
+        }
+
+        /* A line longer than the buffer is skipped, a shorter one re-read */
+        if (line == buffer && got == FRECENCY_READ_SIZE) {
+            frecency_store.file_end += got;
+            continue;
+        }
+        frecency_store.file_end += line - buffer;
+        if (got < FRECENCY_READ_SIZE) return;
+    }
+}
+
+/*
+ * Check whether another process replaced the store file by compacting it
+ * @return: 1 if the open file is no longer the one at the store path
+ */
+static int frecency_file_replaced(void) {
+    char path[PATH_MAX];
+    struct stat open_file;
+    struct stat current;
+    if (!frecency_store_path(path, sizeof(path))) return 0;
+    if (fstat(frecency_store.fd, &open_file) != 0 || stat(path, &current) != 0) return 1;
+    return open_file.st_ino != current.st_ino || open_file.st_dev != current.st_dev;
+}
+
+/*
+ * Close the store file and forget what was read from it
+ */
+static void close_frecency_file(void) {
+    if (frecency_store.fd >= 0) close(frecency_store.fd);
+    frecency_store.fd = -1;
+    frecency_store.file_end = 0;
+    frecency_store.visit_records = 0;
+    clear_frecency_entries();
+}
+
+/*
+ * Bring the store up to date with its file: open it on first use, load
+ * what other processes appended, and reload it after a compaction
+ * @param create: Nonzero to create a missing file
+ * @return: 1 if the file is open, 0 otherwise
+ */
+static int sync_frecency_store(int create) {
+    if (frecency_store.fd >= 0 && frecency_file_replaced()) close_frecency_file();
+
+    if (frecency_store.fd < 0) {
+        char path[PATH_MAX];
+        if (!frecency_store_path(path, sizeof(path))) return 0;
+        int flags = O_RDWR | O_APPEND | O_CLOEXEC | (create ? O_CREAT : 0);
+        frecency_store.fd = open(path, flags, 0600);
+        if (frecency_store.fd < 0) return 0;
+    }
+    read_frecency_records();
+    return 1;
+}
+
+/*
+ * Lock the store file against other parrot processes and read what they
+ * added, so a change is applied on top of it. A file replaced by a
+ * compaction while waiting is opened and locked again.
+ * @return: 1 if locked, 0 if there is no store file
+ */
+static int lock_frecency_store(void) {
+    for (;;) {
+        if (!sync_frecency_store(1)) return 0;
+        if (flock(frecency_store.fd, LOCK_EX) != 0) return 0;
+        if (!frecency_file_replaced()) break;
+        close_frecency_file();
+    }
+    read_frecency_records();
+    return 1;
+}
+
+/*
+ * Release the lock taken by lock_frecency_store()
+ */
+static void unlock_frecency_store(void) {
+    if (frecency_store.fd >= 0) flock(frecency_store.fd, LOCK_UN);
+}
+
+/*
+ * Order entries by descending score for qsort
+ */
+static int compare_scores(const void *a, const void *b) {
+    double x = ((const FrecencyEntry*)a)->score;
+    double y = ((const FrecencyEntry*)b)->score;
+    return (x < y) - (x > y);
+}
+
+/*
+ * Drop all but the strongest FRECENCY_MAX_DIRS entries and replace the
+ * file with one line per entry, through a temporary file and rename.
+ * Callers hold the lock from lock_frecency_store().
+ */
+static void compact_frecency_store(void) {
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 16];
+    if (!frecency_store_path(path, sizeof(path))) return;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+
+    if (frecency_store.count > FRECENCY_MAX_DIRS) {
+        qsort(frecency_store.entries, frecency_store.count, sizeof(FrecencyEntry), compare_scores);
+        while (frecency_store.count > FRECENCY_MAX_DIRS) {
+            frecency_store.count--;
+            free(frecency_store.entries[frecency_store.count].path);
+            free(frecency_store.entries[frecency_store.count].lower);
+        }
+        frecency_store.index_valid = 0;
+        rebuild_entry_slots();
+    }
+
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) return;
+    for (int i = 0; i < frecency_store.count; i++) {
+        fprintf(file, "%.6f\t%s\n", frecency_store.entries[i].score,
+                frecency_store.entries[i].path);
+    }
+    long size = ftell(file);
+    if (fclose(file) != 0 || size < 0 || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return;
+    }
+
+    /* Continue on the new file; waiters on the old one will reopen it */
+    int fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (fd < 0) return;
+    close(frecency_store.fd);
+    frecency_store.fd = fd;
+    frecency_store.file_end = size;
+    frecency_store.visit_records = 0;
+}
+
+/*
+ * Record a visit to a directory. The visit is appended to the store file,
+ * which is compacted every FRECENCY_COMPACT_VISITS visits.
+ * @param path: Absolute directory path
+ */
+void record_directory_visit(const char *path) {
+    /* Scripted or replayed cd's would skew the ranking of interactive visits */
+    if (path[0] != '/' || headless_mode || replaying_session()) return;
+
+    time_t now = time(NULL);
+    if (!lock_frecency_store()) {
+        apply_directory_visit(path, now);
+        return;
+    }
+    apply_directory_visit(path, now);
+
+    char line[PATH_MAX + 32];
+    int len = snprintf(line, sizeof(line), "@%lld\t%s\n", (long long)now, path);
+    if (len > 0 && len < (int)sizeof(line)) {
+        ssize_t written = write(frecency_store.fd, line, len);
+        if (written == len) {
+            frecency_store.file_end += len;
+            frecency_store.visit_records++;
+        } else if (written > 0 && ftruncate(frecency_store.fd, frecency_store.file_end) != 0) {
+            /* A partial line could not be taken back; reread from scratch */
+            close_frecency_file();
+            return;
+        }
+    }
+
+    if (frecency_store.visit_records >= FRECENCY_COMPACT_VISITS) compact_frecency_store();
+    unlock_frecency_store();
+}
+
+/*
+ * Find the best directory with a component starting with prefix
+ * @param prefix: Lowercased prefix
+ * @return: Entry index, or -1 if none
+ */
+static int find_by_component(const char *prefix) {
+    build_frecency_index();
+    if (!frecency_store.index_valid || frecency_store.key_count == 0) return -1;
+
+    size_t len = strlen(prefix);
+    int lo = 0, hi = frecency_store.key_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strncmp(frecency_store.keys[mid].key, prefix, len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    int first = lo;
+
+    hi = frecency_store.key_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strncmp(frecency_store.keys[mid].key, prefix, len) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    /* Best entry among keys first .. lo - 1, walking the tree bottom-up */
+    int best = -1;
+    int n = frecency_store.key_count;
+    for (int l = first + n, r = lo + n; l < r; l /= 2, r /= 2) {
+        if (l & 1) best = better_entry(best, frecency_store.tree[l++]);
+        if (r & 1) best = better_entry(best, frecency_store.tree[--r]);
+    }
+    return best;
+}
+
+/*
+ * Check whether all words occur in path, in order, ignoring case
+ */
+static int path_matches_words(const char *path, char **words, int word_count) {
+    const char *p = path;
+    for (int i = 0; i < word_count; i++) {
+        const char *hit = strcasestr(p, words[i]);
+        if (!hit) return 0;
+        p = hit + strlen(words[i]);
+    }
+    return 1;
+}
+
+/*
+ * Find the best directory matching a pattern. A single word is looked
+ * up in the component index; several words, or a word that only occurs
+ * inside a component, fall back to a scan of the store.
+ * @param words: Lowercased pattern words
+ * @param word_count: Number of words
+ * @return: Entry index, or -1 if none
+ */
+static int find_frecency_match(char **words, int word_count) {
+    if (word_count == 1) {
+        int entry = find_by_component(words[0]);
+        if (entry >= 0) return entry;
+    }
+
+    int best = -1;
+    for (int i = 0; i < frecency_store.count; i++) {
+        if (path_matches_words(frecency_store.entries[i].path, words, word_count) &&
+            (best < 0 || frecency_store.entries[i].score > frecency_store.entries[best].score)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/*
+ * Find the best match that is still a directory, removing the entries
+ * on the way that are not
+ * @param words: Lowercased words
+ * @param word_count: Number of words
+ * @param out: Buffer for the directory
+ * @param out_size: Size of output buffer
+ * @param removed: Set to 1 if an entry was removed
+ * @return: 1 if a directory was found, 0 otherwise
+ */
+static int find_existing_match(char **words, int word_count, char *out, size_t out_size, int *removed) {
+    while (frecency_store.count > 0) {
+        int entry = find_frecency_match(words, word_count);
+        if (entry < 0) break;
+
+        struct stat st;
+        if (stat(frecency_store.entries[entry].path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            snprintf(out, out_size, "%s", frecency_store.entries[entry].path);
+            return 1;
+        }
+        remove_frecency_entry(entry);
+        *removed = 1;
+    }
+    return 0;
+}
+
+/*
+ * Resolve a jump pattern to a directory, dropping entries that no
+ * longer exist on the way
+ * @param pattern: Space separated words
+ * @param out: Buffer for the directory
+ * @param out_size: Size of output buffer
+ * @return: 1 if a directory was found, 0 otherwise
+ */
+int find_frecent_directory(const char *pattern, char *out, size_t out_size) {
+    char buffer[MAX_CMD_INPUT];
+    char *words[MAX_CMD_INPUT / 2];
+    int word_count = 0;
+
+    snprintf(buffer, sizeof(buffer), "%s", pattern);
+    for (char *p = buffer; *p; p++) *p = tolower((unsigned char)*p);
+
+    char *save = NULL;
+    for (char *word = strtok_r(buffer, " ", &save); word; word = strtok_r(NULL, " ", &save)) {
+        words[word_count++] = word;
+    }
+    if (word_count == 0) return 0;
+
+    sync_frecency_store(0);
+    int removed = 0;
+    int found = find_existing_match(words, word_count, out, out_size, &removed);
+
+    /* Drop the missing directories from the file too, by compacting it */
+    if (removed && !replaying_session() && lock_frecency_store()) {
+        found = find_existing_match(words, word_count, out, out_size, &removed);
+        compact_frecency_store();
+        unlock_frecency_store();
+    }
+    return found;
+}
+
+/*
+ * List the highest ranked directories into a history buffer
+ * @param history: History buffer for output
+ * @param limit: Maximum number of directories
+ */
+void list_frecent_directories(HistoryBuffer *history, int limit) {
+    sync_frecency_store(0);
+
+    int shown[limit > 0 ? limit : 1];
+    int count = 0;
+    double now = score_at(time(NULL));
+
+    while (count < limit) {
+        int best = -1;
+        for (int i = 0; i < frecency_store.count; i++) {
+            int taken = 0;
+            for (int j = 0; j < count; j++) {
+                if (shown[j] == i) taken = 1;
+            }
+            if (!taken && (best < 0 ||
+                frecency_store.entries[i].score > frecency_store.entries[best].score)) {
+                best = i;
+            }
+        }
+        if (best < 0) break;
+        shown[count++] = best;
+
+        char line[MAX_LINE_LENGTH];
+        snprintf(line, sizeof(line), "%8.2f  %s",
+                 exp2(frecency_store.entries[best].score - now),
+                 frecency_store.entries[best].path);
+        add_history_line(history, line, HISTORY_TYPE_NORMAL);
+    }
+
+    if (count == 0) {
+        add_history_line(history, "j: no directories recorded yet", HISTORY_TYPE_NORMAL);
+    }
+}
+
+/*
+ * Release the directory store
+ */
+void free_frecency_store(void) {
+    close_frecency_file();
+    free(frecency_store.entries);
+    free(frecency_store.slots);
+    free(frecency_store.keys);
+    free(frecency_store.tree);
+    memset(&frecency_store, 0, sizeof(frecency_store));
+    frecency_store.fd = -1;
+}
@@ -0,0 +1,402 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+
+/* First allocation of a history buffer, in lines */
+#define HISTORY_INITIAL_CAPACITY 64
+
+/* Scrollbacks smaller than this stay in memory when their terminal idles */
+#define SPILL_MIN_BYTES (32 * 1024)
+
+/*
+ * Region of the spill file holding the lines of one hibernated buffer
+ */
+struct HistorySpill {
+    off_t offset;
+    size_t size;
+};
+
+int line_break_enabled = 1;
+
+/* Spill file shared by all hibernated buffers, opened on first use */
+static int spill_fd = -1;
+static off_t spill_end = 0;
+static int spilled_buffers = 0;
+
+/*
+ * Initialize history buffer with default capacity
+ * @param buf: HistoryBuffer to initialize
+ */
+void init_history_buffer(HistoryBuffer *buf) {
+    buf->capacity = 0;
+    buf->count = 0;
+    buf->scroll_offset = 0;
+    buf->lines = NULL;
+    buf->line_types = NULL;
+    buf->timestamps = NULL;
+    buf->spill = NULL;
+    buf->echo = NULL;
+    buf->echo_format = ECHO_TEXT;
+    buf->echo_timestamps = 0;
+    buf->echo_command = 0;
+}
+
+/*
+ * Write a line to the stream of an echoing history buffer
+ * @param buf: HistoryBuffer with echo set
+ * @param text: Text to write
+ */
+static void echo_history_line(HistoryBuffer *buf, const char *text) {
+    if (buf->echo_timestamps) {
+        char time_buf[32];
+        time_t now = time(NULL);
+        strftime(time_buf, sizeof(time_buf), "[%H:%M:%S] ", localtime(&now));
+        fputs(time_buf, buf->echo);
+    }
+    fputs(text, buf->echo);
+    putc('\n', buf->echo);
+}
+
+/*
+ * Add line to history buffer
+ * @param buf: HistoryBuffer to add to
+ * @param text: Text to add
+ * @param line_type: Type of line (normal, command, raw)
+ */
+void add_history_line(HistoryBuffer *buf, const char *text, int line_type) {
+    if (buf->echo && buf->echo_format == ECHO_EVENTS) {
+        write_output_event(buf, OUTPUT_PARROT, text);
+        return;
+    } else if (buf->echo) {
+        echo_history_line(buf, text);
+        return;
+    }
+    wake_history_buffer(buf);
+    
+    if (buf->count >= buf->capacity) {
+        buf->capacity = buf->capacity ? buf->capacity * 2 : HISTORY_INITIAL_CAPACITY;
+        buf->lines = realloc(buf->lines, buf->capacity * sizeof(char*));
+        buf->line_types = realloc(buf->line_types, buf->capacity * sizeof(int));
+        buf->timestamps = realloc(buf->timestamps, buf->capacity * sizeof(time_t));
+        
+        if (!buf->lines || !buf->line_types || !buf->timestamps) {
+            fprintf(stderr, "Critical error: Failed to reallocate history buffer\n");
+            exit(3);
+        }
+    }
+    
+    if (line_break_enabled) {
+        buf->lines[buf->count] = strdup(text);
+    } else {
+        char *cleaned = malloc(strlen(text) + 1);
+        char *dst = cleaned;
+        const char *src = text;
+        while (*src) {
+            *dst++ = (*src == '\n') ? ' ' : *src;
+            src++;
+        }
+        *dst = '\0';
+        buf->lines[buf->count] = cleaned;
+    }
+    
+    buf->line_types[buf->count] = line_type;
+    buf->timestamps[buf->count] = time(NULL);
+    buf->count++;
+}
+
+/*
+ * Open the spill file shared by all hibernated buffers of this process.
+ * It is unlinked at once, so it disappears with the process.
+ * @return: 1 if the file is open, 0 otherwise
+ */
+static int open_spill_file(void) {
+    if (spill_fd != -1) return 1;
+    
+    const char *dir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/parrot-spill-XXXXXX", dir && dir[0] ? dir : "/tmp");
+    spill_fd = mkostemp(path, O_CLOEXEC);
+    if (spill_fd == -1) return 0;
+    unlink(path);
+    return 1;
+}
+
+/*
+ * Give back the part of the spill file a buffer used. Its blocks are
+ * freed right away, and the file is emptied once nothing is spilled.
+ * @param spill: Region to release, freed on return
+ */
+static void release_spill(HistorySpill *spill) {
+    fallocate(spill_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, spill->offset, spill->size);
+    free(spill);
+    
+    if (--spilled_buffers == 0 && ftruncate(spill_fd, 0) == 0) {
+        spill_end = 0;
+    }
+}
+
+/*
+ * Free all resources associated with history buffer
+ * @param buf: HistoryBuffer to free
+ */
+void free_history_buffer(HistoryBuffer *buf) {
+    if (buf->spill) {
+        release_spill(buf->spill);
+        buf->spill = NULL;
+    } else {
+        for (int i = 0; i < buf->count; i++) {
+            if (!is_snapshot_memory(buf->lines[i])) free(buf->lines[i]);
+        }
+    }
+    free(buf->lines);
+    free(buf->line_types);
+    free(buf->timestamps);
+}
+
+/*
+ * Move all lines of a history buffer to the end of the shared spill file
+ * and free them, keeping only the line count. Buffers smaller than
+ * SPILL_MIN_BYTES stay in memory, where they cost less.
+ * @param buf: HistoryBuffer to spill
+ */
+void hibernate_history_buffer(HistoryBuffer *buf) {
+    if (buf->spill || buf->count == 0) return;
+    
+    size_t size = 0;
+    for (int i = 0; i < buf->count; i++) {
+        size += 2 * sizeof(int) + sizeof(time_t) + strlen(buf->lines[i]);
+    }
+    if (size < SPILL_MIN_BYTES || !open_spill_file()) return;
+    
+    char *data = malloc(size);
+    HistorySpill *spill = malloc(sizeof(HistorySpill));
+    if (!data || !spill) {
+        free(data);
+        free(spill);
+        return;
+    }
+    
+    char *dst = data;
+    for (int i = 0; i < buf->count; i++) {
+        int len = strlen(buf->lines[i]);
+        memcpy(dst, &buf->line_types[i], sizeof(int));
+        dst += sizeof(int);
+        memcpy(dst, &buf->timestamps[i], sizeof(time_t));
+        dst += sizeof(time_t);
+        memcpy(dst, &len, sizeof(int));
+        dst += sizeof(int);
+        memcpy(dst, buf->lines[i], len);
+        dst += len;
+    }
+    
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = pwrite(spill_fd, data + written, size - written, spill_end + written);
+        if (n <= 0) break;
+        written += n;
+    }
+    free(data);
+    if (written < size) {
+        free(spill);
+        return;
+    }
+    
+    spill->offset = spill_end;
+    spill->size = size;
+    spill_end += size;
+    spilled_buffers++;
+    
+    for (int i = 0; i < buf->count; i++) {
+        if (!is_snapshot_memory(buf->lines[i])) free(buf->lines[i]);
+    }
+    free(buf->lines);
+    free(buf->line_types);
+    free(buf->timestamps);
+    buf->lines = NULL;
+    buf->line_types = NULL;
+    buf->timestamps = NULL;
+    buf->capacity = 0;
+    buf->spill = spill;
+}
+
+/*
+ * Load the lines of a spilled history buffer back into memory.
+ * Lines that cannot be read back are dropped.
+ * @param buf: HistoryBuffer to restore
+ */
+void wake_history_buffer(HistoryBuffer *buf) {
+    if (!buf->spill) return;
+    
+    HistorySpill *spill = buf->spill;
+    int count = buf->count;
+    buf->spill = NULL;
+    buf->count = 0;
+    buf->capacity = count;
+    buf->lines = malloc(count * sizeof(char*));
+    buf->line_types = malloc(count * sizeof(int));
+    buf->timestamps = malloc(count * sizeof(time_t));
+    char *data = malloc(spill->size);
+    
+    if (!buf->lines || !buf->line_types || !buf->timestamps || !data) {
+        fprintf(stderr, "Critical error: Failed to restore history buffer\n");
+        exit(3);
+    }
+    
+    size_t size = 0;
+    while (size < spill->size) {
+        ssize_t n = pread(spill_fd, data + size, spill->size - size, spill->offset + size);
+        if (n <= 0) break;
+        size += n;
+    }
+    
+    const char *src = data;
+    const char *end = data + size;
+    while (buf->count < count && end - src >= (ptrdiff_t)(2 * sizeof(int) + sizeof(time_t))) {
+        int type, len;
+        time_t timestamp;
+        memcpy(&type, src, sizeof(int));
+        src += sizeof(int);
+        memcpy(&timestamp, src, sizeof(time_t));
+        src += sizeof(time_t);
+        memcpy(&len, src, sizeof(int));
+        src += sizeof(int);
+        if (len < 0 || end - src < len) break;
+        
+        char *line = malloc(len + 1);
+        if (!line) break;
+        memcpy(line, src, len);
+        line[len] = '\0';
+        src += len;
+        
+        buf->lines[buf->count] = line;
+        buf->line_types[buf->count] = type;
+        buf->timestamps[buf->count] = timestamp;
+        buf->count++;
+    }
+    free(data);
+    release_spill(spill);
+    
+    if (buf->scroll_offset >= buf->count) {
+        buf->scroll_offset = buf->count > 0 ? buf->count - 1 : 0;
+    }
+}
+
+/*
+ * Add command to command history ring and the persistent history file
+ * @param input: InputState containing command history
+ * @param cmd: Command string to add
+ * @param cwd: Directory of the terminal running the command
+ */
+void add_to_cmd_history(InputState *input, const char *cmd, const char *cwd) {
+    if (!input->cmd_history) {
+        input->cmd_history = calloc(MAX_CMD_HISTORY, sizeof(char*));
+        if (!input->cmd_history) return;
+    }
+    
+    int slot = (input->cmd_history_head + input->cmd_history_count) % MAX_CMD_HISTORY;
+    
+    if (input->cmd_history_count >= MAX_CMD_HISTORY) {
+        /* Ring is full, overwrite the oldest entry */
+        free(input->cmd_history[slot]);
+        input->cmd_history_head = (input->cmd_history_head + 1) % MAX_CMD_HISTORY;
+        input->cmd_history_count--;
+    }
+    
+    input->cmd_history[slot] = strdup(cmd);
+    input->cmd_history_count++;
+    input->cmd_history_pos = 0;
+    
+    /* Scripted and replayed commands stay out of the interactive history */
+    if (headless_mode || replaying_session()) return;
+    history_store_append(cmd);
+    record_suggestion(cmd, cwd);
+}
+
+/*
+ * Get command from the history ring
+ * @param input: InputState containing command history
+ * @param index: 0 for the oldest entry up to cmd_history_count - 1 for the newest
+ * @return: Command string, or NULL if index is out of range
+ */
+const char* get_cmd_history(InputState *input, int index) {
+    if (index < 0 || index >= input->cmd_history_count) return NULL;
+    return input->cmd_history[(input->cmd_history_head + index) % MAX_CMD_HISTORY];
+}
+
+/*
+ * Check whether a command is in the history ring
+ * @param input: InputState containing command history
+ * @param cmd: Command string
+ * @return: 1 if the ring holds it, 0 otherwise
+ */
+int in_cmd_history(InputState *input, const char *cmd) {
+    for (int i = 0; i < input->cmd_history_count; i++) {
+        if (strcmp(get_cmd_history(input, i), cmd) == 0) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Load a previous command into the input line. Entries of this terminal
+ * come first, then commands other terminals ran since startup, and older
+ * ones continue into the persistent history file.
+ * @param input: InputState to fill
+ * @param steps_back: 1 for the most recent command, 2 for the one before, ...
+ * @return: 1 if an entry was loaded, 0 if there is none
+ */
+int recall_cmd_history(InputState *input, int steps_back) {
+    if (steps_back <= 0) return 0;
+    
+    if (steps_back <= input->cmd_history_count) {
+        set_input_text(input, get_cmd_history(input, input->cmd_history_count - steps_back));
+        return 1;
+    }
+    
+    /* Commands other terminals ran since startup come next, newest first */
+    int index = steps_back - input->cmd_history_count - 1;
+    const char *recent;
+    if (index == 0) history_store_refresh();
+    for (int i = 0; (recent = history_store_recent(i)); i++) {
+        if (in_cmd_history(input, recent)) continue;
+        if (index == 0) {
+            set_input_text(input, recent);
+            return 1;
+        }
+        index--;
+    }
+    
+    /* Unescaping never makes a record longer */
+    const char *record;
+    size_t length;
+    if (!history_store_record(index, &record, &length)) return 0;
+    
+    char *cmd = malloc(length + 1);
+    if (!cmd) return 0;
+    history_store_entry(index, cmd, length + 1);
+    set_input_text(input, cmd);
+    free(cmd);
+    return 1;
+}
+
+/*
+ * Scroll terminal history up
+ * @param history: History buffer to scroll
+ */
+void scroll_terminal_up(HistoryBuffer *history) {
+    if (history->scroll_offset < history->count - 1) {
+        history->scroll_offset++;
+    }
+}
+
+/*
+ * Scroll terminal history down
+ * @param history: History buffer to scroll
+ */
+void scroll_terminal_down(HistoryBuffer *history) {
+    if (history->scroll_offset > 0) {
+        history->scroll_offset--;
+    }
+}
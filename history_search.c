@@ -0,0 +1,682 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Number of best matches kept per query */
+#define SEARCH_TOP 32
+
+/* One cached match level per query length */
+#define SEARCH_LEVELS MAX_SEARCH_QUERY
+
+/* Entries examined per call before the scan yields to the main loop */
+#define SEARCH_STEP_BUDGET 8192
+
+/*
+ * One distinct command in the search index. Text is lowercased; source
+ * is the history file index, or -(n + 1) for the n-th session command.
+ */
+typedef struct {
+    const char *text;
+    uint32_t length;
+    int source;
+    uint64_t mask;
+} SearchEntry;
+
+/*
+ * Scored reference to an index entry
+ */
+typedef struct {
+    int score;
+    int entry;
+} SearchHit;
+
+/*
+ * Greedy match state of one entry. Leftmost matching of a longer query
+ * extends the match of its prefix, so each level continues from here.
+ */
+typedef struct {
+    int entry;
+    uint32_t pos;
+    int streak;
+    int score;
+} SearchMatch;
+
+/*
+ * Matches of one query prefix. Entries are ordered by recency, so a scan
+ * can stop once no later entry can reach the top list; matches then only
+ * covers entries below scanned. A scan that ran out of budget is resumed
+ * from scanned later on.
+ */
+typedef struct {
+    SearchMatch *matches;
+    int match_count;
+    int capacity;
+    int scanned;
+    int unfinished;
+    SearchHit top[SEARCH_TOP];
+    int top_count;
+} SearchLevel;
+
+/*
+ * Search index over the active terminal's ring, the commands other
+ * terminals ran since startup and the history file. The history file part
+ * is built once, the other parts on every search.
+ */
+typedef struct {
+    SearchEntry *store_entries;
+    int store_count;
+    char *store_text;
+    int store_indexed;
+    SearchEntry *entries;
+    int count;
+    int capacity;
+    char **session_text;
+    char **session_lower;
+    int session_count;
+    SearchLevel levels[SEARCH_LEVELS];
+    char level_query[SEARCH_LEVELS];
+    int depth;
+} SearchIndex;
+
+static SearchIndex search_index = {0};
+
+/* Prefilter bit of every byte; letters and digits get bits of their own */
+static uint64_t search_char_bits[256];
+
+/* Characters after which a match counts as a word start */
+static unsigned char search_boundary[256];
+
+/*
+ * Fill the character tables used while matching
+ */
+static void init_search_tables(void) {
+    if (search_char_bits['a']) return;
+
+    for (int c = 0; c < 256; c++) {
+        int bit;
+        if (c >= 'a' && c <= 'z') bit = c - 'a';
+        else if (c >= '0' && c <= '9') bit = 26 + (c - '0');
+        else bit = 36 + (c % 28);
+        search_char_bits[c] = 1ULL << bit;
+    }
+
+    const char *boundaries = " /-_.";
+    for (const char *b = boundaries; *b; b++) {
+        search_boundary[(unsigned char)*b] = 1;
+    }
+}
+
+/*
+ * Compute prefilter mask of all characters in a lowercased string
+ * @param text: Text to scan
+ * @param length: Length of text
+ * @return: Character mask
+ */
+static uint64_t search_text_mask(const char *text, size_t length) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < length; i++) {
+        mask |= search_char_bits[(unsigned char)text[i]];
+    }
+    return mask;
+}
+
+/*
+ * Hash command text for de-duplication
+ * @param text: Text to hash
+ * @param length: Length of text
+ * @return: FNV-1a hash
+ */
+static uint64_t search_hash(const char *text, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Copy text in lowercase
+ * @param dst: Destination buffer of at least length bytes
+ * @param src: Source text
+ * @param length: Number of bytes to copy
+ */
+static void copy_lowercase(char *dst, const char *src, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        dst[i] = tolower((unsigned char)src[i]);
+    }
+}
+
+/*
+ * Index the history file once, newest first, keeping the most recent
+ * occurrence of every command
+ */
+static void index_history_store(void) {
+    search_index.store_indexed = 1;
+
+    int total = history_store_count();
+    if (total == 0) return;
+
+    int table_size = 1;
+    while (table_size < total * 2) table_size <<= 1;
+
+    const char **seen_text = calloc(table_size, sizeof(char*));
+    uint32_t *seen_length = calloc(table_size, sizeof(uint32_t));
+    int *unique = malloc(total * sizeof(int));
+    size_t text_size = 0;
+    int unique_count = 0;
+
+    if (!seen_text || !seen_length || !unique) {
+        free(seen_text);
+        free(seen_length);
+        free(unique);
+        return;
+    }
+
+    for (int i = 0; i < total; i++) {
+        const char *text;
+        size_t length;
+        if (!history_store_record(i, &text, &length)) continue;
+
+        uint64_t slot = search_hash(text, length) & (table_size - 1);
+        int duplicate = 0;
+        while (seen_text[slot]) {
+            if (seen_length[slot] == length && memcmp(seen_text[slot], text, length) == 0) {
+                duplicate = 1;
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (duplicate) continue;
+
+        seen_text[slot] = text;
+        seen_length[slot] = (uint32_t)length;
+        unique[unique_count++] = i;
+        text_size += length;
+    }
+    free(seen_text);
+    free(seen_length);
+
+    /* Lowercased copy of all distinct commands, contiguous for scanning */
+    search_index.store_text = malloc(text_size + 1);
+    search_index.store_entries = malloc(unique_count * sizeof(SearchEntry));
+    if (!search_index.store_text || !search_index.store_entries) {
+        free(search_index.store_text);
+        free(search_index.store_entries);
+        search_index.store_text = NULL;
+        search_index.store_entries = NULL;
+        free(unique);
+        return;
+    }
+
+    char *dst = search_index.store_text;
+    for (int i = 0; i < unique_count; i++) {
+        const char *text;
+        size_t length;
+        history_store_record(unique[i], &text, &length);
+        copy_lowercase(dst, text, length);
+
+        SearchEntry *entry = &search_index.store_entries[i];
+        entry->text = dst;
+        entry->length = (uint32_t)length;
+        entry->source = unique[i];
+        entry->mask = search_text_mask(dst, length);
+        dst += length;
+    }
+    search_index.store_count = unique_count;
+    free(unique);
+}
+
+/*
+ * Add a command of this process to the search index
+ * @param cmd: Command string
+ * @return: 1 on success, 0 if out of memory
+ */
+static int add_session_entry(const char *cmd) {
+    size_t length = strlen(cmd);
+    char *copy = strdup(cmd);
+    char *lower = malloc(length + 1);
+    if (!copy || !lower) {
+        free(copy);
+        free(lower);
+        return 0;
+    }
+    copy_lowercase(lower, cmd, length + 1);
+
+    int n = search_index.session_count++;
+    search_index.session_text[n] = copy;
+    search_index.session_lower[n] = lower;
+
+    SearchEntry *entry = &search_index.entries[search_index.count++];
+    entry->text = lower;
+    entry->length = (uint32_t)length;
+    entry->source = -(n + 1);
+    entry->mask = search_text_mask(lower, length);
+    return 1;
+}
+
+/*
+ * Drop cached match levels
+ */
+static void reset_search_levels(void) {
+    search_index.depth = 0;
+    search_index.level_query[0] = '\0';
+}
+
+/*
+ * Rebuild the index with the given terminal's commands in front of the
+ * history file entries
+ * @param input: InputState whose command ring is searched first
+ */
+static void build_search_index(InputState *input) {
+    init_search_tables();
+    
+    for (int i = 0; i < search_index.session_count; i++) {
+        free(search_index.session_text[i]);
+        free(search_index.session_lower[i]);
+    }
+    free(search_index.session_text);
+    free(search_index.session_lower);
+    search_index.session_text = NULL;
+    search_index.session_lower = NULL;
+    search_index.session_count = 0;
+    search_index.count = 0;
+    reset_search_levels();
+
+    if (!search_index.store_indexed) index_history_store();
+    int recent_count = history_store_refresh();
+
+    int needed = input->cmd_history_count + recent_count + search_index.store_count;
+    if (needed > search_index.capacity) {
+        SearchEntry *entries = realloc(search_index.entries, needed * sizeof(SearchEntry));
+        if (!entries) return;
+        search_index.entries = entries;
+        search_index.capacity = needed;
+    }
+
+    search_index.session_text = malloc((input->cmd_history_count + recent_count + 1) * sizeof(char*));
+    search_index.session_lower = malloc((input->cmd_history_count + recent_count + 1) * sizeof(char*));
+    if (search_index.session_text && search_index.session_lower) {
+        for (int i = input->cmd_history_count - 1; i >= 0; i--) {
+            if (!add_session_entry(get_cmd_history(input, i))) break;
+        }
+
+        /* Then what other terminals ran since startup, once each */
+        for (int i = 0; i < recent_count; i++) {
+            const char *cmd = history_store_recent(i);
+            if (in_cmd_history(input, cmd)) continue;
+
+            int duplicate = 0;
+            for (int j = input->cmd_history_count; j < search_index.session_count && !duplicate; j++) {
+                duplicate = strcmp(search_index.session_text[j], cmd) == 0;
+            }
+            if (!duplicate && !add_session_entry(cmd)) break;
+        }
+    }
+
+    /* Session commands are newer than anything in the history file */
+    if (search_index.store_count > 0) {
+        memcpy(search_index.entries + search_index.count, search_index.store_entries,
+               search_index.store_count * sizeof(SearchEntry));
+        search_index.count += search_index.store_count;
+    }
+}
+
+/*
+ * Extend a greedy subsequence match by one query character
+ * @param entry: Candidate entry
+ * @param match: Match state of the query prefix, updated in place
+ * @param c: Next lowercased query character
+ * @param first: 1 if c is the first query character
+ * @return: 1 if c was found after the previous match, 0 otherwise
+ */
+static int extend_fuzzy_match(const SearchEntry *entry, SearchMatch *match, char c, int first) {
+    const char *text = entry->text;
+    const char *pos = text + match->pos;
+    const char *hit = memchr(pos, c, entry->length - match->pos);
+    if (!hit) return 0;
+
+    int gap = (int)(hit - pos);
+    match->streak = (gap == 0 && !first) ? match->streak + 1 : 0;
+    match->score += 16 + match->streak * 8;
+    if (hit == text || search_boundary[(unsigned char)hit[-1]]) match->score += 12;
+    match->score -= gap < 16 ? gap : 16;
+    match->pos = (uint32_t)(hit - text) + 1;
+    return 1;
+}
+
+/*
+ * Highest score fuzzy_score() can give a query. A character either extends
+ * the run of adjacent matches or starts a new one at a word boundary.
+ * @param query: Lowercased query
+ * @param length: Query length
+ * @return: Upper bound of the fuzzy score
+ */
+static int fuzzy_score_bound(const char *query, int length) {
+    int best[SEARCH_LEVELS];
+    int next[SEARCH_LEVELS];
+
+    /* best[s]: highest score so far ending in a run of s extra adjacent matches */
+    best[0] = 28;
+    for (int s = 1; s < length; s++) best[s] = -1;
+
+    for (int j = 1; j < length; j++) {
+        int boundary = search_boundary[(unsigned char)query[j - 1]] ? 12 : 0;
+        int restart = -1;
+
+        for (int s = 0; s < length; s++) {
+            next[s] = -1;
+            if (best[s] > restart) restart = best[s];
+        }
+        next[0] = restart + 28;
+        for (int s = 0; s + 1 < length; s++) {
+            if (best[s] >= 0) next[s + 1] = best[s] + 16 + (s + 1) * 8 + boundary;
+        }
+        memcpy(best, next, sizeof(int) * length);
+    }
+
+    int bound = 0;
+    for (int s = 0; s < length; s++) {
+        if (best[s] > bound) bound = best[s];
+    }
+    return bound;
+}
+
+/*
+ * Logarithmic recency bonus, each halving of recency costs 8 points
+ * @param rank: Recency rank, 0 for the newest entry
+ * @return: Bonus between 0 and 160
+ */
+static int recency_bonus(uint32_t rank) {
+    int bonus = 160;
+    while (rank > 0 && bonus > 0) {
+        rank >>= 1;
+        bonus -= 8;
+    }
+    return bonus;
+}
+
+/*
+ * Insert hit into a level's top list, which is kept sorted by score
+ * @param level: Level receiving the hit
+ * @param score: Final score
+ * @param entry: Index entry
+ */
+static void keep_top_hit(SearchLevel *level, int score, int entry) {
+    int pos = level->top_count;
+    if (pos == SEARCH_TOP) {
+        if (score <= level->top[SEARCH_TOP - 1].score) return;
+        pos--;
+    } else {
+        level->top_count++;
+    }
+
+    while (pos > 0 && level->top[pos - 1].score < score) {
+        level->top[pos] = level->top[pos - 1];
+        pos--;
+    }
+    level->top[pos].score = score;
+    level->top[pos].entry = entry;
+}
+
+/*
+ * Record a match in the level
+ * @param level: Level being computed
+ * @param match: Match state
+ */
+static void add_search_match(SearchLevel *level, const SearchMatch *match) {
+    if (level->match_count >= level->capacity) {
+        int capacity = level->capacity ? level->capacity * 2 : 256;
+        SearchMatch *matches = realloc(level->matches, capacity * sizeof(SearchMatch));
+        if (!matches) return;
+        level->matches = matches;
+        level->capacity = capacity;
+    }
+    level->matches[level->match_count++] = *match;
+
+    /* Prefer tighter candidates */
+    int length = (int)search_index.entries[match->entry].length;
+    int score = (match->score - length / 16) * 2 + recency_bonus(match->entry);
+    keep_top_hit(level, score, match->entry);
+}
+
+/*
+ * Compute matches of the query prefix of length depth, starting at entry
+ * level->scanned when resuming. Matches of the previous level are extended
+ * by one character; entries it did not reach are matched from scratch.
+ * @param depth: Query prefix length, at least 1
+ * @param query: Lowercased query
+ * @param resume: 1 to continue an unfinished scan, 0 to start over
+ * @param budget: Maximum number of entries to examine
+ * @return: Number of entries examined
+ */
+static int compute_search_level(int depth, const char *query, int resume, int budget) {
+    SearchLevel *level = &search_index.levels[depth];
+    SearchLevel *prev = depth > 1 ? &search_index.levels[depth - 1] : NULL;
+    int bound = 2 * fuzzy_score_bound(query, depth);
+    uint64_t mask = search_text_mask(query, depth);
+    char c = query[depth - 1];
+    int start = resume ? level->scanned : 0;
+    int examined = 0;
+
+    if (!resume) {
+        level->match_count = 0;
+        level->top_count = 0;
+    }
+    level->unfinished = 0;
+
+    int prev_matches = prev ? prev->match_count : 0;
+    int prev_scanned = prev ? prev->scanned : 0;
+
+    /* Previous matches are sorted by entry, skip the part already done */
+    int lo = 0, hi = prev_matches;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (prev->matches[mid].entry < start) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (int i = lo; i < prev_matches; i++) {
+        SearchMatch match = prev->matches[i];
+
+        /* No later entry can beat the current top list */
+        if (level->top_count == SEARCH_TOP &&
+            bound + recency_bonus(match.entry) <= level->top[SEARCH_TOP - 1].score) {
+            level->scanned = match.entry;
+            return examined;
+        }
+        if (examined++ >= budget) {
+            level->scanned = match.entry;
+            level->unfinished = 1;
+            return examined;
+        }
+        if (extend_fuzzy_match(&search_index.entries[match.entry], &match, c, depth == 1)) {
+            add_search_match(level, &match);
+        }
+    }
+
+    for (int idx = start > prev_scanned ? start : prev_scanned; idx < search_index.count; idx++) {
+        if (level->top_count == SEARCH_TOP &&
+            bound + recency_bonus(idx) <= level->top[SEARCH_TOP - 1].score) {
+            level->scanned = idx;
+            return examined;
+        }
+        if (examined++ >= budget) {
+            level->scanned = idx;
+            level->unfinished = 1;
+            return examined;
+        }
+
+        const SearchEntry *entry = &search_index.entries[idx];
+        if ((entry->mask & mask) != mask) continue;
+
+        SearchMatch match = {idx, 0, 0, 0};
+        int j = 0;
+        while (j < depth && extend_fuzzy_match(entry, &match, query[j], j == 0)) j++;
+        if (j == depth) add_search_match(level, &match);
+    }
+    level->scanned = search_index.count;
+    return examined;
+}
+
+/*
+ * Bring match levels up to date with the query, reusing every level
+ * whose prefix is unchanged. Work is capped at SEARCH_STEP_BUDGET entries;
+ * continue_history_search() finishes unfinished levels.
+ * @param query: Lowercased query
+ * @param length: Query length
+ */
+static void run_history_search(const char *query, int length) {
+    int common = 0;
+    while (common < search_index.depth && common < length &&
+           search_index.level_query[common] == query[common]) {
+        common++;
+    }
+
+    int budget = SEARCH_STEP_BUDGET;
+    for (int depth = common + 1; depth <= length; depth++) {
+        /* Deeper levels only need the matches found so far */
+        int share = budget / (length - depth + 1);
+        budget -= compute_search_level(depth, query, 0, share > 0 ? share : 1);
+    }
+
+    memcpy(search_index.level_query, query, length);
+    search_index.level_query[length] = '\0';
+    search_index.depth = length;
+}
+
+/*
+ * Copy the selected match into the input line
+ * @param input: InputState receiving the match
+ * @return: 1 if a match was loaded, 0 if there is none
+ */
+static int load_search_match(InputState *input) {
+    SearchLevel *level = &search_index.levels[search_index.depth];
+    if (search_index.depth == 0 || input->search_choice >= level->top_count) return 0;
+
+    const SearchEntry *entry = &search_index.entries[level->top[input->search_choice].entry];
+    if (entry->source >= 0) {
+        const char *record;
+        size_t length;
+        if (!history_store_record(entry->source, &record, &length)) return 0;
+
+        char *cmd = malloc(length + 1);
+        if (!cmd) return 0;
+        history_store_entry(entry->source, cmd, length + 1);
+        set_input_text(input, cmd);
+        free(cmd);
+    } else {
+        set_input_text(input, search_index.session_text[-entry->source - 1]);
+    }
+    return 1;
+}
+
+/*
+ * Enter reverse incremental history search (Ctrl+R)
+ * @param input: InputState that receives the result
+ */
+void start_history_search(InputState *input) {
+    build_search_index(input);
+
+    free(input->search_saved);
+    input->search_saved = strdup(get_input_text(input));
+    input->search_query[0] = '\0';
+    input->search_len = 0;
+    input->search_choice = 0;
+    input->search_failed = 0;
+    input->search_active = 1;
+}
+
+/*
+ * Rerun search after the query changed and show the best match
+ * @param input: InputState in search mode
+ */
+void update_history_search(InputState *input) {
+    input->search_query[input->search_len] = '\0';
+    input->search_choice = 0;
+
+    if (input->search_len == 0) {
+        search_index.depth = 0;
+        input->search_failed = 0;
+        return;
+    }
+
+    char query[SEARCH_LEVELS];
+    copy_lowercase(query, input->search_query, input->search_len);
+    run_history_search(query, input->search_len);
+    input->search_failed = !load_search_match(input);
+}
+
+/*
+ * Check whether the current query still has entries left to scan
+ * @return: 1 if continue_history_search() has work to do, 0 otherwise
+ */
+int history_search_pending(void) {
+    return search_index.depth > 0 && search_index.levels[search_index.depth].unfinished;
+}
+
+/*
+ * Continue an unfinished scan for the current query and refresh the match
+ * @param input: InputState in search mode
+ */
+void continue_history_search(InputState *input) {
+    if (!input->search_active || !history_search_pending()) return;
+
+    compute_search_level(search_index.depth, search_index.level_query, 1, SEARCH_STEP_BUDGET);
+    input->search_choice = 0;
+    input->search_failed = !load_search_match(input);
+}
+
+/*
+ * Step to the next best match (Ctrl+R pressed again)
+ * @param input: InputState in search mode
+ */
+void next_history_search_match(InputState *input) {
+    char *current = strdup(get_input_text(input));
+    if (!current) return;
+
+    /* The same command can appear both in the ring and the history file */
+    while (input->search_choice + 1 < search_index.levels[search_index.depth].top_count) {
+        input->search_choice++;
+        load_search_match(input);
+        if (strcmp(current, get_input_text(input)) != 0) break;
+    }
+    free(current);
+}
+
+/*
+ * Leave history search
+ * @param input: InputState in search mode
+ * @param accept: 1 to keep the match in the input line, 0 to restore it
+ */
+void end_history_search(InputState *input, int accept) {
+    if (!accept || input->search_failed || input->search_len == 0) {
+        set_input_text(input, input->search_saved ? input->search_saved : "");
+    }
+    free(input->search_saved);
+    input->search_saved = NULL;
+    input->search_active = 0;
+    input->display_start = 0;
+    input->cmd_history_pos = 0;
+}
+
+/*
+ * Release the search index
+ */
+void free_history_search(void) {
+    for (int i = 0; i < search_index.session_count; i++) {
+        free(search_index.session_text[i]);
+        free(search_index.session_lower[i]);
+    }
+    for (int i = 0; i < SEARCH_LEVELS; i++) {
+        free(search_index.levels[i].matches);
+    }
+    free(search_index.session_text);
+    free(search_index.session_lower);
+    free(search_index.entries);
+    free(search_index.store_entries);
+    free(search_index.store_text);
+    memset(&search_index, 0, sizeof(search_index));
+}
@@ -0,0 +1,403 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Location of one record inside the mapped history file
+ */
+typedef struct {
+    size_t offset;
+    size_t length;
+} HistoryRecord;
+
+/*
+ * Persistent command history shared by all terminals and sessions.
+ * The file is opened on first use; the part that existed at that moment
+ * is mapped on first read and indexed backwards only as far as needed.
+ * Commands appended after that, by this process or another one, are
+ * kept unescaped in recent; tail_end is how far the file has been read.
+ */
+typedef struct {
+    int state;
+    int fd;
+    size_t snapshot_size;
+    char *map;
+    size_t scan_end;
+    HistoryRecord *records;
+    int count;
+    int capacity;
+    size_t tail_end;
+    char **recent;
+    int recent_count;
+    int recent_capacity;
+} HistoryStore;
+
+/* Store states */
+#define STORE_CLOSED 0
+#define STORE_OPEN 1
+#define STORE_MAPPED 2
+#define STORE_DISABLED 3
+
+/* Commands appended since the file was opened that are kept in memory */
+#define MAX_RECENT_COMMANDS 1024
+
+static HistoryStore history_store = {STORE_CLOSED, -1, 0, NULL, 0, NULL, 0, 0, 0, NULL, 0, 0};
+
+/*
+ * Resolve the history file path from PARROT_HISTFILE or HOME
+ * @param path: Buffer for the path
+ * @param size: Size of path buffer
+ * @return: 1 if a path is available, 0 otherwise
+ */
+static int history_store_path(char *path, size_t size) {
+    const char *file = getenv("PARROT_HISTFILE");
+    if (file) {
+        if (file[0] == '\0') return 0;
+        snprintf(path, size, "%s", file);
+        return 1;
+    }
+
+    const char *home = getenv("HOME");
+    if (!home) return 0;
+    snprintf(path, size, "%s/.parrot_history", home);
+    return 1;
+}
+
+/*
+ * Open the history file and remember how much of it predates this session
+ * @return: 1 if the store is usable, 0 otherwise
+ */
+static int open_history_store(void) {
+    if (history_store.state == STORE_DISABLED) return 0;
+    if (history_store.state != STORE_CLOSED) return 1;
+
+    char path[PATH_MAX];
+    if (!history_store_path(path, sizeof(path))) {
+        history_store.state = STORE_DISABLED;
+        return 0;
+    }
+
+    /* A replay reads the history but must not create it */
+    int flags = O_RDWR | O_APPEND | O_CLOEXEC;
+    if (!replaying_session()) flags |= O_CREAT;
+    history_store.fd = open(path, flags, 0600);
+    if (history_store.fd == -1) {
+        if (errno != ENOENT || !replaying_session()) history_store.state = STORE_DISABLED;
+        return 0;
+    }
+
+    struct stat st;
+    flock(history_store.fd, LOCK_SH);
+    if (fstat(history_store.fd, &st) == 0) {
+        history_store.snapshot_size = st.st_size;
+        history_store.tail_end = st.st_size;
+    }
+    flock(history_store.fd, LOCK_UN);
+
+    history_store.state = STORE_OPEN;
+    return 1;
+}
+
+/*
+ * Map the snapshot of the history file for reading
+ * @return: 1 if mapped, 0 if there is nothing to read
+ */
+static int map_history_store(void) {
+    if (!open_history_store()) return 0;
+    if (history_store.state == STORE_MAPPED) return 1;
+    if (history_store.snapshot_size == 0) return 0;
+
+    void *map = mmap(NULL, history_store.snapshot_size, PROT_READ,
+                     MAP_PRIVATE, history_store.fd, 0);
+    if (map == MAP_FAILED) return 0;
+
+    history_store.map = map;
+    history_store.scan_end = history_store.snapshot_size;
+    history_store.state = STORE_MAPPED;
+    return 1;
+}
+
+/*
+ * Index one more record, moving backwards from the newest unindexed one
+ * @return: 1 if a record was indexed, 0 at the start of the file
+ */
+static int index_previous_record(void) {
+    while (history_store.scan_end > 0) {
+        size_t end = history_store.scan_end;
+        if (history_store.map[end - 1] == '\n') end--;
+
+        const char *newline = end > 0 ? memrchr(history_store.map, '\n', end) : NULL;
+        size_t start = newline ? (size_t)(newline - history_store.map) + 1 : 0;
+        history_store.scan_end = start;
+
+        if (end == start) continue;
+
+        if (history_store.count >= history_store.capacity) {
+            int capacity = history_store.capacity ? history_store.capacity * 2 : 256;
+            HistoryRecord *records = realloc(history_store.records,
+                                             capacity * sizeof(HistoryRecord));
+            if (!records) return 0;
+            history_store.records = records;
+            history_store.capacity = capacity;
+        }
+
+        history_store.records[history_store.count].offset = start;
+        history_store.records[history_store.count].length = end - start;
+        history_store.count++;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Unescape a record in place
+ * @param record: Escaped record without its newline, NUL-terminated
+ */
+static void unescape_record(char *record) {
+    char *dst = record;
+    for (const char *src = record; *src; src++) {
+        if (*src == '\\' && src[1]) {
+            src++;
+            *dst++ = (*src == 'n') ? '\n' : *src;
+        } else {
+            *dst++ = *src;
+        }
+    }
+    *dst = '\0';
+}
+
+/*
+ * Keep a command appended after the snapshot, dropping the oldest half
+ * of the list when it is full
+ * @param cmd: Unescaped command, owned by the store afterwards
+ */
+static void add_recent_command(char *cmd) {
+    if (history_store.recent_count == MAX_RECENT_COMMANDS) {
+        int drop = MAX_RECENT_COMMANDS / 2;
+        for (int i = 0; i < drop; i++) free(history_store.recent[i]);
+        memmove(history_store.recent, history_store.recent + drop,
+                (history_store.recent_count - drop) * sizeof(char*));
+        history_store.recent_count -= drop;
+    }
+    if (history_store.recent_count >= history_store.recent_capacity) {
+        int capacity = history_store.recent_capacity ? history_store.recent_capacity * 2 : 64;
+        char **recent = realloc(history_store.recent, capacity * sizeof(char*));
+        if (!recent) {
+            free(cmd);
+            return;
+        }
+        history_store.recent = recent;
+        history_store.recent_capacity = capacity;
+    }
+    history_store.recent[history_store.recent_count++] = cmd;
+}
+
+/*
+ * Read records other processes appended since tail_end. The caller
+ * holds a lock on the file, so only whole records are there.
+ */
+static void read_history_tail(void) {
+    struct stat st;
+    if (fstat(history_store.fd, &st) != 0 || (size_t)st.st_size <= history_store.tail_end) return;
+
+    size_t size = st.st_size - history_store.tail_end;
+    char *tail = malloc(size + 1);
+    if (!tail) return;
+
+    ssize_t got = pread(history_store.fd, tail, size, history_store.tail_end);
+    if (got <= 0) {
+        free(tail);
+        return;
+    }
+
+    char *start = tail;
+    char *end = tail + got;
+    char *newline;
+    while (start < end && (newline = memchr(start, '\n', end - start))) {
+        *newline = '\0';
+        if (newline > start) {
+            char *cmd = strdup(start);
+            if (cmd) {
+                unescape_record(cmd);
+                add_recent_command(cmd);
+            }
+        }
+        start = newline + 1;
+    }
+    history_store.tail_end += start - tail;
+    free(tail);
+}
+
+/*
+ * Pick up commands other processes appended to the history file
+ * @return: Number of commands appended since the file was opened
+ */
+int history_store_refresh(void) {
+    if (!open_history_store()) return 0;
+
+    flock(history_store.fd, LOCK_SH);
+    read_history_tail();
+    flock(history_store.fd, LOCK_UN);
+    return history_store.recent_count;
+}
+
+/*
+ * Get a command appended since the history file was opened, as of the
+ * last history_store_refresh()
+ * @param index: 0 for the newest, 1 for the one before, ...
+ * @return: Command string, or NULL if there is no such entry
+ */
+const char *history_store_recent(int index) {
+    if (index < 0 || index >= history_store.recent_count) return NULL;
+    return history_store.recent[history_store.recent_count - 1 - index];
+}
+
+/*
+ * Append command to the history file under an exclusive lock
+ * @param cmd: Command string to record
+ */
+void history_store_append(const char *cmd) {
+    if (!open_history_store()) return;
+
+    /* Escape backslashes and newlines so each record stays on one line */
+    size_t len = strlen(cmd);
+    char *record = malloc(len * 2 + 2);
+    if (!record) return;
+
+    char *dst = record;
+    for (const char *src = cmd; *src; src++) {
+        if (*src == '\\' || *src == '\n') {
+            *dst++ = '\\';
+            *dst++ = (*src == '\n') ? 'n' : '\\';
+        } else {
+            *dst++ = *src;
+        }
+    }
+    *dst++ = '\n';
+
+    /* Records other processes wrote first stay in order before this one */
+    flock(history_store.fd, LOCK_EX);
+    read_history_tail();
+
+    struct stat st;
+    off_t start = fstat(history_store.fd, &st) == 0 ? st.st_size : -1;
+    size_t total = dst - record;
+    size_t written = 0;
+    while (written < total) {
+        ssize_t n = write(history_store.fd, record + written, total - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        written += n;
+    }
+
+    if (written == total) {
+        if ((off_t)history_store.tail_end == start) history_store.tail_end += total;
+    } else if (written > 0 && start >= 0) {
+        /* Take back a partial record so no reader sees half a line */
+        if (ftruncate(history_store.fd, start) != 0) history_store.tail_end = start + written;
+    }
+    flock(history_store.fd, LOCK_UN);
+
+    free(record);
+
+    char *copy = strdup(cmd);
+    if (copy) add_recent_command(copy);
+}
+
+/*
+ * Get command from the history file
+ * @param index: 0 for the newest entry from previous sessions, 1 for the one before, ...
+ * @param out: Buffer for the unescaped command
+ * @param out_size: Size of output buffer
+ * @return: Length of command, or -1 if there is no such entry
+ */
+int history_store_entry(int index, char *out, size_t out_size) {
+    if (index < 0 || out_size == 0 || !map_history_store()) return -1;
+
+    while (history_store.count <= index) {
+        if (!index_previous_record()) return -1;
+    }
+
+    const HistoryRecord *record = &history_store.records[index];
+    const char *src = history_store.map + record->offset;
+    const char *src_end = src + record->length;
+    size_t len = 0;
+
+    while (src < src_end && len < out_size - 1) {
+        if (*src == '\\' && src + 1 < src_end) {
+            src++;
+            out[len++] = (*src == 'n') ? '\n' : *src;
+        } else {
+            out[len++] = *src;
+        }
+        src++;
+    }
+    out[len] = '\0';
+    return (int)len;
+}
+
+/*
+ * Get raw (still escaped) record from the history file without copying
+ * @param index: 0 for the newest entry from previous sessions, 1 for the one before, ...
+ * @param text: Receives pointer into the mapped file
+ * @param length: Receives record length
+ * @return: 1 if the record exists, 0 otherwise
+ */
+int history_store_record(int index, const char **text, size_t *length) {
+    if (index < 0 || !map_history_store()) return 0;
+
+    while (history_store.count <= index) {
+        if (!index_previous_record()) return 0;
+    }
+
+    *text = history_store.map + history_store.records[index].offset;
+    *length = history_store.records[index].length;
+    return 1;
+}
+
+/*
+ * Count entries in the history file, indexing all of it
+ * @return: Number of entries from previous sessions
+ */
+int history_store_count(void) {
+    if (!map_history_store()) return 0;
+    while (index_previous_record());
+    return history_store.count;
+}
+
+/*
+ * Release the history file mapping and index
+ */
+void close_history_store(void) {
+    if (history_store.map) {
+        munmap(history_store.map, history_store.snapshot_size);
+    }
+    if (history_store.fd != -1) {
+        close(history_store.fd);
+    }
+    free(history_store.records);
+    for (int i = 0; i < history_store.recent_count; i++) {
+        free(history_store.recent[i]);
+    }
+    free(history_store.recent);
+
+    history_store.state = STORE_CLOSED;
+    history_store.fd = -1;
+    history_store.snapshot_size = 0;
+    history_store.map = NULL;
+    history_store.scan_end = 0;
+    history_store.records = NULL;
+    history_store.count = 0;
+    history_store.capacity = 0;
+    history_store.tail_end = 0;
+    history_store.recent = NULL;
+    history_store.recent_count = 0;
+    history_store.recent_capacity = 0;
+}
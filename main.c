@@ -4,30 +4,52 @@
 #include <string.h>
 #include <limits.h>
 #include <stdio.h>
+#include <locale.h>
 
 /* Handle non-interactive mode commands */
-static void handle_non_interactive_mode(int argc, char *argv[]);
+static int handle_non_interactive_mode(int argc, char *argv[]);
 
 int main(int argc, char *argv[]) {
     /* Handle command line arguments for non-interactive mode */
     if (argc > 1) {
-        handle_non_interactive_mode(argc, argv);
-        return 0;
+        return handle_non_interactive_mode(argc, argv);
     }
 
-    /* Initialize ncurses for interactive mode */
+    return run_interactive_mode(NULL);
+}
+
+/*
+ * Run the ncurses terminal on the controlling terminal until exit
+ * @param restore_path: Snapshot to reopen, or NULL for a fresh terminal
+ * @return: Process exit status
+ */
+int run_interactive_mode(const char *restore_path) {
+    /* Initialize ncurses for interactive mode, with UTF-8 output if the locale has it */
+    setlocale(LC_CTYPE, "");
     initscr();
     raw();
     keypad(stdscr, TRUE);
+    init_input_keys();
     noecho();
     curs_set(1);
-    timeout(100);
+    timeout(0);
+    set_bracketed_paste(1);
 
     /* Initialize terminal system */
+    interactive_command_handler = run_interactive_application;
     init_terminal_manager();
     init_colors();
+    init_control_socket();
     
-    show_welcome_message(&get_active_terminal()->history);
+    if (restore_path) {
+        char msg[PATH_MAX + 128];
+        if (!restore_snapshot(restore_path, msg, sizeof(msg))) {
+            show_welcome_message(&get_active_terminal()->history);
+        }
+        add_history_line(&get_active_terminal()->history, msg, HISTORY_TYPE_NORMAL);
+    } else {
+        show_welcome_message(&get_active_terminal()->history);
+    }
 
     /* Main event loop */
     while (1) {
@@ -35,19 +57,33 @@ int main(int argc, char *argv[]) {
         
         update_real_time_display();
         
+        wait_for_command_activity(100);
+        pump_command_output();
+        continue_replay();
+        process_control_requests();
+        
         if (handle_input(&active->input, &active->history)) break;
+        continue_history_search(&get_active_terminal()->input);
+        continue_suggestion_seed();
         
         process_command_queue();
+        hibernate_idle_terminals();
     }
 
     /* Cleanup resources */
-    for (int i = 0; i < terminal_manager.terminal_count; i++) {
-        free_history_buffer(&terminal_manager.terminals[i].history);
-        free_input_state(&terminal_manager.terminals[i].input);
-    }
-    free(terminal_manager.terminals);
+    close_control_socket();
+    free_terminal_manager();
+    free_snapshot();
+    free_history_search();
+    free_completion_cache();
+    free_suggestions();
+    free_frecency_store();
+    free_kill_buffer();
+    close_history_store();
     
+    set_bracketed_paste(0);
     endwin();
+    close_recording();
     return 0;
 }
 
@@ -55,8 +91,47 @@ int main(int argc, char *argv[]) {
  * Handle non-interactive mode commands
  * @param argc: Argument count
  * @param argv: Argument vector
+ * @return: Process exit status
  */
-static void handle_non_interactive_mode(int argc, char *argv[]) {
+static int handle_non_interactive_mode(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "attach") == 0) {
+        return attach_session(argc > 2 ? argv[2] : NULL);
+    }
+    
+    if (argc > 1 && (strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "run") == 0)) {
+        return run_batch_mode(argc - 1, argv + 1);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "--restore") == 0) {
+        char path[PATH_MAX];
+        if (argc > 2) {
+            snprintf(path, sizeof(path), "%s", argv[2]);
+        } else if (!snapshot_default_path(path, sizeof(path))) {
+            fprintf(stderr, "--restore: HOME is not set\n");
+            return 1;
+        }
+        return run_interactive_mode(path);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "--record") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "--record: missing file\n");
+            return 2;
+        }
+        if (!open_recording(argv[2])) return 1;
+        return run_interactive_mode(NULL);
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "--replay: missing file\n");
+            return 2;
+        }
+        int fast = argc > 3 && strcmp(argv[3], "--fast") == 0;
+        if (!open_replay(argv[2], fast)) return 1;
+        return run_interactive_mode(NULL);
+    }
+    
     if (argc == 1 || strcmp(argv[1], "manual") == 0) {
         printf("Parrot Terminal %s\n", PARROT_VERSION);
         printf("==========================================\n");
@@ -68,11 +143,44 @@ static void handle_non_interactive_mode(int argc, char *argv[]) {
         printf("  Alt+Arrows: Switch between split panes\n");
         printf("  Arrow Keys: Scroll terminal history\n");
         printf("  Shift+Up/Down: Command history\n");
+        printf("  Ctrl+R: Reverse search command history\n");
+        printf("  Tab: Complete command or path\n");
+        printf("  Right/End: Accept history suggestion\n");
+        printf("  Alt+Enter: Insert a new line into the command\n");
+        printf("  Ctrl+Left/Right, Alt+B/F: Move by word\n");
+        printf("  Ctrl+A/E: Start/end of line\n");
+        printf("  Ctrl+K/U, Alt+D/Backspace: Kill text, Ctrl+Y: Yank\n");
+        printf("  Ctrl+L: Redraw the screen\n");
+        printf("\nBatch mode:\n");
+        printf("  parrot -c [-t] command: Run a command without the interface\n");
+        printf("  parrot run [-t] script|-: Run each line of a script in order\n");
+        printf("  -t: Prefix output lines with the time they arrived\n");
+        printf("  --events jsonl: Print JSON lines for command start, output by stream and end\n");
+        printf("  -j N: Run N commands at once, printing each one's output whole\n");
+        printf("  --order input|completion: Print outputs in script order (default) or as commands finish\n");
+        printf("\nControl socket:\n");
+        printf("  $PARROT_CONTROL: Unix socket taking JSON-RPC 2.0 requests, one per line\n");
+        printf("  Methods: list, submit, state, scrollback, subscribe, unsubscribe\n");
+        printf("\nSnapshots:\n");
+        printf("  snapshot [file]: Save all terminals (default ~/.parrot_snapshot)\n");
+        printf("  parrot --restore [file]: Reopen the terminals of a snapshot\n");
+        printf("\nRecording:\n");
+        printf("  parrot --record file: Save keys and command output with their timing\n");
+        printf("  parrot --replay file [--fast]: Play a recording back, at maximum speed with --fast\n");
+        printf("\nSessions:\n");
+        printf("  parrot attach [name]: Attach to a session, starting it if needed\n");
+        printf("  Ctrl+\\: Detach; terminals and running commands keep going\n");
         printf("\nCommand Queue Features:\n");
         printf("  - Commands auto-queue when another is running\n");
         printf("  - Queue size: 10 commands maximum\n");
         printf("  - Terminal locks when queue is full (red clock)\n");
         printf("  - Input shows #### when locked\n");
+        printf("\nBuiltins:\n");
+        printf("  j pattern: Jump to the most frecent matching directory\n");
         printf("Type 'parrot' to start interactive mode\n");
-    } else printf("Unknown command: %s\n", argv[1]);
+    } else {
+        printf("Unknown command: %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
 }
@@ -0,0 +1,366 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+/* Seconds a background terminal stays idle before its scrollback is spilled */
+#define TERMINAL_IDLE_SECONDS 300
+
+TerminalManager terminal_manager = {0};
+
+/*
+ * Take a free slot for a new terminal, doubling the slot map when full
+ * @return: Slot index, or -1 if no slot can be allocated
+ */
+static int allocate_terminal_slot(void) {
+    TerminalManager *tm = &terminal_manager;
+    if (tm->free_count > 0) return tm->free_slots[--tm->free_count];
+    
+    int capacity = tm->slot_capacity ? tm->slot_capacity * 2 : 8;
+    if (capacity > TERMINAL_SLOT_MASK + 1) return -1;
+    
+    Terminal **slots = realloc(tm->slots, capacity * sizeof(Terminal*));
+    if (!slots) return -1;
+    tm->slots = slots;
+    unsigned int *generations = realloc(tm->generations, capacity * sizeof(unsigned int));
+    if (!generations) return -1;
+    tm->generations = generations;
+    int *free_slots = realloc(tm->free_slots, capacity * sizeof(int));
+    if (!free_slots) return -1;
+    tm->free_slots = free_slots;
+    
+    /* Hand out the first new slot, keep the rest lowest on top */
+    for (int i = capacity - 1; i >= tm->slot_capacity; i--) {
+        slots[i] = NULL;
+        generations[i] = 0;
+        if (i > tm->slot_capacity) free_slots[tm->free_count++] = i;
+    }
+    int slot = tm->slot_capacity;
+    tm->slot_capacity = capacity;
+    return slot;
+}
+
+/*
+ * Create a terminal and append it to the tab order
+ * @param cwd: Working directory of the new terminal
+ * @return: New terminal, or NULL on allocation failure
+ */
+Terminal* add_terminal(const char *cwd) {
+    TerminalManager *tm = &terminal_manager;
+    int slot = allocate_terminal_slot();
+    if (slot < 0) return NULL;
+    
+    Terminal *term = calloc(1, sizeof(Terminal));
+    if (!term) {
+        tm->free_slots[tm->free_count++] = slot;
+        return NULL;
+    }
+    
+    init_history_buffer(&term->history);
+    init_input_state(&term->input);
+    init_command_queue(&term->cmd_queue);
+    term->id = (int)((tm->generations[slot] & TERMINAL_GENERATION_MASK) << TERMINAL_SLOT_BITS) | slot;
+    term->split_with = -1;
+    init_command_process(term);
+    snprintf(term->current_directory, sizeof(term->current_directory), "%s", cwd);
+    term->last_active = time(NULL);
+    
+    term->prev_slot = tm->last_slot;
+    term->next_slot = -1;
+    if (tm->last_slot >= 0) {
+        tm->slots[tm->last_slot]->next_slot = slot;
+    } else {
+        tm->first_slot = slot;
+    }
+    tm->last_slot = slot;
+    tm->slots[slot] = term;
+    tm->terminal_count++;
+    return term;
+}
+
+/*
+ * Release a terminal and return its slot to the free list
+ * @param term: Terminal to destroy
+ */
+static void destroy_terminal(Terminal *term) {
+    TerminalManager *tm = &terminal_manager;
+    int slot = term->id & TERMINAL_SLOT_MASK;
+    
+    release_command_process(term);
+    free_command_queue(&term->cmd_queue);
+    free_history_buffer(&term->history);
+    free_input_state(&term->input);
+    
+    if (term->prev_slot >= 0) tm->slots[term->prev_slot]->next_slot = term->next_slot;
+    else tm->first_slot = term->next_slot;
+    if (term->next_slot >= 0) tm->slots[term->next_slot]->prev_slot = term->prev_slot;
+    else tm->last_slot = term->prev_slot;
+    
+    tm->slots[slot] = NULL;
+    tm->generations[slot]++;
+    tm->free_slots[tm->free_count++] = slot;
+    tm->terminal_count--;
+    free(term);
+}
+
+/*
+ * Bring a hibernated terminal's scrollback back into memory
+ * @param term: Terminal about to be shown
+ */
+static void wake_terminal(Terminal *term) {
+    wake_history_buffer(&term->history);
+    term->last_active = time(NULL);
+}
+
+/*
+ * Initialize terminal manager and first terminal
+ */
+void init_terminal_manager(void) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) strcpy(cwd, "/");
+    
+    terminal_manager.first_slot = -1;
+    terminal_manager.last_slot = -1;
+    
+    Terminal *term = add_terminal(cwd);
+    if (!term) {
+        fprintf(stderr, "Critical error: Failed to allocate memory for terminals\n");
+        exit(1);
+    }
+    terminal_manager.active_terminal = term->id;
+}
+
+/*
+ * Release every terminal and the slot map
+ */
+void free_terminal_manager(void) {
+    while (terminal_manager.first_slot >= 0) {
+        destroy_terminal(terminal_manager.slots[terminal_manager.first_slot]);
+    }
+    free(terminal_manager.slots);
+    free(terminal_manager.generations);
+    free(terminal_manager.free_slots);
+    memset(&terminal_manager, 0, sizeof(terminal_manager));
+}
+
+/*
+ * Look up a terminal by its stable ID
+ * @param terminal_id: ID to look up
+ * @return: Terminal, or NULL if it was closed or never existed
+ */
+Terminal* find_terminal(int terminal_id) {
+    if (terminal_id < 0) return NULL;
+    
+    int slot = terminal_id & TERMINAL_SLOT_MASK;
+    if (slot >= terminal_manager.slot_capacity) return NULL;
+    
+    Terminal *term = terminal_manager.slots[slot];
+    return term && term->id == terminal_id ? term : NULL;
+}
+
+/*
+ * Get pointer to currently active terminal
+ * @return: Pointer to active Terminal
+ */
+Terminal* get_active_terminal(void) {
+    return find_terminal(terminal_manager.active_terminal);
+}
+
+/*
+ * Get the first terminal in tab order
+ * @return: Terminal, or NULL if there is none
+ */
+Terminal* get_first_terminal(void) {
+    int slot = terminal_manager.first_slot;
+    return slot >= 0 ? terminal_manager.slots[slot] : NULL;
+}
+
+/*
+ * Get the terminal after term in tab order
+ * @param term: Current terminal
+ * @return: Next terminal, or NULL after the last one
+ */
+Terminal* get_next_terminal(Terminal *term) {
+    return term->next_slot >= 0 ? terminal_manager.slots[term->next_slot] : NULL;
+}
+
+/*
+ * Create new terminal tab
+ */
+void create_new_terminal(void) {
+    Terminal* new_term = add_terminal(get_active_terminal()->current_directory);
+    if (!new_term) return;
+    
+    show_welcome_message(&new_term->history);
+    chdir(new_term->current_directory);
+}
+
+/*
+ * Create split terminal in specified direction
+ * @param split_direction: SPLIT_HORIZONTAL or SPLIT_VERTICAL
+ */
+void create_split_terminal(int split_direction) {
+    Terminal* active = get_active_terminal();
+    Terminal* new_term = add_terminal(active->current_directory);
+    if (!new_term) return;
+    
+    new_term->split_with = active->id;
+    new_term->split_direction = split_direction;
+    active->split_with = new_term->id;
+    active->split_direction = split_direction;
+    
+    show_welcome_message(&new_term->history);
+    switch_terminal(new_term->id);
+}
+
+/*
+ * Switch to specified terminal by ID
+ * @param terminal_id: ID of terminal to switch to
+ */
+void switch_terminal(int terminal_id) {
+    if (find_terminal(terminal_id)) {
+        Terminal* current = get_active_terminal();
+        getcwd(current->current_directory, sizeof(current->current_directory));
+        current->last_active = time(NULL);
+        
+        terminal_manager.active_terminal = terminal_id;
+        
+        Terminal* new_active = get_active_terminal();
+        wake_terminal(new_active);
+        chdir(new_active->current_directory);
+    }
+}
+
+/*
+ * Switch to next terminal in sequence
+ */
+void next_terminal(void) {
+    int slot = get_active_terminal()->next_slot;
+    if (slot < 0) slot = terminal_manager.first_slot;
+    switch_terminal(terminal_manager.slots[slot]->id);
+}
+
+/*
+ * Switch to previous terminal in sequence
+ */
+void prev_terminal(void) {
+    int slot = get_active_terminal()->prev_slot;
+    if (slot < 0) slot = terminal_manager.last_slot;
+    switch_terminal(terminal_manager.slots[slot]->id);
+}
+
+/*
+ * Close currently active terminal
+ */
+void close_current_terminal(void) {
+    if (terminal_manager.terminal_count <= 1) return;
+    
+    Terminal* active = get_active_terminal();
+    
+    if (active->cmd_state == CMD_STATE_RUNNING) {
+        stop_current_command(active);
+    }
+    
+    /* The partner's split_with would miss anyway, clear it so the pane is whole again */
+    Terminal* partner = find_terminal(active->split_with);
+    if (partner) {
+        partner->split_with = -1;
+    }
+    
+    /* Focus moves to the following tab, or the previous one after the last */
+    int slot = active->next_slot >= 0 ? active->next_slot : active->prev_slot;
+    terminal_manager.active_terminal = terminal_manager.slots[slot]->id;
+    wake_terminal(terminal_manager.slots[slot]);
+    
+    destroy_terminal(active);
+}
+
+/*
+ * Spill the scrollback and drop the caches of background terminals that
+ * have had no command activity for TERMINAL_IDLE_SECONDS. Checks at most
+ * once per second.
+ */
+void hibernate_idle_terminals(void) {
+    static time_t last_check = 0;
+    time_t now = time(NULL);
+    if (now == last_check) return;
+    last_check = now;
+    
+    Terminal *active = get_active_terminal();
+    for (Terminal *term = get_first_terminal(); term; term = get_next_terminal(term)) {
+        if (term == active || term->history.spill) continue;
+        if (term->cmd_state != CMD_STATE_READY || term->current_process > 0 ||
+            !is_queue_empty(&term->cmd_queue)) continue;
+        if (now - term->last_active < TERMINAL_IDLE_SECONDS) continue;
+        
+        hibernate_history_buffer(&term->history);
+        if (!term->input.search_active) shrink_gap_buffer(&term->input.buffer);
+        free(term->partial_line);
+        term->partial_line = NULL;
+        term->partial_len = 0;
+        /* Scrollbacks too small to spill are looked at again after another idle period */
+        term->last_active = now;
+    }
+}
+
+/*
+ * Display welcome message with logo and help
+ * @param history: History buffer to add message to
+ */
+void show_welcome_message(HistoryBuffer *history) {
+    char version_msg[128];
+    snprintf(version_msg, sizeof(version_msg), 
+             "Welcome to Parrot Terminal Version %s", 
+             PARROT_VERSION
+            );
+    add_history_line(history, version_msg, HISTORY_TYPE_RAW);
+    add_history_line(history, "==========================================", HISTORY_TYPE_RAW);
+    add_history_line(history, "Type 'exit' to quit", HISTORY_TYPE_RAW);
+    add_history_line(history, "Shift+T: New terminal, Shift+W: Close terminal", HISTORY_TYPE_RAW);
+    add_history_line(history, "Alt+1-9: Switch terminals, Alt+/-: Next/Prev terminal", HISTORY_TYPE_RAW);
+    add_history_line(history, "Alt+Arrows: Switch between split panes", HISTORY_TYPE_RAW);
+    add_history_line(history, "Arrows: Scroll terminal history", HISTORY_TYPE_RAW);
+    add_history_line(history, "Shift+Up/Down: Command history, Ctrl+R: Search history", HISTORY_TYPE_RAW);
+    add_history_line(history, "", HISTORY_TYPE_RAW);
+}
+
+/*
+ * Switch to specific terminal by its tab position
+ * @param terminal_index: Position in tab order, starting at 0
+ */
+void switch_to_terminal(int terminal_index) {
+    Terminal *term = get_first_terminal();
+    for (int i = 0; term && i < terminal_index; i++) {
+        term = get_next_terminal(term);
+    }
+    if (term) {
+        switch_terminal(term->id);
+    }
+}
+
+/*
+ * Split terminal horizontally
+ */
+void split_terminal_horizontal(void) {
+    create_split_terminal(SPLIT_HORIZONTAL);
+}
+
+/*
+ * Split terminal vertically
+ */
+void split_terminal_vertical(void) {
+    create_split_terminal(SPLIT_VERTICAL);
+}
+
+/*
+ * Switch between split panes
+ * @param direction: Direction to switch (unused in current implementation)
+ */
+void switch_split_pane(int direction) {
+    Terminal* active = get_active_terminal();
+    if (active->split_with != -1) {
+        switch_terminal(active->split_with);
+    }
+}
@@ -0,0 +1,443 @@
+#ifndef PARROT_H
+#define PARROT_H
+
+/*
+ * Engine of Parrot Terminal: terminals, history buffers, the command
+ * queue and scheduler, output ingestion and search. Built as libparrot.a
+ * without curses; the interface in terminal.h is one client of it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <time.h>
+#include <pwd.h>
+#include <sys/types.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+/* Version and configuration constants */
+#define PARROT_VERSION "v6.0.0"
+#define MAX_CMD_INPUT 512
+#define MAX_HISTORY 512
+#define MAX_CMD_HISTORY 256
+#define MAX_LINE_LENGTH 512
+#define COMMAND_QUEUE_SIZE 10
+#define MAX_SEARCH_QUERY 64
+
+/*
+ * Terminal IDs pack a slot index in the low bits and the slot's
+ * generation above it, so an ID stays unique after its slot is reused
+ */
+#define TERMINAL_SLOT_BITS 20
+#define TERMINAL_SLOT_MASK ((1 << TERMINAL_SLOT_BITS) - 1)
+#define TERMINAL_GENERATION_MASK 0x7FF
+
+/* Split modes for terminal division */
+#define SPLIT_HORIZONTAL 0
+#define SPLIT_VERTICAL 1
+
+/* Formats written by an echoing history buffer */
+#define ECHO_TEXT 0
+#define ECHO_EVENTS 1
+
+/* Clients the control socket serves at once */
+#define CONTROL_MAX_CLIENTS 16
+
+/* Room for one JSON event or response before it is written in pieces */
+#define JSON_BUFFER_SIZE 8192
+
+/* Streams of command output */
+#define OUTPUT_STDOUT 0
+#define OUTPUT_STDERR 1
+#define OUTPUT_PARROT 2
+
+/* Classes of words in command output, as told by classify_output_token() */
+#define TOKEN_TEXT 0
+#define TOKEN_ERROR 1
+#define TOKEN_DIRECTORY 2
+#define TOKEN_FILE 3
+#define TOKEN_MISSING_PATH 4
+
+/* History line types */
+#define HISTORY_TYPE_NORMAL 0
+#define HISTORY_TYPE_COMMAND 1  
+#define HISTORY_TYPE_RAW 2
+
+/* Split position constants */
+#define MAX_SPLIT_PANES 4
+#define SPLIT_TOP 2
+#define SPLIT_BOTTOM 3
+
+/* Command execution states */
+#define CMD_STATE_READY 0
+#define CMD_STATE_RUNNING 1
+#define CMD_STATE_QUEUED 2
+
+/* Queue state indicators */
+#define QUEUE_NORMAL 0
+#define QUEUE_FULL 1
+
+/* Forward declarations */
+typedef struct HistoryBuffer HistoryBuffer;
+typedef struct InputState InputState;
+typedef struct Terminal Terminal;
+typedef struct TerminalManager TerminalManager;
+typedef struct CommandQueue CommandQueue;
+typedef struct PendingSpawn PendingSpawn;
+typedef struct SuggestNode SuggestNode;
+typedef struct GapBuffer GapBuffer;
+typedef struct HistorySpill HistorySpill;
+
+/*
+ * Command queue structure for managing command execution order
+ */
+struct CommandQueue {
+    char *commands[COMMAND_QUEUE_SIZE];
+    int count;
+    int head;
+    int tail;
+    int state;
+};
+
+/*
+ * Child forked ahead of time for the next queued command.
+ * It blocks on gate_fd and only execs once its predecessor has exited.
+ */
+struct PendingSpawn {
+    pid_t pid;
+    int gate_fd;
+    int output_fd;
+    int error_fd;
+    char *command;
+};
+
+/*
+ * History buffer structure for storing terminal output.
+ * The arrays are allocated by the first line. While spill is set the
+ * buffer is hibernated: its lines live only in the process's spill
+ * file and the arrays are freed.
+ * While echo is set lines are written to that stream instead of kept,
+ * as text or as JSON events about command echo_command.
+ */
+struct HistoryBuffer {
+    char **lines;
+    int *line_types;
+    time_t *timestamps;
+    int count;
+    int capacity;
+    int scroll_offset;
+    HistorySpill *spill;
+    FILE *echo;
+    int echo_format;
+    int echo_timestamps;
+    unsigned int echo_command;
+};
+
+/*
+ * Gap buffer holding the input text. The text is data[0, gap_start)
+ * followed by data[gap_end, capacity), and the gap sits at the cursor,
+ * so typing only writes into the gap. text caches a contiguous copy.
+ */
+struct GapBuffer {
+    char *data;
+    int capacity;
+    int gap_start;
+    int gap_end;
+    char *text;
+    int text_capacity;
+    int text_valid;
+};
+
+/*
+ * Input state structure for managing user input.
+ * cursor_pos and input_len mirror the buffer and are updated by the
+ * editing functions; they must not be written directly.
+ */
+struct InputState {
+    GapBuffer buffer;
+    int cursor_pos;
+    int input_len;
+    int display_start;
+    char **cmd_history;
+    int cmd_history_head;
+    int cmd_history_count;
+    int cmd_history_pos;
+    int is_locked;
+    int search_active;
+    char search_query[MAX_SEARCH_QUERY];
+    int search_len;
+    int search_choice;
+    int search_failed;
+    char *search_saved;
+    SuggestNode *suggest_node;
+    int suggest_edge_pos;
+    unsigned int suggest_generation;
+    const char *suggestion;
+};
+
+/*
+ * Terminal structure representing individual terminal instance.
+ * prev_slot and next_slot link the terminals in tab order.
+ * partial_line is allocated when the first command output arrives.
+ * commands_finished counts completed commands, the last one having
+ * exited with exit_status. error_fd is only open when the terminal
+ * echoes events, which keep stderr apart from stdout.
+ */
+struct Terminal {
+    HistoryBuffer history;
+    InputState input;
+    int id;
+    int prev_slot;
+    int next_slot;
+    int split_with;
+    int split_direction;
+    char current_directory[PATH_MAX];
+    int pane_x, pane_y;
+    int pane_width, pane_height;
+    CommandQueue cmd_queue;
+    pid_t current_process;
+    int cmd_state;
+    int output_fd;
+    char *partial_line;
+    int partial_len;
+    int error_fd;
+    char *error_line;
+    int error_len;
+    PendingSpawn prespawn;
+    time_t last_active;
+    int exit_status;
+    unsigned int commands_finished;
+    struct timespec command_started;
+};
+
+/*
+ * Terminal manager structure for handling multiple terminals.
+ * Terminals live in a slot map: slots[i] is NULL for a free slot, and
+ * generations[i] is bumped whenever slot i is freed so stale IDs miss.
+ * Terminals are allocated one by one and never move.
+ */
+struct TerminalManager {
+    Terminal **slots;
+    unsigned int *generations;
+    int *free_slots;
+    int free_count;
+    int slot_capacity;
+    int first_slot;
+    int last_slot;
+    int terminal_count;
+    int active_terminal;
+    int split_layout;
+};
+
+/*
+ * JSON text being built; longer text is written out in several pieces
+ */
+typedef struct {
+    FILE *out;
+    size_t len;
+    char data[JSON_BUFFER_SIZE];
+} JsonWriter;
+
+/* Global state variables */
+extern int line_break_enabled;
+extern int headless_mode;
+extern TerminalManager terminal_manager;
+
+/*
+ * Runs a command that takes over the terminal, such as an editor.
+ * Left NULL, such commands run like any other.
+ */
+extern void (*interactive_command_handler)(Terminal *term, const char *cmd);
+
+/* Function declarations */
+
+/* History buffer management */
+void init_history_buffer(HistoryBuffer *buf);
+void add_history_line(HistoryBuffer *buf, const char *text, int line_type);
+void free_history_buffer(HistoryBuffer *buf);
+void scroll_terminal_up(HistoryBuffer *history);
+void scroll_terminal_down(HistoryBuffer *history);
+void hibernate_history_buffer(HistoryBuffer *buf);
+void wake_history_buffer(HistoryBuffer *buf);
+
+/* Input handling */
+void init_input_state(InputState *input);
+void add_to_cmd_history(InputState *input, const char *cmd, const char *cwd);
+const char* get_cmd_history(InputState *input, int index);
+int in_cmd_history(InputState *input, const char *cmd);
+int recall_cmd_history(InputState *input, int steps_back);
+void free_input_state(InputState *input);
+
+/* Input line editing */
+void init_gap_buffer(GapBuffer *gb);
+void free_gap_buffer(GapBuffer *gb);
+void shrink_gap_buffer(GapBuffer *gb);
+const char* get_input_text(InputState *input);
+char input_char_at(InputState *input, int pos);
+void insert_input_text(InputState *input, const char *text, int len);
+void delete_input_text(InputState *input, int from, int to);
+void move_input_cursor(InputState *input, int pos);
+void set_input_text(InputState *input, const char *text);
+void clear_input(InputState *input);
+int find_word_start(InputState *input, int pos);
+int find_word_end(InputState *input, int pos);
+int find_line_start(InputState *input, int pos);
+int find_line_end(InputState *input, int pos);
+int input_prev_char(InputState *input, int pos);
+int input_next_char(InputState *input, int pos);
+void kill_input_text(InputState *input, int from, int to);
+void yank_input_text(InputState *input);
+void free_kill_buffer(void);
+
+/* UTF-8 text */
+int codepoint_width(uint32_t cp);
+int utf8_is_ascii(const char *s, int len);
+int utf8_decode(const char *s, int len, uint32_t *cp);
+int utf8_width(const char *s, int len);
+int utf8_fit(const char *s, int len, int columns, int *used);
+
+/* Tab completion */
+void complete_input(InputState *input, HistoryBuffer *history);
+void free_completion_cache(void);
+
+/* Inline autosuggestions */
+void record_suggestion(const char *cmd, const char *cwd);
+void refresh_suggestion(InputState *input);
+void extend_suggestion(InputState *input, char c);
+const char* get_suggestion_tail(InputState *input);
+int suggestion_seed_pending(void);
+void continue_suggestion_seed(void);
+void free_suggestions(void);
+
+/* Frecency ranked directory jumping */
+void record_directory_visit(const char *path);
+int find_frecent_directory(const char *pattern, char *out, size_t out_size);
+void list_frecent_directories(HistoryBuffer *history, int limit);
+void free_frecency_store(void);
+
+/* Persistent command history */
+void history_store_append(const char *cmd);
+int history_store_entry(int index, char *out, size_t out_size);
+int history_store_record(int index, const char **text, size_t *length);
+int history_store_count(void);
+int history_store_refresh(void);
+const char *history_store_recent(int index);
+void close_history_store(void);
+
+/* Reverse incremental history search */
+void start_history_search(InputState *input);
+void update_history_search(InputState *input);
+void next_history_search_match(InputState *input);
+int history_search_pending(void);
+void continue_history_search(InputState *input);
+void end_history_search(InputState *input, int accept);
+void free_history_search(void);
+
+/* Terminal management */
+void init_terminal_manager(void);
+void free_terminal_manager(void);
+Terminal* add_terminal(const char *cwd);
+Terminal* get_active_terminal(void);
+Terminal* find_terminal(int terminal_id);
+Terminal* get_first_terminal(void);
+Terminal* get_next_terminal(Terminal *term);
+void create_new_terminal(void);
+void create_split_terminal(int split_direction);
+void switch_terminal(int terminal_id);
+void next_terminal(void);
+void prev_terminal(void);
+void close_current_terminal(void);
+void hibernate_idle_terminals(void);
+void switch_to_terminal(int terminal_index);
+void split_terminal_horizontal(void);
+void split_terminal_vertical(void);
+void switch_split_pane(int direction);
+
+/* Messages shown in new terminals */
+void show_welcome_message(HistoryBuffer *history);
+
+/* Command execution */
+void execute_command(Terminal *term, const char *cmd);
+void stop_current_command(Terminal *term);
+int is_command_running(void);
+void add_command_to_queue(Terminal *term, const char *cmd);
+int is_builtin_command(const char *cmd);
+int is_interactive_command(const char *cmd);
+void process_command_queue(void);
+void init_command_process(Terminal *term);
+void release_command_process(Terminal *term);
+int wait_for_command_activity(int timeout_ms);
+void pump_command_output(void);
+void prespawn_next_command(Terminal *term);
+void cancel_prespawned_command(Terminal *term);
+
+/* Command queue management */
+void init_command_queue(CommandQueue *queue);
+int is_queue_full(CommandQueue *queue);
+int is_queue_empty(CommandQueue *queue);
+int add_to_queue(CommandQueue *queue, const char *cmd);
+char* get_from_queue(CommandQueue *queue);
+void free_command_queue(CommandQueue *queue);
+void update_queue_state(CommandQueue *queue);
+
+/* Text cleanup and classification */
+void shorten_path(char *path, char *output, size_t output_size);
+int is_existing_file(const char *path);
+int classify_output_token(const char *token);
+void strip_escape_codes(char* str);
+
+/* Session snapshots */
+int snapshot_default_path(char *path, size_t size);
+int save_snapshot(const char *path, char *message, size_t message_size);
+int restore_snapshot(const char *path, char *message, size_t message_size);
+int is_snapshot_memory(const char *p);
+void free_snapshot(void);
+
+/* JSON output, built on the stack and written with a single fwrite */
+void json_begin(JsonWriter *w, FILE *out);
+void json_flush(JsonWriter *w);
+void json_raw(JsonWriter *w, const char *s, size_t n);
+void json_text(JsonWriter *w, const char *s);
+void json_uint(JsonWriter *w, unsigned long long value);
+void json_int(JsonWriter *w, long long value);
+void json_seconds(JsonWriter *w, long long seconds, long micros);
+void json_string(JsonWriter *w, const char *s);
+
+/* JSON-lines command events */
+void write_command_start_event(Terminal *term, const char *cmd);
+void write_output_event(HistoryBuffer *history, int stream, const char *text);
+void write_command_end_event(Terminal *term, int status, const struct rusage *usage);
+
+/* Recording and replay of input and command output */
+int open_recording(const char *path);
+int open_replay(const char *path, int fast);
+int replaying_session(void);
+int replay_next_key(int *key);
+void set_replay_paste(int active);
+void record_input_key(int key);
+void flush_recording(void);
+void stop_replay(const char *message);
+void record_command_output(Terminal *term, int stream, const char *data, size_t len);
+void record_command_exit(Terminal *term, int status);
+void replay_command_output(Terminal *term, int stream, const char *data, size_t len);
+void replay_command_exit(Terminal *term, int status);
+void continue_replay(void);
+int replay_poll_timeout(int timeout_ms);
+void close_recording(void);
+
+/* Control socket for automation, and the sockets of detachable sessions */
+struct pollfd;
+int session_socket_path(const char *name, char *path, size_t size);
+int listen_session(const char *path);
+void init_control_socket(void);
+int add_control_poll_fds(struct pollfd *fds);
+void process_control_requests(void);
+void close_control_socket(void);
+
+#endif
@@ -0,0 +1,93 @@
+#include "parrot.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Initialize command queue structure
+ * @param queue: Pointer to CommandQueue to initialize
+ */
+void init_command_queue(CommandQueue *queue) {
+    queue->count = 0;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->state = QUEUE_NORMAL;
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+        queue->commands[i] = NULL;
+    }
+}
+
+/*
+ * Free commands still waiting in a queue
+ * @param queue: Pointer to CommandQueue to empty
+ */
+void free_command_queue(CommandQueue *queue) {
+    char *cmd;
+    while ((cmd = get_from_queue(queue)) != NULL) {
+        free(cmd);
+    }
+}
+
+/*
+ * Update queue state based on current count
+ * @param queue: Pointer to CommandQueue to update
+ */
+void update_queue_state(CommandQueue *queue) {
+    queue->state = (queue->count >= COMMAND_QUEUE_SIZE) ? 
+                   QUEUE_FULL : QUEUE_NORMAL;
+}
+
+/*
+ * Check if command queue is full
+ * @param queue: Pointer to CommandQueue to check
+ * @return: 1 if full, 0 otherwise
+ */
+int is_queue_full(CommandQueue *queue) {
+    return queue->count >= COMMAND_QUEUE_SIZE;
+}
+
+/*
+ * Check if command queue is empty
+ * @param queue: Pointer to CommandQueue to check
+ * @return: 1 if empty, 0 otherwise
+ */
+int is_queue_empty(CommandQueue *queue) {
+    return queue->count == 0;
+}
+
+/*
+ * Add command to queue
+ * @param queue: Pointer to CommandQueue
+ * @param cmd: Command string to add
+ * @return: 1 on success, 0 on failure (queue full)
+ */
+int add_to_queue(CommandQueue *queue, const char *cmd) {
+    if (is_queue_full(queue)) {
+        queue->state = QUEUE_FULL;
+        return 0;
+    }
+    
+    queue->commands[queue->tail] = strdup(cmd);
+    if (!queue->commands[queue->tail]) return 0;
+    queue->tail = (queue->tail + 1) % COMMAND_QUEUE_SIZE;
+    queue->count++;
+    update_queue_state(queue);
+    return 1;
+}
+
+/*
+ * Get next command from queue
+ * @param queue: Pointer to CommandQueue
+ * @return: Command string owned by the caller, or NULL if queue empty
+ */
+char* get_from_queue(CommandQueue *queue) {
+    if (is_queue_empty(queue)) {
+        return NULL;
+    }
+    
+    char *cmd = queue->commands[queue->head];
+    queue->commands[queue->head] = NULL;
+    queue->head = (queue->head + 1) % COMMAND_QUEUE_SIZE;
+    queue->count--;
+    update_queue_state(queue);
+    return cmd;
+}
@@ -0,0 +1,363 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#define RECORDING_MAGIC "PARROTRC"
+#define RECORDING_VERSION 1
+
+/* Written in native order; a reader on another byte order rejects the file */
+#define RECORDING_BYTE_ORDER 0x01020304u
+
+/* Keys recorded this close together are replayed in the same batch, as the
+ * terminal would have delivered them in a single read */
+#define REPLAY_KEY_SLACK_US 10000
+
+/* Record types */
+#define RECORD_KEY 0
+#define RECORD_OUTPUT 1
+#define RECORD_EXIT 2
+
+/* File header */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+} RecordingHeader;
+
+/*
+ * Header of one record; the payload follows it. Keys carry their int
+ * key code, output the bytes read from the child and exits the wait status.
+ */
+typedef struct {
+    uint64_t time_us;
+    int32_t terminal;
+    uint32_t length;
+    uint8_t type;
+    uint8_t stream;
+    uint16_t reserved;
+    uint32_t reserved2;
+} RecordHeader;
+
+static FILE *record_file = NULL;
+static FILE *replay_file = NULL;
+static int replay_fast = 0;
+static int replay_used = 0;
+static struct timespec session_start;
+
+/* Next record of the replay, read ahead so its time can be checked */
+static RecordHeader pending;
+static char *pending_data = NULL;
+static uint32_t pending_capacity = 0;
+static int have_pending = 0;
+
+/* Set while a bracketed paste is read, whose keys are taken without waiting */
+static int replay_in_paste = 0;
+
+static unsigned long replayed_keys = 0;
+static unsigned long long replayed_bytes = 0;
+static unsigned long replay_skipped = 0;
+static double replay_seconds = 0;
+
+/*
+ * Microseconds since recording or replay started
+ * @return: Elapsed time
+ */
+static uint64_t session_elapsed_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - session_start.tv_sec) * 1000000ULL +
+           (now.tv_nsec - session_start.tv_nsec) / 1000;
+}
+
+/*
+ * Append one record to the recording
+ * @param type: RECORD_KEY, RECORD_OUTPUT or RECORD_EXIT
+ * @param terminal: Terminal ID, 0 for keys
+ * @param stream: Output stream, 0 for other records
+ * @param data: Payload
+ * @param length: Payload size in bytes
+ */
+static void write_record(int type, int terminal, int stream, const void *data, size_t length) {
+    RecordHeader header;
+
+    memset(&header, 0, sizeof(header));
+    header.time_us = session_elapsed_us();
+    header.terminal = terminal;
+    header.length = length;
+    header.type = type;
+    header.stream = stream;
+    fwrite(&header, sizeof(header), 1, record_file);
+    fwrite(data, 1, length, record_file);
+}
+
+/*
+ * Start recording keys and command output to a file
+ * @param path: File to create
+ * @return: 1 on success, 0 with a message on stderr on failure
+ */
+int open_recording(const char *path) {
+    RecordingHeader header;
+
+    record_file = fopen(path, "wb");
+    if (!record_file) {
+        fprintf(stderr, "--record: %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION;
+    header.byte_order = RECORDING_BYTE_ORDER;
+    fwrite(&header, sizeof(header), 1, record_file);
+    clock_gettime(CLOCK_MONOTONIC, &session_start);
+    return 1;
+}
+
+/*
+ * Stop replaying. Commands whose exit was not recorded are finished so
+ * their terminals accept new ones.
+ * @param message: Note for the active terminal
+ */
+void stop_replay(const char *message) {
+    if (!replay_file) return;
+
+    fclose(replay_file);
+    replay_file = NULL;
+    have_pending = 0;
+    replay_seconds = session_elapsed_us() / 1e6;
+
+    for (Terminal *term = get_first_terminal(); term; term = get_next_terminal(term)) {
+        if (term->cmd_state == CMD_STATE_RUNNING && term->current_process == 0) {
+            replay_command_exit(term, 0);
+        }
+    }
+    add_history_line(&get_active_terminal()->history, message, HISTORY_TYPE_NORMAL);
+}
+
+/*
+ * Read the next record of the replay into pending, closing the replay at
+ * the end of the file
+ * @return: 1 if a record is pending, 0 when the replay is over
+ */
+static int read_next_record(void) {
+    have_pending = 0;
+    if (!replay_file) return 0;
+
+    if (fread(&pending, sizeof(pending), 1, replay_file) == 1) {
+        if (pending.length > pending_capacity) {
+            char *grown = realloc(pending_data, pending.length);
+            if (grown) {
+                pending_data = grown;
+                pending_capacity = pending.length;
+            }
+        }
+        if (pending.length <= pending_capacity &&
+            fread(pending_data, 1, pending.length, replay_file) == pending.length) {
+            have_pending = 1;
+            return 1;
+        }
+    }
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Replay finished: %lu keys, %llu bytes of output in %.3f s",
+             replayed_keys, replayed_bytes, session_elapsed_us() / 1e6);
+    stop_replay(msg);
+    return 0;
+}
+
+/*
+ * Start replaying a recording. Commands are not run while it lasts; their
+ * recorded output and exit status are fed to the terminals instead.
+ * @param path: Recording to read
+ * @param fast: Nonzero to replay at maximum speed instead of original timing
+ * @return: 1 on success, 0 with a message on stderr on failure
+ */
+int open_replay(const char *path, int fast) {
+    RecordingHeader header;
+
+    replay_file = fopen(path, "rb");
+    if (!replay_file) {
+        fprintf(stderr, "--replay: %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    if (fread(&header, sizeof(header), 1, replay_file) != 1 ||
+        memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != RECORDING_VERSION || header.byte_order != RECORDING_BYTE_ORDER) {
+        fprintf(stderr, "--replay: %s: not a recording from this build\n", path);
+        fclose(replay_file);
+        replay_file = NULL;
+        return 0;
+    }
+    replay_fast = fast;
+    replay_used = 1;
+    clock_gettime(CLOCK_MONOTONIC, &session_start);
+    return 1;
+}
+
+/*
+ * Check whether commands are being replayed instead of run
+ * @return: 1 while a replay is in progress
+ */
+int replaying_session(void) {
+    return replay_file != NULL;
+}
+
+/*
+ * Check whether the pending record is due
+ * @param slack_us: Extra time allowed before the record's timestamp
+ * @return: 1 if the record should be applied now
+ */
+static int pending_record_due(uint64_t slack_us) {
+    return replay_fast || pending.time_us <= session_elapsed_us() + slack_us;
+}
+
+/*
+ * Mark whether a bracketed paste is being read. The reader gives up after
+ * a pause, so the keys of a paste are replayed as soon as they are asked
+ * for rather than at their recorded times.
+ * @param active: 1 when the paste starts, 0 when it ends
+ */
+void set_replay_paste(int active) {
+    replay_in_paste = active;
+}
+
+/*
+ * Apply the output and exit records recorded between two keys of a
+ * paste, waiting for each one to be due
+ */
+static void replay_until_key(void) {
+    while (replay_file && (have_pending || read_next_record()) && pending.type != RECORD_KEY) {
+        uint64_t now = session_elapsed_us();
+        if (!replay_fast && pending.time_us > now) {
+            uint64_t wait_us = pending.time_us - now;
+            struct timespec delay = { wait_us / 1000000, (wait_us % 1000000) * 1000 };
+            nanosleep(&delay, NULL);
+        }
+        continue_replay();
+        
+        // A record waiting for its command to be dispatched cannot be passed
+        if (have_pending && pending.type != RECORD_KEY) return;
+    }
+}
+
+/*
+ * Take the next recorded key if it is due. During a paste the next key is
+ * taken regardless of its time.
+ * @param key: Receives the key code
+ * @return: 1 if a key was taken, 0 if none is due or no replay is running
+ */
+int replay_next_key(int *key) {
+    if (!replay_file || (!have_pending && !read_next_record())) return 0;
+    if (replay_in_paste) replay_until_key();
+    if (!have_pending || pending.type != RECORD_KEY) return 0;
+    if (!replay_in_paste && !pending_record_due(REPLAY_KEY_SLACK_US)) return 0;
+
+    memcpy(key, pending_data, sizeof(*key));
+    replayed_keys++;
+    read_next_record();
+    return 1;
+}
+
+/*
+ * Record a key read from the keyboard
+ * @param key: Key code
+ */
+void record_input_key(int key) {
+    if (record_file) write_record(RECORD_KEY, 0, 0, &key, sizeof(key));
+}
+
+/*
+ * Write out buffered records, called whenever the input has been drained
+ */
+void flush_recording(void) {
+    if (record_file) fflush(record_file);
+}
+
+/*
+ * Record output read from a child
+ * @param term: Terminal running the command
+ * @param stream: Stream the output came from
+ * @param data: Output bytes
+ * @param len: Number of bytes
+ */
+void record_command_output(Terminal *term, int stream, const char *data, size_t len) {
+    if (record_file) write_record(RECORD_OUTPUT, term->id, stream, data, len);
+}
+
+/*
+ * Record the exit of a command
+ * @param term: Terminal whose command finished
+ * @param status: Status from wait4
+ */
+void record_command_exit(Terminal *term, int status) {
+    if (record_file) write_record(RECORD_EXIT, term->id, 0, &status, sizeof(status));
+}
+
+/*
+ * Feed due output and exit records to their terminals. A record waits for
+ * its terminal's command to be dispatched, and is dropped if the terminal
+ * is gone or has nothing left to run.
+ */
+void continue_replay(void) {
+    while (replay_file && (have_pending || read_next_record())) {
+        if (pending.type == RECORD_KEY || !pending_record_due(0)) return;
+
+        Terminal *term = find_terminal(pending.terminal);
+        if (term && term->cmd_state == CMD_STATE_QUEUED) return;
+
+        if (!term || term->cmd_state != CMD_STATE_RUNNING) {
+            replay_skipped++;
+        } else if (pending.type == RECORD_OUTPUT) {
+            replay_command_output(term, pending.stream, pending_data, pending.length);
+            replayed_bytes += pending.length;
+        } else if (pending.type == RECORD_EXIT) {
+            int status;
+            memcpy(&status, pending_data, sizeof(status));
+            replay_command_exit(term, status);
+        }
+        read_next_record();
+    }
+}
+
+/*
+ * Shorten a poll timeout so the next replayed record is applied on time
+ * @param timeout_ms: Timeout wanted by the caller
+ * @return: Timeout to use
+ */
+int replay_poll_timeout(int timeout_ms) {
+    if (!replay_file) return timeout_ms;
+    if (!have_pending && !read_next_record()) return timeout_ms;
+    if (pending_record_due(0)) return 0;
+
+    uint64_t wait_ms = (pending.time_us - session_elapsed_us() + 999) / 1000;
+    return wait_ms < (uint64_t)timeout_ms ? (int)wait_ms : timeout_ms;
+}
+
+/*
+ * Finish recording or replaying, printing a replay summary to stderr
+ */
+void close_recording(void) {
+    if (record_file) {
+        fclose(record_file);
+        record_file = NULL;
+    }
+    if (replay_file) {
+        fclose(replay_file);
+        replay_file = NULL;
+        replay_seconds = session_elapsed_us() / 1e6;
+    }
+    if (replay_used) {
+        fprintf(stderr, "Replayed %lu keys and %llu bytes of output in %.3f s",
+                replayed_keys, replayed_bytes, replay_seconds);
+        if (replay_skipped > 0) {
+            fprintf(stderr, " (%lu records skipped)", replay_skipped);
+        }
+        fprintf(stderr, "\n");
+    }
+    free(pending_data);
+    pending_data = NULL;
+    pending_capacity = 0;
+    have_pending = 0;
+}
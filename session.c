@@ -0,0 +1,455 @@
+#include "terminal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Frame types sent by the front end to the session server */
+#define SESSION_INPUT 1
+#define SESSION_RESIZE 2
+
+/* Frame header: type byte followed by a big-endian 16-bit payload length */
+#define SESSION_HEADER_SIZE 3
+
+#define SESSION_BUFFER_SIZE 4096
+
+/* Pty output held for a front end that is not reading. One that falls
+ * further behind is disconnected, and repaints when it attaches again. */
+#define SESSION_BACKLOG_SIZE (256 * 1024)
+
+/* Ctrl+\ in the front end detaches from the session */
+#define SESSION_DETACH_KEY 28
+
+/* Ctrl+L, injected so the session repaints for a newly attached front end */
+#define SESSION_REDRAW_KEY 12
+
+/*
+ * Terminal modes the session may have left on in the front end's
+ * terminal: bracketed paste, application cursor keys and keypad,
+ * alternate screen and hidden cursor
+ */
+#define SESSION_RESET_SEQUENCE "\033[?2004l\033[?1l\033>\033[?1049l\033[?25h"
+
+static volatile sig_atomic_t window_resized = 0;
+
+/*
+ * Write a whole buffer, retrying short writes
+ * @return: 0 on success, -1 on error
+ */
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        len -= written;
+    }
+    return 0;
+}
+
+/*
+ * Send one frame to the session server
+ * @return: 0 on success, -1 on error
+ */
+static int send_frame(int fd, int type, const char *payload, int len) {
+    char frame[SESSION_HEADER_SIZE + SESSION_BUFFER_SIZE];
+    frame[0] = type;
+    frame[1] = (len >> 8) & 0xFF;
+    frame[2] = len & 0xFF;
+    memcpy(frame + SESSION_HEADER_SIZE, payload, len);
+    return write_all(fd, frame, SESSION_HEADER_SIZE + len);
+}
+
+/*
+ * Send the front end's window size to the session server
+ * @return: 0 on success, -1 on error
+ */
+static int send_window_size(int fd) {
+    struct winsize size;
+    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &size) != 0) return 0;
+
+    char payload[4] = {
+        (size.ws_row >> 8) & 0xFF, size.ws_row & 0xFF,
+        (size.ws_col >> 8) & 0xFF, size.ws_col & 0xFF
+    };
+    return send_frame(fd, SESSION_RESIZE, payload, sizeof(payload));
+}
+
+/*
+ * Connect to a session socket
+ * @return: Connected descriptor, or -1 with errno set
+ */
+static int connect_session(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Start the interactive terminal on the slave side of a pty, as the
+ * leader of a new session so it survives the front end's terminal
+ * @param master: Pty master descriptor
+ * @param name: Session name, exported as PARROT_SESSION
+ * @return: Child pid, or -1 on error
+ */
+static pid_t spawn_session_terminal(int master, const char *name) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    setsid();
+    int slave = open(ptsname(master), O_RDWR);
+    if (slave < 0) _exit(1);
+    ioctl(slave, TIOCSCTTY, 0);
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    dup2(slave, STDERR_FILENO);
+    if (slave > STDERR_FILENO) close(slave);
+    close(master);
+
+    setenv("PARROT_SESSION", name, 1);
+    signal(SIGPIPE, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    _exit(run_interactive_mode(NULL));
+}
+
+/*
+ * Send as much queued output to the front end as it takes without blocking
+ * @param client: Non-blocking front end socket
+ * @param backlog: Queued output, shifted down by what was sent
+ * @param len: Queued bytes, updated
+ * @return: 0 on success, -1 if the front end is gone
+ */
+static int flush_client_output(int client, char *backlog, size_t *len) {
+    size_t sent = 0;
+    while (sent < *len) {
+        ssize_t written = write(client, backlog + sent, *len - sent);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        sent += written;
+    }
+    memmove(backlog, backlog + sent, *len - sent);
+    *len -= sent;
+    return 0;
+}
+
+/*
+ * Queue pty output for the front end and send what it takes
+ * @param client: Non-blocking front end socket
+ * @param backlog: Output queue of SESSION_BACKLOG_SIZE bytes
+ * @param len: Queued bytes, updated
+ * @param data: Output to add
+ * @param size: Bytes of output
+ * @return: 0 on success, -1 if the front end is gone or too far behind
+ */
+static int queue_client_output(int client, char *backlog, size_t *len,
+                               const char *data, size_t size) {
+    if (*len + size > SESSION_BACKLOG_SIZE) return -1;
+    memcpy(backlog + *len, data, size);
+    *len += size;
+    return flush_client_output(client, backlog, len);
+}
+
+/*
+ * Apply one frame received from the front end
+ * @param master: Pty master of the session terminal
+ * @param type: Frame type
+ * @param payload: Frame payload
+ * @param len: Payload length
+ * @param fresh: Set while the front end has not sent its size, cleared
+ *               once the terminal was asked to repaint for it
+ */
+static void apply_client_frame(int master, int type, const char *payload, int len, int *fresh) {
+    if (type == SESSION_INPUT) {
+        write_all(master, payload, len);
+    } else if (type == SESSION_RESIZE && len == 4) {
+        struct winsize size;
+        memset(&size, 0, sizeof(size));
+        size.ws_row = ((unsigned char)payload[0] << 8) | (unsigned char)payload[1];
+        size.ws_col = ((unsigned char)payload[2] << 8) | (unsigned char)payload[3];
+        ioctl(master, TIOCSWINSZ, &size);
+        if (*fresh) {
+            char redraw = SESSION_REDRAW_KEY;
+            write_all(master, &redraw, 1);
+            *fresh = 0;
+        }
+    }
+}
+
+/*
+ * Session server main loop. Pty output is relayed to the attached front
+ * end, or discarded while none is attached, so the terminal never blocks
+ * on a full pty. The front end socket is non-blocking: output it does not
+ * take is queued, and a front end that stalls past SESSION_BACKLOG_SIZE is
+ * dropped. A new front end replaces the previous one.
+ * @param listen_fd: Listening session socket
+ * @param master: Pty master of the session terminal
+ */
+static void serve_session(int listen_fd, int master) {
+    static char backlog[SESSION_BACKLOG_SIZE];
+    size_t backlog_len = 0;
+    char buffer[SESSION_BUFFER_SIZE];
+    char input[SESSION_HEADER_SIZE + SESSION_BUFFER_SIZE];
+    size_t input_len = 0;
+    int client = -1;
+    int fresh = 0;
+
+    for (;;) {
+        struct pollfd fds[3];
+        int nfds = 2;
+        fds[0].fd = master;
+        fds[0].events = POLLIN;
+        fds[1].fd = listen_fd;
+        fds[1].events = POLLIN;
+        if (client >= 0) {
+            fds[2].fd = client;
+            fds[2].events = backlog_len > 0 ? POLLIN | POLLOUT : POLLIN;
+            nfds = 3;
+        }
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+
+        if (fds[0].revents) {
+            ssize_t got = read(master, buffer, sizeof(buffer));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return; // Terminal exited
+            if (client >= 0 && queue_client_output(client, backlog, &backlog_len, buffer, got) != 0) {
+                close(client);
+                client = -1;
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0) {
+                if (client >= 0) close(client);
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                client = fd;
+                fresh = 1;
+                backlog_len = 0;
+                input_len = 0;
+                continue;
+            }
+        }
+
+        if (nfds != 3 || client < 0) continue;
+
+        if ((fds[2].revents & POLLOUT) && flush_client_output(client, backlog, &backlog_len) != 0) {
+            close(client);
+            client = -1;
+            continue;
+        }
+
+        if (fds[2].revents & ~POLLOUT) {
+            ssize_t got = read(client, input + input_len, sizeof(input) - input_len);
+            if (got < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+            if (got <= 0) {
+                close(client);
+                client = -1;
+                continue;
+            }
+            input_len += got;
+
+            /* Apply the complete frames, keeping a partial one for later */
+            size_t used = 0;
+            while (input_len - used >= SESSION_HEADER_SIZE) {
+                const char *frame = input + used;
+                int len = ((unsigned char)frame[1] << 8) | (unsigned char)frame[2];
+                if (len > SESSION_BUFFER_SIZE) {
+                    close(client);
+                    client = -1;
+                    break;
+                }
+                if (input_len - used < (size_t)(SESSION_HEADER_SIZE + len)) break;
+                apply_client_frame(master, frame[0], frame + SESSION_HEADER_SIZE, len, &fresh);
+                used += SESSION_HEADER_SIZE + len;
+            }
+            memmove(input, input + used, input_len - used);
+            input_len -= used;
+        }
+    }
+}
+
+/*
+ * Fork a detached session server owning a new pty and terminal
+ * @param listen_fd: Listening session socket, inherited by the server
+ * @param path: Socket path, removed when the session ends
+ * @param name: Session name
+ * @return: 0 on success, -1 on error
+ */
+static int start_session_server(int listen_fd, const char *path, const char *name) {
+    struct winsize size;
+    int have_size = ioctl(STDIN_FILENO, TIOCGWINSZ, &size) == 0;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid > 0) return 0;
+
+    setsid();
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGHUP, SIG_IGN);
+
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO) close(null_fd);
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        unlink(path);
+        _exit(1);
+    }
+    if (have_size) ioctl(master, TIOCSWINSZ, &size);
+
+    pid_t terminal = spawn_session_terminal(master, name);
+    if (terminal < 0) {
+        unlink(path);
+        _exit(1);
+    }
+
+    serve_session(listen_fd, master);
+
+    unlink(path);
+    close(listen_fd);
+    close(master);
+    waitpid(terminal, NULL, 0);
+    _exit(0);
+}
+
+/*
+ * Note that the front end's window changed size
+ */
+static void handle_window_resize(int sig) {
+    (void)sig;
+    window_resized = 1;
+}
+
+/*
+ * Attach the current terminal to a named session, starting the session
+ * server first if it is not running. Ctrl+\ detaches.
+ * @param name: Session name, NULL for "default"
+ * @return: Process exit status
+ */
+int attach_session(const char *name) {
+    char path[PATH_MAX];
+    if (!name) name = "default";
+
+    if (getenv("PARROT_SESSION")) {
+        fprintf(stderr, "Already inside session %s\n", getenv("PARROT_SESSION"));
+        return 1;
+    }
+    if (!isatty(STDIN_FILENO)) {
+        fprintf(stderr, "attach needs a terminal\n");
+        return 1;
+    }
+    if (session_socket_path(name, path, sizeof(path)) != 0) {
+        fprintf(stderr, "Cannot use session %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+
+    int fd = connect_session(path);
+    if (fd < 0) {
+        /* No server, or a stale socket left by one that died */
+        if (errno == ECONNREFUSED) unlink(path);
+        int listen_fd = listen_session(path);
+        if (listen_fd < 0 || start_session_server(listen_fd, path, name) != 0) {
+            fprintf(stderr, "Cannot start session %s: %s\n", name, strerror(errno));
+            return 1;
+        }
+        close(listen_fd);
+        fd = connect_session(path);
+        if (fd < 0) {
+            fprintf(stderr, "Cannot attach to session %s: %s\n", name, strerror(errno));
+            return 1;
+        }
+    }
+
+    struct termios saved, raw_mode;
+    tcgetattr(STDIN_FILENO, &saved);
+    raw_mode = saved;
+    cfmakeraw(&raw_mode);
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw_mode);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_window_resize;
+    sigaction(SIGWINCH, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    char buffer[SESSION_BUFFER_SIZE];
+    int detached = 0;
+    send_window_size(fd);
+
+    for (;;) {
+        if (window_resized) {
+            window_resized = 0;
+            if (send_window_size(fd) != 0) break;
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = STDIN_FILENO;
+        fds[0].events = POLLIN;
+        fds[1].fd = fd;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[1].revents) {
+            ssize_t got = read(fd, buffer, sizeof(buffer));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break; // Session ended
+            write_all(STDOUT_FILENO, buffer, got);
+        }
+
+        if (fds[0].revents) {
+            ssize_t got = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+
+            char *detach = memchr(buffer, SESSION_DETACH_KEY, got);
+            if (detach) {
+                got = detach - buffer;
+                detached = 1;
+            }
+            if (got > 0 && send_frame(fd, SESSION_INPUT, buffer, got) != 0) break;
+            if (detached) break;
+        }
+    }
+
+    close(fd);
+    write_all(STDOUT_FILENO, SESSION_RESET_SEQUENCE, strlen(SESSION_RESET_SEQUENCE));
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    printf(detached ? "[detached from session %s]\n" : "[session %s ended]\n", name);
+    return 0;
+}
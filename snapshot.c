@@ -0,0 +1,479 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#define SNAPSHOT_MAGIC "PARROTSS"
+#define SNAPSHOT_VERSION 1
+
+/* Written in native order; a reader on another byte order rejects the file */
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+/* Buffers gathered into each writev() call */
+#define SNAPSHOT_IOV_BATCH 512
+
+/*
+ * File header. The file is written in native byte order and type sizes,
+ * which the header records so a mismatching reader can refuse it.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint16_t int_size;
+    uint16_t time_size;
+    uint32_t terminal_count;
+    uint32_t active_index;
+    uint32_t reserved;
+    uint64_t file_size;
+} SnapshotHeader;
+
+/*
+ * Per-terminal record. It is followed by, in order:
+ * the working directory, line_types (int[line_count]),
+ * timestamps (time_t[line_count]), line lengths (uint32_t[line_count]),
+ * the lines, the command history, the queued commands and the input text.
+ * Every string is stored with its terminating NUL so restored scrollback
+ * can point straight into the mapped file.
+ */
+typedef struct {
+    int32_t split_with;
+    int32_t split_direction;
+    uint32_t cwd_len;
+    uint32_t line_count;
+    uint32_t cmd_history_count;
+    uint32_t queue_count;
+    uint32_t input_len;
+    uint32_t reserved;
+} SnapshotTerminal;
+
+/*
+ * Gathers buffers and writes them with as few writev() calls as possible
+ */
+typedef struct {
+    int fd;
+    struct iovec iov[SNAPSHOT_IOV_BATCH];
+    int count;
+    uint64_t total;
+    int failed;
+} SnapshotWriter;
+
+/*
+ * Bounds-checked reader over the mapped file
+ */
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t pos;
+} SnapshotReader;
+
+/* Mapping of the restored snapshot, kept for the scrollback pointing into it */
+static char *snapshot_map = NULL;
+static size_t snapshot_map_size = 0;
+
+/*
+ * Resolve the default snapshot path from PARROT_SNAPSHOT or HOME
+ * @param path: Buffer for the path
+ * @param size: Size of path buffer
+ * @return: 1 if a path is available, 0 otherwise
+ */
+int snapshot_default_path(char *path, size_t size) {
+    const char *file = getenv("PARROT_SNAPSHOT");
+    if (file && file[0]) {
+        snprintf(path, size, "%s", file);
+        return 1;
+    }
+
+    const char *home = getenv("HOME");
+    if (!home) return 0;
+    snprintf(path, size, "%s/.parrot_snapshot", home);
+    return 1;
+}
+
+/*
+ * Write all gathered buffers, resuming after short writes
+ * @param w: Writer to flush
+ */
+static void flush_writer(SnapshotWriter *w) {
+    struct iovec *iov = w->iov;
+    int count = w->count;
+
+    while (count > 0 && !w->failed) {
+        ssize_t written = writev(w->fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            w->failed = 1;
+            break;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    w->count = 0;
+}
+
+/*
+ * Queue a buffer for writing. The buffer must stay valid until the next flush.
+ * @param w: Writer
+ * @param data: Bytes to write
+ * @param len: Number of bytes
+ */
+static void add_buffer(SnapshotWriter *w, const void *data, size_t len) {
+    if (len == 0) return;
+    if (w->count == SNAPSHOT_IOV_BATCH) flush_writer(w);
+
+    w->iov[w->count].iov_base = (void *)data;
+    w->iov[w->count].iov_len = len;
+    w->count++;
+    w->total += len;
+}
+
+/*
+ * Queue one terminal. Everything is flushed before returning so the
+ * temporary arrays can be freed.
+ * @param w: Writer
+ * @param term: Terminal to write
+ * @param split_index: Tab position of the split partner, or -1
+ * @return: 1 on success, 0 on allocation failure
+ */
+static int write_terminal(SnapshotWriter *w, Terminal *term, int split_index) {
+    HistoryBuffer *history = &term->history;
+    InputState *input = &term->input;
+    CommandQueue *queue = &term->cmd_queue;
+
+    wake_history_buffer(history);
+
+    SnapshotTerminal record;
+    memset(&record, 0, sizeof(record));
+    record.split_with = split_index;
+    record.split_direction = term->split_direction;
+    record.cwd_len = strlen(term->current_directory);
+    record.line_count = history->count;
+    record.cmd_history_count = input->cmd_history_count;
+    record.queue_count = queue->count;
+    record.input_len = input->input_len;
+
+    uint32_t *lengths = malloc((history->count + 1) * sizeof(uint32_t));
+    if (!lengths) return 0;
+    for (int i = 0; i < history->count; i++) {
+        lengths[i] = strlen(history->lines[i]);
+    }
+
+    add_buffer(w, &record, sizeof(record));
+    add_buffer(w, term->current_directory, record.cwd_len + 1);
+    add_buffer(w, history->line_types, history->count * sizeof(int));
+    add_buffer(w, history->timestamps, history->count * sizeof(time_t));
+    add_buffer(w, lengths, history->count * sizeof(uint32_t));
+    for (int i = 0; i < history->count; i++) {
+        add_buffer(w, history->lines[i], lengths[i] + 1);
+    }
+    for (int i = 0; i < input->cmd_history_count; i++) {
+        const char *cmd = get_cmd_history(input, i);
+        add_buffer(w, cmd, strlen(cmd) + 1);
+    }
+    for (int i = 0; i < queue->count; i++) {
+        const char *cmd = queue->commands[(queue->head + i) % COMMAND_QUEUE_SIZE];
+        add_buffer(w, cmd, strlen(cmd) + 1);
+    }
+    add_buffer(w, get_input_text(input), record.input_len + 1);
+
+    flush_writer(w);
+    free(lengths);
+    return 1;
+}
+
+/*
+ * Save every terminal into a snapshot file. The file is written next to
+ * the target and renamed over it, so a mapped older snapshot stays intact.
+ * @param path: Snapshot path
+ * @param message: Receives a status line for the user
+ * @param message_size: Size of message
+ * @return: 1 on success, 0 on failure
+ */
+int save_snapshot(const char *path, char *message, size_t message_size) {
+    char tmp_path[PATH_MAX];
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid()) >= (int)sizeof(tmp_path)) {
+        snprintf(message, message_size, "snapshot: path too long");
+        return 0;
+    }
+
+    SnapshotWriter w;
+    memset(&w, 0, sizeof(w));
+    w.fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (w.fd < 0) {
+        snprintf(message, message_size, "snapshot: %s: %s", tmp_path, strerror(errno));
+        return 0;
+    }
+
+    Terminal *active = get_active_terminal();
+    getcwd(active->current_directory, sizeof(active->current_directory));
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.int_size = sizeof(int);
+    header.time_size = sizeof(time_t);
+    header.terminal_count = terminal_manager.terminal_count;
+
+    int index = 0;
+    for (Terminal *term = get_first_terminal(); term; term = get_next_terminal(term), index++) {
+        if (term == active) header.active_index = index;
+    }
+    add_buffer(&w, &header, sizeof(header));
+
+    for (Terminal *term = get_first_terminal(); term && !w.failed; term = get_next_terminal(term)) {
+        /* Splits are stored by tab position since IDs are not kept */
+        int split_index = -1;
+        Terminal *partner = find_terminal(term->split_with);
+        if (partner) {
+            index = 0;
+            for (Terminal *t = get_first_terminal(); t != partner; t = get_next_terminal(t)) index++;
+            split_index = index;
+        }
+        if (!write_terminal(&w, term, split_index)) w.failed = 1;
+    }
+    flush_writer(&w);
+
+    header.file_size = w.total;
+    if (!w.failed && pwrite(w.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        w.failed = 1;
+    }
+    if (close(w.fd) != 0) w.failed = 1;
+    if (w.failed || rename(tmp_path, path) != 0) {
+        snprintf(message, message_size, "snapshot: %s: %s", path, strerror(errno));
+        unlink(tmp_path);
+        return 0;
+    }
+
+    gettimeofday(&end, NULL);
+    long ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+    snprintf(message, message_size, "Snapshot of %d terminals saved to %s (%llu bytes, %ld ms)",
+             terminal_manager.terminal_count, path, (unsigned long long)w.total, ms);
+    return 1;
+}
+
+/*
+ * Take the next n bytes from the mapped file
+ * @return: Pointer to the bytes, or NULL if the file is too short
+ */
+static const char* take_bytes(SnapshotReader *r, size_t n) {
+    if (n > r->size - r->pos) return NULL;
+    const char *p = r->data + r->pos;
+    r->pos += n;
+    return p;
+}
+
+/*
+ * Take the next NUL-terminated string from the mapped file
+ * @return: The string, or NULL if it runs past the end
+ */
+static const char* take_string(SnapshotReader *r) {
+    const char *p = r->data + r->pos;
+    const char *nul = memchr(p, '\0', r->size - r->pos);
+    if (!nul) return NULL;
+    r->pos += nul - p + 1;
+    return p;
+}
+
+/*
+ * Restore one terminal record into term
+ * @param r: Reader positioned at the record
+ * @param term: Freshly created terminal
+ * @param record: Receives the record header
+ * @return: 1 on success, 0 if the record is malformed
+ */
+static int read_terminal(SnapshotReader *r, Terminal *term, SnapshotTerminal *record) {
+    const char *p = take_bytes(r, sizeof(*record));
+    if (!p) return 0;
+    memcpy(record, p, sizeof(*record));
+
+    const char *cwd = take_string(r);
+    if (!cwd) return 0;
+    snprintf(term->current_directory, sizeof(term->current_directory), "%s", cwd);
+
+    size_t count = record->line_count;
+    const char *types = take_bytes(r, count * sizeof(int));
+    const char *timestamps = take_bytes(r, count * sizeof(time_t));
+    const char *lengths = take_bytes(r, count * sizeof(uint32_t));
+    if (!types || !timestamps || !lengths) return 0;
+
+    /* Scrollback lines stay in the mapping; only the arrays are copied */
+    HistoryBuffer *history = &term->history;
+    free_history_buffer(history);
+    init_history_buffer(history);
+    if (count > 0) {
+        history->lines = malloc(count * sizeof(char*));
+        history->line_types = malloc(count * sizeof(int));
+        history->timestamps = malloc(count * sizeof(time_t));
+        if (!history->lines || !history->line_types || !history->timestamps) return 0;
+        history->capacity = count;
+
+        memcpy(history->line_types, types, count * sizeof(int));
+        memcpy(history->timestamps, timestamps, count * sizeof(time_t));
+
+        /* Only the lengths are read; the text pages are faulted in when shown */
+        const char *line;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t len;
+            memcpy(&len, lengths + i * sizeof(uint32_t), sizeof(len));
+            line = take_bytes(r, (size_t)len + 1);
+            if (!line) return 0;
+            history->lines[i] = (char *)line;
+        }
+
+        /* A NUL at the very end keeps every line inside the mapping */
+        if (r->data[r->pos - 1] != '\0') return 0;
+        history->count = count;
+    }
+
+    InputState *input = &term->input;
+    for (uint32_t i = 0; i < record->cmd_history_count; i++) {
+        const char *cmd = take_string(r);
+        if (!cmd) return 0;
+        if (!input->cmd_history) {
+            input->cmd_history = calloc(MAX_CMD_HISTORY, sizeof(char*));
+            if (!input->cmd_history) return 0;
+        }
+        if (input->cmd_history_count < MAX_CMD_HISTORY) {
+            input->cmd_history[input->cmd_history_count++] = strdup(cmd);
+        }
+    }
+
+    for (uint32_t i = 0; i < record->queue_count; i++) {
+        const char *cmd = take_string(r);
+        if (!cmd) return 0;
+        add_to_queue(&term->cmd_queue, cmd);
+    }
+    if (!is_queue_empty(&term->cmd_queue)) term->cmd_state = CMD_STATE_QUEUED;
+
+    const char *text = take_string(r);
+    if (!text) return 0;
+    set_input_text(input, text);
+    return 1;
+}
+
+/*
+ * Replace the terminals with the contents of a snapshot file. The file
+ * is mapped rather than read, and the scrollback points into the mapping.
+ * Must be called right after init_terminal_manager().
+ * @param path: Snapshot path
+ * @param message: Receives a status line for the user
+ * @param message_size: Size of message
+ * @return: 1 on success, 0 on failure
+ */
+int restore_snapshot(const char *path, char *message, size_t message_size) {
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(message, message_size, "restore: %s: %s", path, strerror(errno));
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+        close(fd);
+        snprintf(message, message_size, "restore: %s: not a snapshot", path);
+        return 0;
+    }
+
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(message, message_size, "restore: %s: %s", path, strerror(errno));
+        return 0;
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, map, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION ||
+        header.byte_order != SNAPSHOT_BYTE_ORDER ||
+        header.int_size != sizeof(int) || header.time_size != sizeof(time_t) ||
+        header.file_size != (uint64_t)st.st_size || header.terminal_count == 0) {
+        munmap(map, st.st_size);
+        snprintf(message, message_size, "restore: %s: unsupported or damaged snapshot", path);
+        return 0;
+    }
+
+    /* Keep the mapping before any line points into it */
+    snapshot_map = map;
+    snapshot_map_size = st.st_size;
+
+    SnapshotReader r = {map, (size_t)st.st_size, sizeof(header)};
+    int *split_index = malloc(header.terminal_count * sizeof(int));
+    int *ids = malloc(header.terminal_count * sizeof(int));
+    uint32_t restored = 0;
+    if (!split_index || !ids) header.terminal_count = 0;
+
+    Terminal *term = get_first_terminal();
+    for (; restored < header.terminal_count; restored++) {
+        if (restored > 0) term = add_terminal(term->current_directory);
+        if (!term) break;
+
+        SnapshotTerminal record;
+        if (!read_terminal(&r, term, &record)) break;
+        split_index[restored] = record.split_with;
+        term->split_direction = record.split_direction;
+        ids[restored] = term->id;
+    }
+
+    /* Reconnect splits and the active tab by position */
+    for (uint32_t i = 0; i < restored; i++) {
+        int partner = split_index[i];
+        if (partner >= 0 && (uint32_t)partner < restored) {
+            find_terminal(ids[i])->split_with = ids[partner];
+        }
+    }
+    if (header.active_index < restored) {
+        terminal_manager.active_terminal = ids[header.active_index];
+    }
+    chdir(get_active_terminal()->current_directory);
+    free(split_index);
+    free(ids);
+
+    gettimeofday(&end, NULL);
+    long ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+    if (restored == 0 || restored < header.terminal_count) {
+        snprintf(message, message_size, "restore: %s: damaged after %u of %u terminals",
+                 path, restored, header.terminal_count);
+        return 0;
+    }
+    snprintf(message, message_size, "Restored %u terminals from %s (%ld ms)", restored, path, ms);
+    return 1;
+}
+
+/*
+ * Check whether a string lives in the restored snapshot mapping and
+ * must not be freed
+ * @param p: Pointer to check
+ * @return: 1 if p points into the mapping, 0 otherwise
+ */
+int is_snapshot_memory(const char *p) {
+    return snapshot_map && p >= snapshot_map && p < snapshot_map + snapshot_map_size;
+}
+
+/*
+ * Unmap the restored snapshot. Call only after every terminal is freed.
+ */
+void free_snapshot(void) {
+    if (snapshot_map) munmap(snapshot_map, snapshot_map_size);
+    snapshot_map = NULL;
+    snapshot_map_size = 0;
+}
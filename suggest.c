@@ -0,0 +1,429 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Best commands remembered per radix tree node */
+#define SUGGEST_TOP 8
+
+/* Directories remembered per command for the cwd bonus */
+#define SUGGEST_CWDS 4
+
+/* Score multiplier for commands used in the current directory */
+#define SUGGEST_CWD_WEIGHT 4
+
+/* History file entries loaded into the tree per main loop iteration */
+#define SUGGEST_SEED_BUDGET 1024
+
+/*
+ * Child edge, keyed by the first character of its label so lookups
+ * do not touch the child node itself
+ */
+typedef struct {
+    unsigned char key;
+    SuggestNode *node;
+} SuggestEdge;
+
+/*
+ * Radix tree node. The edge label leads from the parent to this node;
+ * command is set when a history entry ends here. Every node keeps the
+ * most frequent commands of its subtree so a lookup never walks below
+ * the node the input ends on.
+ */
+struct SuggestNode {
+    char *label;
+    int label_len;
+    SuggestEdge *children;
+    int child_count;
+    char *command;
+    int count;
+    uint32_t cwds[SUGGEST_CWDS];
+    int cwd_next;
+    SuggestNode *top[SUGGEST_TOP];
+    int top_counts[SUGGEST_TOP];
+    int top_count;
+};
+
+static SuggestNode suggest_root = {0};
+static unsigned int suggest_generation = 1;
+static int suggest_seed_next = -1;
+static int suggest_seed_done = 0;
+
+/*
+ * Hash a directory path for the cwd bonus
+ * @param path: Directory path
+ * @return: 32-bit FNV-1a hash, never 0
+ */
+static uint32_t hash_directory(const char *path) {
+    uint32_t hash = 2166136261u;
+    for (; *path; path++) {
+        hash = (hash ^ (unsigned char)*path) * 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+/*
+ * Find child whose label starts with c
+ * @param node: Parent node
+ * @param c: First character of the edge
+ * @param slot: Receives the child position, or the insertion point if there is none
+ * @return: Child node, or NULL
+ */
+static SuggestNode* find_child(SuggestNode *node, char c, int *slot) {
+    int lo = 0, hi = node->child_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        unsigned char first = node->children[mid].key;
+        if (first == (unsigned char)c) {
+            if (slot) *slot = mid;
+            return node->children[mid].node;
+        }
+        if (first < (unsigned char)c) lo = mid + 1;
+        else hi = mid;
+    }
+    if (slot) *slot = lo;
+    return NULL;
+}
+
+/*
+ * Create a node with a copy of the given edge label
+ * @param label: Edge label
+ * @param len: Label length
+ * @return: New node, or NULL on allocation failure
+ */
+static SuggestNode* create_node(const char *label, int len) {
+    SuggestNode *node = calloc(1, sizeof(SuggestNode));
+    if (!node) return NULL;
+
+    node->label = malloc(len + 1);
+    if (!node->label) {
+        free(node);
+        return NULL;
+    }
+    memcpy(node->label, label, len);
+    node->label[len] = '\0';
+    node->label_len = len;
+    return node;
+}
+
+/*
+ * Insert child at the given position of the sorted child array
+ * @return: 1 on success, 0 on allocation failure
+ */
+static int attach_child(SuggestNode *node, SuggestNode *child, int slot) {
+    SuggestEdge *children = realloc(node->children,
+                                    (node->child_count + 1) * sizeof(SuggestEdge));
+    if (!children) return 0;
+
+    memmove(&children[slot + 1], &children[slot],
+            (node->child_count - slot) * sizeof(SuggestEdge));
+    children[slot].key = (unsigned char)child->label[0];
+    children[slot].node = child;
+    node->children = children;
+    node->child_count++;
+    return 1;
+}
+
+/*
+ * Split the edge above child after len characters
+ * @param parent: Parent of child
+ * @param child: Node whose edge is split
+ * @param len: Characters kept on the upper edge
+ * @return: New intermediate node, or NULL on allocation failure
+ */
+static SuggestNode* split_edge(SuggestNode *parent, SuggestNode *child, int len) {
+    int slot;
+    find_child(parent, child->label[0], &slot);
+
+    SuggestNode *mid = create_node(child->label, len);
+    if (!mid) return NULL;
+
+    mid->children = malloc(sizeof(SuggestEdge));
+    if (!mid->children) {
+        free(mid->label);
+        free(mid);
+        return NULL;
+    }
+    mid->child_count = 1;
+    memcpy(mid->top, child->top, sizeof(mid->top));
+    memcpy(mid->top_counts, child->top_counts, sizeof(mid->top_counts));
+    mid->top_count = child->top_count;
+
+    memmove(child->label, child->label + len, child->label_len - len + 1);
+    child->label_len -= len;
+    mid->children[0].key = (unsigned char)child->label[0];
+    mid->children[0].node = child;
+
+    parent->children[slot].node = mid;
+    return mid;
+}
+
+/*
+ * Move leaf into the top list of node if it now ranks there
+ * @param node: Node on the path to leaf
+ * @param leaf: Node whose count just increased
+ */
+static void update_top(SuggestNode *node, SuggestNode *leaf) {
+    int pos;
+    for (pos = 0; pos < node->top_count && node->top[pos] != leaf; pos++);
+
+    if (pos == node->top_count) {
+        if (node->top_count < SUGGEST_TOP) {
+            node->top_count++;
+        } else if (node->top_counts[SUGGEST_TOP - 1] >= leaf->count) {
+            return;
+        } else {
+            pos = SUGGEST_TOP - 1;
+        }
+    }
+
+    /* Counts only grow, so the leaf can only move up */
+    while (pos > 0 && node->top_counts[pos - 1] < leaf->count) {
+        node->top[pos] = node->top[pos - 1];
+        node->top_counts[pos] = node->top_counts[pos - 1];
+        pos--;
+    }
+    node->top[pos] = leaf;
+    node->top_counts[pos] = leaf->count;
+}
+
+/*
+ * Add one use of a command to the tree
+ * @param cmd: Command string
+ * @param cwd_hash: Hash of the directory it ran in, or 0 if unknown
+ */
+static void insert_command(const char *cmd, uint32_t cwd_hash) {
+    int len = strlen(cmd);
+    if (len == 0 || len >= MAX_CMD_INPUT) return;
+
+    SuggestNode *path[MAX_CMD_INPUT + 1];
+    int depth = 0;
+    SuggestNode *node = &suggest_root;
+    int pos = 0;
+
+    path[depth++] = node;
+    while (pos < len) {
+        int slot;
+        SuggestNode *child = find_child(node, cmd[pos], &slot);
+
+        if (!child) {
+            child = create_node(cmd + pos, len - pos);
+            if (!child || !attach_child(node, child, slot)) {
+                if (child) {
+                    free(child->label);
+                    free(child);
+                }
+                return;
+            }
+            node = child;
+            path[depth++] = node;
+            break;
+        }
+
+        int common = 0;
+        while (common < child->label_len && pos + common < len &&
+               child->label[common] == cmd[pos + common]) {
+            common++;
+        }
+
+        if (common < child->label_len) {
+            child = split_edge(node, child, common);
+            if (!child) return;
+        }
+        node = child;
+        pos += common;
+        path[depth++] = node;
+    }
+
+    if (!node->command) {
+        node->command = strdup(cmd);
+        if (!node->command) return;
+    }
+    node->count++;
+
+    if (cwd_hash) {
+        int known = 0;
+        for (int i = 0; i < SUGGEST_CWDS; i++) {
+            if (node->cwds[i] == cwd_hash) known = 1;
+        }
+        if (!known) {
+            node->cwds[node->cwd_next] = cwd_hash;
+            node->cwd_next = (node->cwd_next + 1) % SUGGEST_CWDS;
+        }
+    }
+
+    for (int i = 0; i < depth; i++) {
+        update_top(path[i], node);
+    }
+    suggest_generation++;
+}
+
+/*
+ * Start loading the persistent history file into the tree on first use.
+ * The entries are indexed and inserted newest first by
+ * continue_suggestion_seed(), so the file is never walked all at once.
+ */
+static void seed_suggestions(void) {
+    if (suggest_seed_next >= 0) return;
+    suggest_seed_next = 0;
+    suggest_seed_done = 0;
+}
+
+/*
+ * Check whether history file entries are still waiting to be loaded
+ * @return: 1 if continue_suggestion_seed() has work left, 0 otherwise
+ */
+int suggestion_seed_pending(void) {
+    return suggest_seed_next >= 0 && !suggest_seed_done;
+}
+
+/*
+ * Load the next batch of history file entries into the tree
+ */
+void continue_suggestion_seed(void) {
+    char cmd[MAX_CMD_INPUT];
+    int end = suggest_seed_next + SUGGEST_SEED_BUDGET;
+
+    if (!suggestion_seed_pending()) return;
+
+    for (; suggest_seed_next < end; suggest_seed_next++) {
+        int len = history_store_entry(suggest_seed_next, cmd, sizeof(cmd));
+        if (len < 0) {
+            /* Reached the start of the file */
+            suggest_seed_done = 1;
+            return;
+        }
+        if (len > 0 && len < (int)sizeof(cmd) - 1) {
+            insert_command(cmd, 0);
+        }
+    }
+}
+
+/*
+ * Record an executed command for future suggestions
+ * @param cmd: Command string
+ * @param cwd: Directory the command ran in
+ */
+void record_suggestion(const char *cmd, const char *cwd) {
+    seed_suggestions();
+    insert_command(cmd, hash_directory(cwd));
+}
+
+/*
+ * Pick the best suggestion below the input cursor
+ * @param input: InputState with a valid tree cursor
+ */
+static void choose_suggestion(InputState *input) {
+    SuggestNode *node = input->suggest_node;
+    input->suggestion = NULL;
+    if (!node || input->input_len == 0) return;
+
+    uint32_t cwd_hash = hash_directory(get_active_terminal()->current_directory);
+    long best_score = 0;
+
+    for (int i = 0; i < node->top_count; i++) {
+        SuggestNode *leaf = node->top[i];
+        if ((int)strlen(leaf->command) <= input->input_len) continue;
+
+        long score = leaf->count;
+        for (int j = 0; j < SUGGEST_CWDS; j++) {
+            if (leaf->cwds[j] == cwd_hash) {
+                score *= SUGGEST_CWD_WEIGHT;
+                break;
+            }
+        }
+        if (score > best_score) {
+            best_score = score;
+            input->suggestion = leaf->command;
+        }
+    }
+}
+
+/*
+ * Advance the tree cursor by one character
+ * @param input: InputState whose cursor to move
+ * @param c: Character typed
+ */
+static void step_suggestion(InputState *input, char c) {
+    SuggestNode *node = input->suggest_node;
+    if (!node) return;
+
+    if (input->suggest_edge_pos < node->label_len) {
+        if (node->label[input->suggest_edge_pos] == c) {
+            input->suggest_edge_pos++;
+        } else {
+            input->suggest_node = NULL;
+        }
+    } else {
+        input->suggest_node = find_child(node, c, NULL);
+        input->suggest_edge_pos = 1;
+    }
+}
+
+/*
+ * Recompute the suggestion for the whole input line
+ * @param input: InputState to update
+ */
+void refresh_suggestion(InputState *input) {
+    seed_suggestions();
+
+    input->suggest_node = &suggest_root;
+    input->suggest_edge_pos = 0;
+    input->suggest_generation = suggest_generation;
+    for (int i = 0; i < input->input_len && input->suggest_node; i++) {
+        step_suggestion(input, input_char_at(input, i));
+    }
+    choose_suggestion(input);
+}
+
+/*
+ * Update the suggestion after a character was appended to the input
+ * @param input: InputState to update
+ * @param c: Character appended
+ */
+void extend_suggestion(InputState *input, char c) {
+    if (input->suggest_generation != suggest_generation) {
+        refresh_suggestion(input);
+        return;
+    }
+    step_suggestion(input, c);
+    choose_suggestion(input);
+}
+
+/*
+ * Get the part of the suggestion not typed yet
+ * @param input: InputState to query
+ * @return: Remaining text, or NULL if there is no suggestion
+ */
+const char* get_suggestion_tail(InputState *input) {
+    if (input->suggest_generation != suggest_generation) {
+        refresh_suggestion(input);
+    }
+    if (!input->suggestion || input->cursor_pos != input->input_len) return NULL;
+    return input->suggestion + input->input_len;
+}
+
+/*
+ * Free a subtree
+ * @param node: Root of the subtree
+ */
+static void free_suggest_node(SuggestNode *node) {
+    for (int i = 0; i < node->child_count; i++) {
+        free_suggest_node(node->children[i].node);
+        free(node->children[i].node);
+    }
+    free(node->children);
+    free(node->label);
+    free(node->command);
+}
+
+/*
+ * Release the suggestion tree
+ */
+void free_suggestions(void) {
+    free_suggest_node(&suggest_root);
+    memset(&suggest_root, 0, sizeof(suggest_root));
+    suggest_seed_next = -1;
+    suggest_seed_done = 0;
+    suggest_generation++;
+}
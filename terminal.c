@@ -11,189 +11,19 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <poll.h>
+
+/* Upper bound on keys applied between two redraws */
+#define INPUT_DRAIN_LIMIT 4096
+
+/* Give up on a paste whose end marker does not arrive within this time */
+#define PASTE_TIMEOUT_MS 1000
 
 /* Global state variables */
 uint8_t current_theme_index = 0;
-int line_break_enabled = 1;
 int time_format = TIME_FORMAT_24H;
-TerminalManager terminal_manager = {0};
 int terminal_layout_mode = 0;
 
-/*
- * Initialize command queue structure
- * @param queue: Pointer to CommandQueue to initialize
- */
-void init_command_queue(CommandQueue *queue) {
-    queue->count = 0;
-    queue->head = 0;
-    queue->tail = 0;
-    queue->state = QUEUE_NORMAL;
-    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
-        queue->commands[i][0] = '\0';
-    }
-}
-
-/*
- * Update queue state based on current count
- * @param queue: Pointer to CommandQueue to update
- */
-void update_queue_state(CommandQueue *queue) {
-    queue->state = (queue->count >= COMMAND_QUEUE_SIZE) ? 
-                   QUEUE_FULL : QUEUE_NORMAL;
-}
-
-/*
- * Check if command queue is full
- * @param queue: Pointer to CommandQueue to check
- * @return: 1 if full, 0 otherwise
- */
-int is_queue_full(CommandQueue *queue) {
-    return queue->count >= COMMAND_QUEUE_SIZE;
-}
-
-/*
- * Check if command queue is empty
- * @param queue: Pointer to CommandQueue to check
- * @return: 1 if empty, 0 otherwise
- */
-int is_queue_empty(CommandQueue *queue) {
-    return queue->count == 0;
-}
-
-/*
- * Add command to queue
- * @param queue: Pointer to CommandQueue
- * @param cmd: Command string to add
- * @return: 1 on success, 0 on failure (queue full)
- */
-int add_to_queue(CommandQueue *queue, const char *cmd) {
-    if (is_queue_full(queue)) {
-        queue->state = QUEUE_FULL;
-        return 0;
-    }
-    
-    strncpy(queue->commands[queue->tail], cmd, MAX_CMD_INPUT - 1);
-    queue->commands[queue->tail][MAX_CMD_INPUT - 1] = '\0';
-    queue->tail = (queue->tail + 1) % COMMAND_QUEUE_SIZE;
-    queue->count++;
-    update_queue_state(queue);
-    return 1;
-}
-
-/*
- * Get next command from queue
- * @param queue: Pointer to CommandQueue
- * @param cmd: Buffer to store retrieved command
- * @return: 1 if command retrieved, 0 if queue empty
- */
-int get_from_queue(CommandQueue *queue, char *cmd) {
-    if (is_queue_empty(queue)) {
-        return 0;
-    }
-    
-    strncpy(cmd, queue->commands[queue->head], MAX_CMD_INPUT - 1);
-    cmd[MAX_CMD_INPUT - 1] = '\0';
-    queue->head = (queue->head + 1) % COMMAND_QUEUE_SIZE;
-    queue->count--;
-    update_queue_state(queue);
-    return 1;
-}
-
-/*
- * Add command to active terminal's queue
- * @param cmd: Command string to queue
- */
-void add_command_to_queue(const char *cmd) {
-    Terminal* active = get_active_terminal();
-    if (add_to_queue(&active->cmd_queue, cmd)) {
-        char msg[128];
-        snprintf(msg, sizeof(msg), 
-                 "Command added to queue. Queue size: %d/%d", 
-                 active->cmd_queue.count, COMMAND_QUEUE_SIZE
-                );
-        add_history_line(&active->history, msg, HISTORY_TYPE_NORMAL);
-    } else {
-        add_history_line(&active->history, 
-                         "Command queue is full! Maximum 10 commands allowed.", 
-                         HISTORY_TYPE_RAW
-                        );
-        active->input.is_locked = 1;
-    }
-}
-
-/*
- * Process next command from queue if no command is running
- */
-void process_command_queue() {
-    Terminal* active = get_active_terminal();
-    
-    if (!is_command_running() && !is_queue_empty(&active->cmd_queue)) {
-        char next_cmd[MAX_CMD_INPUT];
-        if (get_from_queue(&active->cmd_queue, next_cmd)) {
-            if (active->cmd_queue.state == QUEUE_NORMAL) {
-                active->input.is_locked = 0;
-            }
-            execute_command(next_cmd, &active->history, &active->input);
-        }
-    }
-}
-
-/*
- * Check if command is currently running in active terminal
- * @return: 1 if command running, 0 otherwise
- */
-int is_command_running() {
-    Terminal* active = get_active_terminal();
-    return active->cmd_state == CMD_STATE_RUNNING;
-}
-
-/*
- * Stop currently running command (emulate Ctrl+C)
- */
-void stop_current_command() {
-    Terminal* active = get_active_terminal();
-    
-    if (active->cmd_state == CMD_STATE_RUNNING && active->current_process > 0) {
-        kill(active->current_process, SIGINT);
-        add_history_line(&active->history, 
-                         "Command interrupted (SIGINT sent)", 
-                         HISTORY_TYPE_NORMAL
-                        );
-        active->cmd_state = CMD_STATE_READY;
-        active->current_process = 0;
-    } else {
-        add_history_line(&active->history, 
-                         "No command is currently running", 
-                         HISTORY_TYPE_NORMAL
-                        );
-    }
-}
-
-/*
- * Remove ANSI escape codes from string
- * @param str: String to clean
- */
-void strip_escape_codes(char* str) {
-    char* src = str;
-    char* dst = str;
-    int in_escape = 0;
-    
-    while (*src) {
-        if (*src == '\033') {
-            in_escape = 1;
-            src++;
-        } else if (in_escape && *src == 'm') {
-            in_escape = 0;
-            src++;
-        } else if (in_escape) {
-            src++;
-        } else {
-            *dst++ = *src++;
-        }
-    }
-    *dst = '\0';
-}
-
 /*
  * Initialize colors with default theme
  */
@@ -233,6 +63,123 @@ void draw_locked_input(int width) {
     attroff(COLOR_PAIR(COLOR_ERROR) | A_BOLD);
 }
 
+/*
+ * Draw reverse search prompt with query and current match
+ * @param input: Input state in search mode
+ * @param width: Available width
+ */
+void draw_history_search(InputState *input, int width) {
+    char line[MAX_CMD_INPUT * 2 + 64];
+    snprintf(line, sizeof(line), 
+             "%s%s': %s", 
+             input->search_failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`",
+             input->search_query, 
+             input->search_failed ? "" : get_input_text(input)
+            );
+    for (char *p = line; *p; p++) {
+        if (*p == '\n') *p = ' ';
+    }
+    if (width < 0) width = 0;
+    line[utf8_fit(line, strlen(line), width, NULL)] = '\0';
+    
+    attron(COLOR_PAIR(COLOR_DIRECTORY));
+    printw("%s", line);
+    attroff(COLOR_PAIR(COLOR_DIRECTORY));
+}
+
+/*
+ * Draw the input text, one row per line, scrolled so the cursor stays
+ * visible, with the history suggestion dimmed after the last line
+ * @param input: Input state to draw
+ * @param first_row: Screen row of the first input line
+ * @param rows: Number of rows available
+ * @param left: Screen column where the text starts
+ * @param width: Available width
+ * @param cursor_row: Receives the cursor screen row
+ * @param cursor_col: Receives the cursor screen column
+ */
+static void draw_input_text(InputState *input, int first_row, int rows, int left, int width,
+                            int *cursor_row, int *cursor_col) {
+    const char *text = get_input_text(input);
+    if (width < 1) width = 1;
+    
+    /* Locate the cursor line and the widest line, in columns */
+    int cursor_line = 0, cursor_line_start = 0, widest = 0;
+    int line = 0, start = 0;
+    for (int i = 0; ; i++) {
+        if (text[i] != '\n' && text[i] != '\0') continue;
+        
+        int columns = utf8_width(text + start, i - start);
+        if (columns > widest) widest = columns;
+        if (input->cursor_pos >= start && input->cursor_pos <= i) {
+            cursor_line = line;
+            cursor_line_start = start;
+        }
+        if (text[i] == '\0') break;
+        line++;
+        start = i + 1;
+    }
+    int cursor_column = utf8_width(text + cursor_line_start, input->cursor_pos - cursor_line_start);
+    
+    /* display_start counts columns, not bytes */
+    if (widest < width) {
+        input->display_start = 0;
+    } else if (cursor_column < input->display_start) {
+        input->display_start = cursor_column;
+    } else if (cursor_column >= input->display_start + width) {
+        input->display_start = cursor_column - width + 1;
+    }
+    
+    int first_line = cursor_line - rows + 1;
+    if (first_line < 0) first_line = 0;
+    
+    line = 0;
+    start = 0;
+    for (int i = 0; ; i++) {
+        if (text[i] != '\n' && text[i] != '\0') continue;
+        
+        if (line >= first_line && line < first_line + rows) {
+            int row = first_row + line - first_line;
+            int line_len = i - start;
+            int column = utf8_width(text + start, line_len) - input->display_start;
+            
+            /* Skip the scrolled-off columns; a wide character cut by the edge is left blank */
+            int skipped;
+            int skip = utf8_fit(text + start, line_len, input->display_start, &skipped);
+            int pad = 0;
+            if (skipped < input->display_start && skip < line_len) {
+                uint32_t cp;
+                skip += utf8_decode(text + start + skip, line_len - skip, &cp);
+                pad = skipped + codepoint_width(cp) - input->display_start;
+            }
+            int len = utf8_fit(text + start + skip, line_len - skip, width - pad, NULL);
+            
+            move(row, left + pad);
+            if (len > 0) {
+                char segment[len + 1];
+                memcpy(segment, text + start + skip, len);
+                segment[len] = '\0';
+                highlight_text_with_files(segment);
+            }
+            
+            /* Ghost text for the suggested completion */
+            const char *tail = text[i] == '\0' ? get_suggestion_tail(input) : NULL;
+            if (tail && column >= 0 && column < width) {
+                int tail_len = utf8_fit(tail, strcspn(tail, "\n"), width - column, NULL);
+                attron(A_DIM);
+                mvprintw(row, left + column, "%.*s", tail_len, tail);
+                attroff(A_DIM);
+            }
+        }
+        if (text[i] == '\0') break;
+        line++;
+        start = i + 1;
+    }
+    
+    *cursor_row = first_row + cursor_line - first_line;
+    *cursor_col = left + cursor_column - input->display_start;
+}
+
 /*
  * Draw complete terminal interface with history, tabs, and prompt
  * @param history: History buffer to display
@@ -240,15 +187,27 @@ void draw_locked_input(int width) {
  * @param show_cursor: Whether to show cursor (1) or not (0)
  */
 void draw_interface(HistoryBuffer *history, InputState *input, int show_cursor) {
-    clear();
+    /* erase() lets refresh() send only the cells that changed */
+    erase();
     
     int max_y, max_x;
     getmaxyx(stdscr, max_y, max_x);
     
     draw_terminal_tabs();
     
+    /* Multi-line input grows the prompt upwards */
+    int input_rows = 1;
+    if (!input->is_locked && !input->search_active) {
+        for (const char *p = get_input_text(input); *p; p++) {
+            if (*p == '\n') input_rows++;
+        }
+    }
+    if (input_rows > max_y - 3) input_rows = max_y - 3;
+    if (input_rows < 1) input_rows = 1;
+    int prompt_row = max_y - input_rows;
+    
     int content_width = max_x;
-    int history_height = max_y - 2;
+    int history_height = max_y - 2 - input_rows;
     int start_line = history->count - history_height - history->scroll_offset;
     if (start_line < 0) start_line = 0;
     
@@ -268,11 +227,12 @@ void draw_interface(HistoryBuffer *history, InputState *input, int show_cursor)
             attroff(COLOR_PAIR(COLOR_TEXT));
         } else {
             int line_len = strlen(line_text);
+            int fit = utf8_fit(line_text, line_len, content_width, NULL);
             
-            if (line_len > content_width) {
-                char truncated_line[content_width + 1];
-                strncpy(truncated_line, line_text, content_width);
-                truncated_line[content_width] = '\0';
+            if (fit < line_len) {
+                char truncated_line[fit + 1];
+                memcpy(truncated_line, line_text, fit);
+                truncated_line[fit] = '\0';
                 highlight_text(truncated_line, history->line_types[i]);
             } else {
                 highlight_text(line_text, history->line_types[i]);
@@ -281,7 +241,7 @@ void draw_interface(HistoryBuffer *history, InputState *input, int show_cursor)
     }
     
     /* Display prompt line with real-time clock */
-    move(max_y - 1, 0); 
+    move(prompt_row, 0); 
     clrtoeol();
     
     time_t now = time(NULL);
@@ -325,40 +285,29 @@ void draw_interface(HistoryBuffer *history, InputState *input, int show_cursor)
     
     int available_width = content_width - prompt_len - 2;
     
+    int cursor_row = prompt_row;
+    int cursor_col = prompt_len;
+    
     if (input->is_locked) {
         draw_locked_input(available_width);
+    } else if (input->search_active) {
+        draw_history_search(input, available_width);
     } else {
-        if (input->input_len <= available_width) {
-            highlight_text_with_files(input->input);
-        } else {
-            if (input->display_start + available_width > input->input_len) {
-                input->display_start = input->input_len - available_width;
-            }
-            if (input->display_start < 0) input->display_start = 0;
-            
-            char display_part[available_width + 1];
-            strncpy(display_part, 
-                    input->input + input->display_start, 
-                    available_width
-                   );
-            display_part[available_width] = '\0';
-            highlight_text_with_files(display_part);
-        }
+        draw_input_text(input, prompt_row, input_rows, prompt_len, available_width, 
+                        &cursor_row, &cursor_col);
     }
     
     /* Position cursor appropriately */
-    if (show_cursor && !input->is_locked) {
-        int cursor_display_pos = input->cursor_pos - input->display_start;
-        if (cursor_display_pos < 0) {
-            input->display_start = input->cursor_pos;
-            cursor_display_pos = 0;
-        } else if (cursor_display_pos >= available_width) {
-            input->display_start = input->cursor_pos - available_width + 1;
-            cursor_display_pos = available_width - 1;
-        }
-        move(max_y - 1, prompt_len + cursor_display_pos);
+    if (show_cursor && input->search_active && !input->is_locked) {
+        int label_len = (int)strlen(input->search_failed ? 
+                                    "(failed reverse-i-search)`" : "(reverse-i-search)`");
+        int cursor_display_pos = label_len + utf8_width(input->search_query, input->search_len);
+        if (cursor_display_pos >= available_width) cursor_display_pos = available_width - 1;
+        move(prompt_row, prompt_len + cursor_display_pos);
+    } else if (show_cursor && !input->is_locked) {
+        move(cursor_row, cursor_col);
     } else if (input->is_locked) {
-        move(max_y - 1, prompt_len + available_width);
+        move(prompt_row, prompt_len + available_width);
     }
     
     refresh();
@@ -372,6 +321,17 @@ void update_real_time_display() {
     draw_interface(&active->history, &active->input, 1);
 }
 
+/*
+ * Repaint the whole screen and re-send the terminal modes set at startup.
+ * Used for Ctrl+L and when a session front end attaches with a fresh terminal.
+ */
+void redraw_screen(void) {
+    endwin();
+    refresh();
+    clearok(curscr, TRUE);
+    set_bracketed_paste(1);
+}
+
 /*
  * Update input lock state based on queue status
  * @param input: InputState to update
@@ -381,373 +341,6 @@ void update_input_lock_state(InputState *input, CommandQueue *queue) {
     input->is_locked = (queue->state == QUEUE_FULL);
 }
 
-/*
- * Initialize terminal manager and first terminal
- */
-void init_terminal_manager(void) {
-    terminal_manager.terminals = malloc(sizeof(Terminal) * MAX_TERMINALS);
-    if (!terminal_manager.terminals) {
-        fprintf(stderr, "Critical error: Failed to allocate memory for terminals\n");
-        exit(1);
-    }
-    
-    terminal_manager.terminal_count = 1;
-    terminal_manager.active_terminal = 0;
-    
-    init_history_buffer(&terminal_manager.terminals[0].history);
-    init_input_state(&terminal_manager.terminals[0].input);
-    init_command_queue(&terminal_manager.terminals[0].cmd_queue);
-    terminal_manager.terminals[0].id = 0;
-    terminal_manager.terminals[0].split_with = -1;
-    terminal_manager.terminals[0].cmd_state = CMD_STATE_READY;
-    terminal_manager.terminals[0].current_process = 0;
-    getcwd(terminal_manager.terminals[0].current_directory, 
-           sizeof(terminal_manager.terminals[0].current_directory)
-          );
-}
-
-/*
- * Get pointer to currently active terminal
- * @return: Pointer to active Terminal
- */
-Terminal* get_active_terminal(void) {
-    return &terminal_manager.terminals[terminal_manager.active_terminal];
-}
-
-/*
- * Create new terminal tab
- */
-void create_new_terminal(void) {
-    if (terminal_manager.terminal_count >= MAX_TERMINALS) return;
-    
-    int new_id = terminal_manager.terminal_count;
-    Terminal* new_term = &terminal_manager.terminals[new_id];
-    
-    init_history_buffer(&new_term->history);
-    init_input_state(&new_term->input);
-    init_command_queue(&new_term->cmd_queue);
-    new_term->id = new_id;
-    new_term->split_with = -1;
-    new_term->cmd_state = CMD_STATE_READY;
-    new_term->current_process = 0;
-    
-    Terminal* active = get_active_terminal();
-    strncpy(new_term->current_directory, 
-            active->current_directory, 
-            sizeof(new_term->current_directory)
-           );
-    
-    terminal_manager.terminal_count++;
-    show_welcome_message(&new_term->history);
-    chdir(new_term->current_directory);
-}
-
-/*
- * Create split terminal in specified direction
- * @param split_direction: SPLIT_HORIZONTAL or SPLIT_VERTICAL
- */
-void create_split_terminal(int split_direction) {
-    if (terminal_manager.terminal_count >= MAX_TERMINALS) return;
-    
-    int active_id = terminal_manager.active_terminal;
-    int new_id = terminal_manager.terminal_count;
-    
-    init_history_buffer(&terminal_manager.terminals[new_id].history);
-    init_input_state(&terminal_manager.terminals[new_id].input);
-    init_command_queue(&terminal_manager.terminals[new_id].cmd_queue);
-    terminal_manager.terminals[new_id].id = new_id;
-    terminal_manager.terminals[new_id].split_with = active_id;
-    terminal_manager.terminals[new_id].split_direction = split_direction;
-    terminal_manager.terminals[new_id].cmd_state = CMD_STATE_READY;
-    terminal_manager.terminals[new_id].current_process = 0;
-    
-    strncpy(terminal_manager.terminals[new_id].current_directory,
-            terminal_manager.terminals[active_id].current_directory,
-            sizeof(terminal_manager.terminals[new_id].current_directory)
-           );
-    
-    terminal_manager.terminals[active_id].split_with = new_id;
-    terminal_manager.terminals[active_id].split_direction = split_direction;
-    
-    terminal_manager.terminal_count++;
-    show_welcome_message(&terminal_manager.terminals[new_id].history);
-    switch_terminal(new_id);
-}
-
-/*
- * Switch to specified terminal by ID
- * @param terminal_id: ID of terminal to switch to
- */
-void switch_terminal(int terminal_id) {
-    if (terminal_id >= 0 && terminal_id < terminal_manager.terminal_count) {
-        Terminal* current = get_active_terminal();
-        getcwd(current->current_directory, sizeof(current->current_directory));
-        
-        terminal_manager.active_terminal = terminal_id;
-        
-        Terminal* new_active = get_active_terminal();
-        chdir(new_active->current_directory);
-    }
-}
-
-/*
- * Switch to next terminal in sequence
- */
-void next_terminal(void) {
-    int next = (terminal_manager.active_terminal + 1) % terminal_manager.terminal_count;
-    switch_terminal(next);
-}
-
-/*
- * Switch to previous terminal in sequence
- */
-void prev_terminal(void) {
-    int prev = (terminal_manager.active_terminal - 1 + terminal_manager.terminal_count) % 
-                terminal_manager.terminal_count;
-    switch_terminal(prev);
-}
-
-/*
- * Close currently active terminal
- */
-void close_current_terminal(void) {
-    if (terminal_manager.terminal_count <= 1) return;
-    
-    int active_id = terminal_manager.active_terminal;
-    
-    if (terminal_manager.terminals[active_id].cmd_state == CMD_STATE_RUNNING) {
-        stop_current_command();
-    }
-    
-    int split_with = terminal_manager.terminals[active_id].split_with;
-    if (split_with != -1) {
-        terminal_manager.terminals[split_with].split_with = -1;
-    }
-    
-    free_history_buffer(&terminal_manager.terminals[active_id].history);
-    free_input_state(&terminal_manager.terminals[active_id].input);
-    
-    /* Shift terminals array to fill gap */
-    for (int i = active_id; i < terminal_manager.terminal_count - 1; i++) {
-        terminal_manager.terminals[i] = terminal_manager.terminals[i + 1];
-        terminal_manager.terminals[i].id = i;
-        
-        if (terminal_manager.terminals[i].split_with != -1) {
-            if (terminal_manager.terminals[i].split_with > active_id) {
-                terminal_manager.terminals[i].split_with--;
-            }
-        }
-    }
-    
-    terminal_manager.terminal_count--;
-    
-    if (terminal_manager.active_terminal >= terminal_manager.terminal_count) {
-        terminal_manager.active_terminal = terminal_manager.terminal_count - 1;
-    }
-}
-
-/*
- * Display welcome message with logo and help
- * @param history: History buffer to add message to
- */
-void show_welcome_message(HistoryBuffer *history) {
-    char version_msg[128];
-    snprintf(version_msg, sizeof(version_msg), 
-             "Welcome to Parrot Terminal Version %s", 
-             PARROT_VERSION
-            );
-    add_history_line(history, version_msg, HISTORY_TYPE_RAW);
-    add_history_line(history, "==========================================", HISTORY_TYPE_RAW);
-    add_history_line(history, "Type 'exit' to quit", HISTORY_TYPE_RAW);
-    add_history_line(history, "Shift+T: New terminal, Shift+W: Close terminal", HISTORY_TYPE_RAW);
-    add_history_line(history, "Alt+1-9: Switch terminals, Alt+/-: Next/Prev terminal", HISTORY_TYPE_RAW);
-    add_history_line(history, "Alt+Arrows: Switch between split panes", HISTORY_TYPE_RAW);
-    add_history_line(history, "Arrows: Scroll terminal history", HISTORY_TYPE_RAW);
-    add_history_line(history, "Shift+Up/Down: Command history", HISTORY_TYPE_RAW);
-    add_history_line(history, "", HISTORY_TYPE_RAW);
-}
-
-/*
- * Initialize history buffer with default capacity
- * @param buf: HistoryBuffer to initialize
- */
-void init_history_buffer(HistoryBuffer *buf) {
-    buf->capacity = 500;
-    buf->count = 0;
-    buf->scroll_offset = 0;
-    buf->lines = malloc(buf->capacity * sizeof(char*));
-    buf->line_types = malloc(buf->capacity * sizeof(int));
-    buf->timestamps = malloc(buf->capacity * sizeof(time_t));
-    
-    if (!buf->lines || !buf->line_types || !buf->timestamps) {
-        fprintf(stderr, "Critical error: Failed to allocate history buffer\n");
-        exit(2);
-    }
-}
-
-/*
- * Add line to history buffer
- * @param buf: HistoryBuffer to add to
- * @param text: Text to add
- * @param line_type: Type of line (normal, command, raw)
- */
-void add_history_line(HistoryBuffer *buf, const char *text, int line_type) {
-    if (buf->count >= buf->capacity) {
-        buf->capacity *= 2;
-        buf->lines = realloc(buf->lines, buf->capacity * sizeof(char*));
-        buf->line_types = realloc(buf->line_types, buf->capacity * sizeof(int));
-        buf->timestamps = realloc(buf->timestamps, buf->capacity * sizeof(time_t));
-        
-        if (!buf->lines || !buf->line_types || !buf->timestamps) {
-            fprintf(stderr, "Critical error: Failed to reallocate history buffer\n");
-            exit(3);
-        }
-    }
-    
-    if (line_break_enabled) {
-        buf->lines[buf->count] = strdup(text);
-    } else {
-        char *cleaned = malloc(strlen(text) + 1);
-        char *dst = cleaned;
-        const char *src = text;
-        while (*src) {
-            *dst++ = (*src == '\n') ? ' ' : *src;
-            src++;
-        }
-        *dst = '\0';
-        buf->lines[buf->count] = cleaned;
-    }
-    
-    buf->line_types[buf->count] = line_type;
-    buf->timestamps[buf->count] = time(NULL);
-    buf->count++;
-}
-
-/*
- * Free all resources associated with history buffer
- * @param buf: HistoryBuffer to free
- */
-void free_history_buffer(HistoryBuffer *buf) {
-    for (int i = 0; i < buf->count; i++) {
-        free(buf->lines[i]);
-    }
-    free(buf->lines);
-    free(buf->line_types);
-    free(buf->timestamps);
-}
-
-/*
- * Initialize input state structure
- * @param input: InputState to initialize
- */
-void init_input_state(InputState *input) {
-    input->input[0] = '\0';
-    input->cursor_pos = 0;
-    input->input_len = 0;
-    input->display_start = 0;
-    input->cmd_history_count = 0;
-    input->cmd_history_pos = -1;
-    input->is_locked = 0;
-    
-    for (int i = 0; i < MAX_CMD_HISTORY; i++) {
-        input->cmd_history[i] = NULL;
-    }
-}
-
-/*
- * Add command to command history
- * @param input: InputState containing command history
- * @param cmd: Command string to add
- */
-void add_to_cmd_history(InputState *input, const char *cmd) {
-    if (input->cmd_history_count >= MAX_CMD_HISTORY) {
-        free(input->cmd_history[0]);
-        for (int i = 1; i < MAX_CMD_HISTORY; i++) {
-            input->cmd_history[i-1] = input->cmd_history[i];
-        }
-        input->cmd_history_count--;
-    }
-    
-    input->cmd_history[input->cmd_history_count] = strdup(cmd);
-    input->cmd_history_count++;
-    input->cmd_history_pos = input->cmd_history_count;
-}
-
-/*
- * Free input state resources
- * @param input: InputState to free
- */
-void free_input_state(InputState *input) {
-    for (int i = 0; i < input->cmd_history_count; i++) {
-        free(input->cmd_history[i]);
-    }
-}
-
-/*
- * Shorten path for display (replace home with ~, truncate middle components)
- * @param path: Full path to shorten
- * @param output: Buffer for shortened path
- * @param output_size: Size of output buffer
- */
-void shorten_path(char *path, char *output, size_t output_size) {
-    if (strlen(path) == 0) {
-        strncpy(output, path, output_size);
-        return;
-    }
-    
-    /* Replace home directory with ~ */
-    const char* home = getenv("HOME");
-    char modified_path[PATH_MAX];
-    if (home && strncmp(path, home, strlen(home)) == 0) {
-        snprintf(modified_path, sizeof(modified_path), 
-                 "~%s", 
-                 path + strlen(home)
-                );
-    } else {
-        strncpy(modified_path, path, sizeof(modified_path));
-    }
-    
-    char *components[64];
-    int count = 0;
-    char *path_copy = strdup(modified_path);
-    char *token = strtok(path_copy, "/");
-    
-    while (token != NULL && count < 63) {
-        components[count++] = token;
-        token = strtok(NULL, "/");
-    }
-    
-    output[0] = '\0';
-    
-    if (modified_path[0] == '/') {
-        strncat(output, "/", output_size - 1);
-    }
-    
-    for (int i = 0; i < count; i++) {
-        if (i == count - 1) {
-            if (strlen(components[i]) > 12) {
-                char shortened[16];
-                strncpy(shortened, components[i], 12);
-                shortened[12] = '\0';
-                strcat(shortened, "...");
-                strncat(output, shortened, output_size - strlen(output) - 1);
-            } else {
-                strncat(output, components[i], output_size - strlen(output) - 1);
-            }
-        } else {
-            if (strlen(components[i]) > 0) {
-                char first_letter[2] = {components[i][0], '\0'};
-                strncat(output, first_letter, output_size - strlen(output) - 1);
-                if (i < count - 1) {
-                    strncat(output, "/", output_size - strlen(output) - 1);
-                }
-            }
-        }
-    }
-    
-    free(path_copy);
-}
-
 /*
  * Get prompt information (time and directory)
  * @param time_buf: Buffer for time string
@@ -766,16 +359,6 @@ void get_prompt_info(char *time_buf, size_t time_size,
     shorten_path(cwd, dir_buf, dir_size);
 }
 
-/*
- * Check if file exists at given path
- * @param path: Path to check
- * @return: 1 if file exists, 0 otherwise
- */
-int is_existing_file(const char *path) {
-    struct stat buffer;
-    return (stat(path, &buffer) == 0);
-}
-
 /*
  * Highlight text with file path recognition
  * @param text: Text to highlight
@@ -786,45 +369,28 @@ void highlight_text_with_files(const char *text) {
     int pos = 0;
     
     while (token != NULL) {
-        /* Check for file paths */
-        if (is_existing_file(token) || 
-            strstr(token, "/") != NULL || 
-            strstr(token, "./") == token ||
-            strstr(token, "../") == token ||
-            strstr(token, "~/") == token) {
-            
-            if (access(token, F_OK) == 0) {
-                struct stat st;
-                if (stat(token, &st) == 0) {
-                    if (S_ISDIR(st.st_mode)) {
-                        attron(COLOR_PAIR(COLOR_DIRECTORY) | A_BOLD);
-                    } else {
-                        attron(COLOR_PAIR(COLOR_FILE) | A_UNDERLINE);
-                    }
-                } else {
-                    attron(COLOR_PAIR(COLOR_FILE));
-                }
-            } else {
+        switch (classify_output_token(token)) {
+            case TOKEN_DIRECTORY:
+                attron(COLOR_PAIR(COLOR_DIRECTORY) | A_BOLD);
+                break;
+            case TOKEN_FILE:
+                attron(COLOR_PAIR(COLOR_FILE) | A_UNDERLINE);
+                break;
+            case TOKEN_MISSING_PATH:
                 attron(COLOR_PAIR(COLOR_FILE) | A_DIM);
-            }
-            
-            printw("%s", token);
-            attroff(COLOR_PAIR(COLOR_FILE) | A_UNDERLINE | A_BOLD | A_DIM);
-            attroff(COLOR_PAIR(COLOR_DIRECTORY) | A_BOLD);
-        } else {
-            /* Check for error keywords */
-            if (strstr(token, "error") || strstr(token, "Error") || 
-                strstr(token, "ERROR") || strstr(token, "No such") ||
-                strstr(token, "Permission denied") || strstr(token, "command not found") ||
-                strstr(token, "fail") || strstr(token, "Fail") || strstr(token, "FAIL")) {
+                break;
+            case TOKEN_ERROR:
                 attron(COLOR_PAIR(COLOR_ERROR) | A_BOLD);
-            } else {
+                break;
+            default:
                 attron(COLOR_PAIR(COLOR_TEXT));
-            }
-            printw("%s", token);
-            attroff(COLOR_PAIR(COLOR_ERROR) | A_BOLD);
-            attroff(COLOR_PAIR(COLOR_TEXT));
+                break;
         }
+        printw("%s", token);
+        attroff(COLOR_PAIR(COLOR_FILE) | A_UNDERLINE | A_BOLD | A_DIM);
+        attroff(COLOR_PAIR(COLOR_DIRECTORY) | A_BOLD);
+        attroff(COLOR_PAIR(COLOR_ERROR) | A_BOLD);
+        attroff(COLOR_PAIR(COLOR_TEXT));
         
         pos += strlen(token);
         token = strtok(NULL, " ");
@@ -883,15 +449,28 @@ void draw_terminal_tabs(void) {
     int tab_width = max_x / terminal_manager.terminal_count;
     if (tab_width < 15) tab_width = 15;
     
-    for (int i = 0; i < terminal_manager.terminal_count; i++) {
-        int start_x = i * tab_width;
+    /* Scroll the tab bar so the active tab stays visible */
+    Terminal *active = get_active_terminal();
+    int active_index = 0;
+    for (Terminal *term = get_first_terminal(); term != active; term = get_next_terminal(term)) {
+        active_index++;
+    }
+    int visible = max_x / tab_width;
+    if (visible < 1) visible = 1;
+    int first_tab = active_index >= visible ? active_index - visible + 1 : 0;
+    
+    int i = 0;
+    for (Terminal *term = get_first_terminal(); term; term = get_next_terminal(term), i++) {
+        if (i < first_tab) continue;
+        
+        int start_x = (i - first_tab) * tab_width;
         if (start_x >= max_x) break;
         
         int width = (i == terminal_manager.terminal_count - 1) ? 
                    (max_x - start_x) : tab_width;
         
         /* Get directory for tab */
-        char* cwd = terminal_manager.terminals[i].current_directory;
+        char* cwd = term->current_directory;
         char dir_buf[PATH_MAX];
         shorten_path(cwd, dir_buf, sizeof(dir_buf));
         
@@ -913,7 +492,7 @@ void draw_terminal_tabs(void) {
             tab_text[width - 3] = '\0';
         }
         
-        if (i == terminal_manager.active_terminal) {
+        if (term == active) {
             /* Active tab - black text on cyan background */
             attron(COLOR_PAIR(COLOR_TERMINAL_TAB_ACTIVE) | A_BOLD);
             mvaddch(0, start_x, ACS_VLINE);
@@ -955,332 +534,221 @@ void draw_terminal_tabs(void) {
 }
 
 /*
- * Execute command with proper process management
- * @param cmd: Command string to execute
+ * Handle a key while reverse history search is active
+ * @param input: Input state in search mode
  * @param history: History buffer for output
- * @param input: Input state for command history
+ * @param ch: Key code
+ * @return: 1 if exit requested, 0 otherwise
  */
-void execute_command(const char *cmd, HistoryBuffer *history, InputState *input) {
-    if (strlen(cmd) == 0) return;
-    
-    Terminal* active = get_active_terminal();
-    
-    /* Handle stop command */
-    if (strcmp(cmd, "stop") == 0) {
-        stop_current_command();
-        return;
-    }
-    
-    /* Handle manual command */
-    if (strcmp(cmd, "manual") == 0) {
-        add_history_line(history, "Parrot Terminal Usage:", HISTORY_TYPE_RAW);
-        add_history_line(history, "======================", HISTORY_TYPE_RAW);
-        add_history_line(history, "Shift+T: Create new terminal", HISTORY_TYPE_RAW);
-        add_history_line(history, "Shift+W: Close current terminal", HISTORY_TYPE_RAW);
-        add_history_line(history, "Alt+1-9: Switch to terminal 1-9", HISTORY_TYPE_RAW);
-        add_history_line(history, "Alt+/-: Switch to next/previous terminal", HISTORY_TYPE_RAW);
-        add_history_line(history, "Alt+Arrows: Switch between split panes", HISTORY_TYPE_RAW);
-        add_history_line(history, "Arrow Keys: Scroll terminal history", HISTORY_TYPE_RAW);
-        add_history_line(history, "Shift+Up/Down: Navigate command history", HISTORY_TYPE_RAW);
-        add_history_line(history, "Type 'stop' to interrupt running command", HISTORY_TYPE_RAW);
-        add_history_line(history, "Type 'exit' to quit", HISTORY_TYPE_RAW);
-        add_history_line(history, "Note: Commands queue automatically when another is running", HISTORY_TYPE_RAW);
-        add_history_line(history, "Queue size: 10 commands max", HISTORY_TYPE_RAW);
-        return;
-    }
-    
-    /* Check if another command is running */
-    if (is_command_running()) {
-        add_command_to_queue(cmd);
-        return;
-    }
-    
-    /* Add to command history */
-    if (input->cmd_history_count == 0 || 
-        strcmp(cmd, input->cmd_history[input->cmd_history_count - 1]) != 0) {
-        add_to_cmd_history(input, cmd);
-    }
-    
-    /* Handle cd command specially */
-    if (strncmp(cmd, "cd ", 3) == 0) {
-        const char* dir = cmd + 3;
-        char clean_dir[PATH_MAX];
-        strncpy(clean_dir, dir, sizeof(clean_dir) - 1);
-        clean_dir[sizeof(clean_dir) - 1] = '\0';
-        
-        char *start = clean_dir;
-        while (*start == ' ') start++;
-        char *end = start + strlen(start) - 1;
-        while (end > start && (*end == ' ' || *end == '\n')) {
-            *end = '\0';
-            end--;
-        }
-        
-        if (strcmp(start, "~") == 0) {
-            const char* home = getenv("HOME");
-            if (home) strcpy(clean_dir, home);
-        } else if (strncmp(start, "~/", 2) == 0) {
-            const char* home = getenv("HOME");
-            if (home) {
-                char full_path[PATH_MAX];
-                snprintf(full_path, sizeof(full_path), 
-                         "%s%s", 
-                         home, 
-                         start + 1
-                        );
-                strcpy(clean_dir, full_path);
+static int handle_search_input(InputState *input, HistoryBuffer *history, int ch) {
+    switch (ch) {
+        case ERR:
+            break;
+            
+        case 18: // Ctrl+R - next match
+            next_history_search_match(input);
+            break;
+            
+        case 7:  // Ctrl+G - cancel
+        case 27: // ESC - cancel
+            end_history_search(input, 0);
+            break;
+            
+        case KEY_BACKSPACE:
+        case 127:
+            if (input->search_len > 0) {
+                /* Remove the whole last UTF-8 character */
+                do {
+                    input->search_len--;
+                } while (input->search_len > 0 && 
+                         (input->search_query[input->search_len] & 0xC0) == 0x80);
+                update_history_search(input);
             }
-        }
-        
-        if (chdir(clean_dir) != 0) {
-            char error_msg[128];
-            snprintf(error_msg, sizeof(error_msg), 
-                     "cd: %s: %s", 
-                     clean_dir, 
-                     strerror(errno)
-                    );
-            add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
-        } else {
-            getcwd(active->current_directory, sizeof(active->current_directory));
-        }
-        return;
-    } else if (strcmp(cmd, "cd") == 0) {
-        const char* home = getenv("HOME");
-        if (home) {
-            if (chdir(home) != 0) {
-                char error_msg[128];
-                snprintf(error_msg, sizeof(error_msg), 
-                         "cd: %s: %s", 
-                         home, 
-                         strerror(errno)
-                        );
-                add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
+            break;
+            
+        case '\n': // Enter - run the match
+        case KEY_PASTE_START: // Paste - edit the match
+            end_history_search(input, 1);
+            return handle_input_key(input, history, ch);
+            
+        default:
+            if (((ch >= 32 && ch <= 126) || (ch >= 128 && ch <= 255)) && 
+                input->search_len < MAX_SEARCH_QUERY - 1) {
+                input->search_query[input->search_len++] = ch;
+                update_history_search(input);
             } else {
-                getcwd(active->current_directory, sizeof(active->current_directory));
+                /* Any other key accepts the match for editing */
+                end_history_search(input, 1);
             }
-        }
-        return;
-    }
-    
-    /* Add timestamped command to history */
-    char timestamped_cmd[512];
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    char time_buf[32];
-    
-    strftime(time_buf, sizeof(time_buf), "[%H:%M:%S]", t);
-    
-    snprintf(timestamped_cmd, sizeof(timestamped_cmd), 
-             "%s %s", 
-             time_buf, 
-             cmd
-            );
-    add_history_line(history, timestamped_cmd, HISTORY_TYPE_COMMAND);
-    
-    /* Check for interactive applications */
-    int is_interactive = 0;
-    const char* interactive_commands[] = {
-        "vim", "nvim", "nano", "ranger", "parrot", "htop", "top", "sudo", "ssh", "man", "less", "more", NULL
-    };
-    
-    for (int i = 0; interactive_commands[i] != NULL; i++) {
-        if (strcmp(cmd, interactive_commands[i]) == 0 || 
-            strncmp(cmd, interactive_commands[i], 
-                    strlen(interactive_commands[i])) == 0) {
-            is_interactive = 1;
             break;
-        }
-    }
-    
-    if (is_interactive) {
-        add_history_line(history, "Starting interactive application...", HISTORY_TYPE_NORMAL);
-        add_history_line(history, "Note: Use Ctrl+Z to suspend and 'fg' to return", HISTORY_TYPE_NORMAL);
-        
-        def_prog_mode();
-        endwin();
-        
-        resetty();
-        
-        int result = system(cmd);
-        
-        reset_prog_mode();
-        refresh();
-        clear();
-        
-        if (result != 0) {
-            char result_msg[128];
-            snprintf(result_msg, sizeof(result_msg), 
-                     "Command returned with exit code: %d", 
-                     result
-                    );
-            add_history_line(history, result_msg, HISTORY_TYPE_NORMAL);
-        }
-        
-        add_history_line(history, "Returned to Parrot Terminal", HISTORY_TYPE_NORMAL);
-        return;
-    }
-    
-    /* Execute regular command with pipe for output capture */
-    int pipefd[2];
-    if (pipe(pipefd) == -1) {
-        char error_msg[128];
-        snprintf(error_msg, sizeof(error_msg), 
-                 "Failed to create pipe: %s", 
-                 strerror(errno)
-                );
-        add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
-        return;
-    }
-    
-    pid_t pid = fork();
-    if (pid == -1) {
-        char error_msg[128];
-        snprintf(error_msg, sizeof(error_msg), 
-                 "Failed to fork process: %s", 
-                 strerror(errno)
-                );
-        add_history_line(history, error_msg, HISTORY_TYPE_NORMAL);
-        close(pipefd[0]);
-        close(pipefd[1]);
-        return;
-    }
-    
-    if (pid == 0) {
-        close(pipefd[0]);
-        
-        dup2(pipefd[1], STDOUT_FILENO);
-        dup2(pipefd[1], STDERR_FILENO);
-        close(pipefd[1]);
-        
-        execl("/bin/sh", "sh", "-c", cmd, NULL);
-        
-        exit(127);
-    } else {
-        active->cmd_state = CMD_STATE_RUNNING;
-        active->current_process = pid;
-        
-        close(pipefd[1]);
-        
-        char buffer[1024];
-        ssize_t bytes_read;
-        FILE* pipe_read = fdopen(pipefd[0], "r");
-        
-        if (pipe_read) {
-            while ((bytes_read = read(pipefd[0], buffer, sizeof(buffer) - 1)) > 0) {
-                buffer[bytes_read] = '\0';
-                
-                char* line = strtok(buffer, "\n");
-                while (line != NULL) {
-                    char clean_line[1024];
-                    strncpy(clean_line, line, sizeof(clean_line) - 1);
-                    clean_line[sizeof(clean_line) - 1] = '\0';
-                    strip_escape_codes(clean_line);
-                    add_history_line(history, clean_line, HISTORY_TYPE_NORMAL);
-                    line = strtok(NULL, "\n");
-                }
-            }
-            fclose(pipe_read);
-        } else {
-            close(pipefd[0]);
-        }
-        
-        int status;
-        waitpid(pid, &status, 0);
-        
-        active->cmd_state = CMD_STATE_READY;
-        active->current_process = 0;
-        
-        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-            char status_msg[128];
-            snprintf(status_msg, sizeof(status_msg), 
-                     "Command exited with status: %d", 
-                     WEXITSTATUS(status)
-                    );
-            add_history_line(history, status_msg, HISTORY_TYPE_NORMAL);
-        } else if (WIFSIGNALED(status)) {
-            char signal_msg[128];
-            snprintf(signal_msg, sizeof(signal_msg), 
-                     "Command terminated by signal: %d", 
-                     WTERMSIG(status)
-                    );
-            add_history_line(history, signal_msg, HISTORY_TYPE_NORMAL);
-        }
-        
-        process_command_queue();
     }
+    return 0;
 }
 
 /*
- * Scroll terminal history up
- * @param history: History buffer to scroll
+ * Bind the escape sequences of editing keys that ncurses does not
+ * report by itself
  */
-void scroll_terminal_up(HistoryBuffer *history) {
-    if (history->scroll_offset < history->count - 1) {
-        history->scroll_offset++;
-    }
+void init_input_keys(void) {
+    define_key("\033[1;5D", KEY_WORD_LEFT);
+    define_key("\033[1;5C", KEY_WORD_RIGHT);
+    define_key("\033Od", KEY_WORD_LEFT);
+    define_key("\033Oc", KEY_WORD_RIGHT);
+    define_key("\033[200~", KEY_PASTE_START);
+    define_key("\033[201~", KEY_PASTE_END);
 }
 
 /*
- * Scroll terminal history down
- * @param history: History buffer to scroll
+ * Switch the terminal's bracketed paste mode, in which pasted text
+ * arrives between KEY_PASTE_START and KEY_PASTE_END
+ * @param enabled: 1 to enable, 0 to disable
  */
-void scroll_terminal_down(HistoryBuffer *history) {
-    if (history->scroll_offset > 0) {
-        history->scroll_offset--;
-    }
+void set_bracketed_paste(int enabled) {
+    printf(enabled ? "\033[?2004h" : "\033[?2004l");
+    fflush(stdout);
 }
 
 /*
- * Switch to specific terminal by ID
- * @param terminal_id: ID of terminal to switch to
+ * Read pasted text up to the end marker. Carriage returns become
+ * newlines, tabs become spaces and other control characters are dropped.
+ * Leaves the getch() timeout at 0 as used by the main loop.
+ * @param length: Receives the text length
+ * @return: Pasted text owned by the caller, or NULL on allocation failure
  */
-void switch_to_terminal(int terminal_id) {
-    if (terminal_id >= 0 && terminal_id < terminal_manager.terminal_count) {
-        switch_terminal(terminal_id);
+char* read_bracketed_paste(int *length) {
+    int capacity = 4096;
+    int len = 0;
+    char *text = malloc(capacity);
+    if (!text) return NULL;
+
+    timeout(PASTE_TIMEOUT_MS);
+    set_replay_paste(1);
+    for (;;) {
+        int ch = read_input_key();
+        if (ch == ERR || ch == KEY_PASTE_END) break;
+
+        if (ch == '\r') ch = '\n';
+        if (ch == '\t') ch = ' ';
+        if (ch > 255 || (ch < 32 && ch != '\n') || ch == 127) continue;
+
+        if (len == capacity) {
+            char *grown = realloc(text, capacity * 2);
+            if (!grown) break;
+            text = grown;
+            capacity *= 2;
+        }
+        text[len++] = ch;
     }
-}
+    set_replay_paste(0);
+    timeout(0);
 
-/*
- * Split terminal horizontally
- */
-void split_terminal_horizontal(void) {
-    create_split_terminal(SPLIT_HORIZONTAL);
+    *length = len;
+    return text;
 }
 
 /*
- * Split terminal vertically
+ * Read a key, from the keyboard or from a replay. Keys typed during a
+ * replay stop it, so a long one can be interrupted.
+ * @return: Key code as from getch(), ERR if none is available
  */
-void split_terminal_vertical(void) {
-    create_split_terminal(SPLIT_VERTICAL);
+int read_input_key(void) {
+    int ch;
+    
+    if (replay_next_key(&ch)) return ch;
+    
+    ch = getch();
+    if (ch == ERR) {
+        flush_recording();
+    } else if (ch != KEY_RESIZE) {
+        if (replaying_session()) stop_replay("Replay stopped by keyboard input");
+        else record_input_key(ch);
+    }
+    return ch;
 }
 
 /*
- * Switch between split panes
- * @param direction: Direction to switch (unused in current implementation)
+ * Run a command that takes over the terminal, suspending the interface
+ * until it exits
+ * @param term: Terminal the command was entered in
+ * @param cmd: Command string
  */
-void switch_split_pane(int direction) {
-    Terminal* active = get_active_terminal();
-    if (active->split_with != -1) {
-        switch_terminal(active->split_with);
+void run_interactive_application(Terminal *term, const char *cmd) {
+    HistoryBuffer *history = &term->history;
+    
+    add_history_line(history, "Starting interactive application...", HISTORY_TYPE_NORMAL);
+    add_history_line(history, "Note: Use Ctrl+Z to suspend and 'fg' to return", HISTORY_TYPE_NORMAL);
+    
+    def_prog_mode();
+    set_bracketed_paste(0);
+    endwin();
+    
+    resetty();
+    
+    int result = system(cmd);
+    
+    reset_prog_mode();
+    set_bracketed_paste(1);
+    refresh();
+    clear();
+    
+    if (result != 0) {
+        char result_msg[128];
+        snprintf(result_msg, sizeof(result_msg), 
+                 "Command returned with exit code: %d", 
+                 result
+                );
+        add_history_line(history, result_msg, HISTORY_TYPE_NORMAL);
     }
+    
+    add_history_line(history, "Returned to Parrot Terminal", HISTORY_TYPE_NORMAL);
 }
 
 /*
- * Handle all user input and keyboard shortcuts
+ * Handle all pending user input and keyboard shortcuts without blocking,
+ * so the caller redraws once per batch of keys instead of once per key
  * @param input: Current input state
  * @param history: History buffer for output
  * @return: 1 if exit requested, 0 otherwise
  */
 int handle_input(InputState *input, HistoryBuffer *history) {
     int ch;
+    int handled = 0;
     
-    ch = getch();
-    
-    Terminal* active = get_active_terminal();
+    while (handled < INPUT_DRAIN_LIMIT && (ch = read_input_key()) != ERR) {
+        if (handle_input_key(input, history, ch)) return 1;
+        handled++;
+        
+        /* A key may have switched, created or closed the active terminal */
+        Terminal *active = get_active_terminal();
+        input = &active->input;
+        history = &active->history;
+    }
+    return 0;
+}
+
+/*
+ * Apply a single key to the input state
+ * @param input: Current input state
+ * @param history: History buffer for output
+ * @param ch: Key code from getch()
+ * @return: 1 if exit requested, 0 otherwise
+ */
+int handle_input_key(InputState *input, HistoryBuffer *history, int ch) {
+    if (ch == 12) { // Ctrl+L - redraw screen
+        redraw_screen();
+        return 0;
+    }
     
     /* Handle input when terminal is locked (queue full) */
     if (input->is_locked) {
         switch (ch) {
+            case KEY_PASTE_START: // Pasted text is dropped while locked
+                {
+                    int length;
+                    free(read_bracketed_paste(&length));
+                }
+                break;
+                
             case 20: // Shift+T - new terminal
                 create_new_terminal();
                 break;
@@ -1291,7 +759,7 @@ int handle_input(InputState *input, HistoryBuffer *history) {
                 
             case 27: // ESC sequences (Alt+keys)
                 {
-                    int next_ch = getch();
+                    int next_ch = read_input_key();
                     if (next_ch == -1) {
                         break;
                     }
@@ -1303,7 +771,7 @@ int handle_input(InputState *input, HistoryBuffer *history) {
                     } else if (next_ch == '-') {
                         prev_terminal();
                     } else if (next_ch == 91) { // [
-                        next_ch = getch();
+                        next_ch = read_input_key();
                         switch (next_ch) {
                             case 65: // Alt+Up
                             case 66: // Alt+Down  
@@ -1327,13 +795,30 @@ int handle_input(InputState *input, HistoryBuffer *history) {
         return 0;
     }
     
+    if (input->search_active) {
+        int result = handle_search_input(input, history, ch);
+        if (!input->search_active) refresh_suggestion(input);
+        return result;
+    }
+    
     switch (ch) {
+        case ERR: // No key pending
+            return 0;
+            
         case 20: // Shift+T - new terminal
             create_new_terminal();
             break;
             
         case 23: // Shift+W - close terminal
             close_current_terminal();
+            return 0; // input may belong to the closed terminal
+            
+        case 18: // Ctrl+R - reverse history search
+            start_history_search(input);
+            break;
+            
+        case '\t': // Tab - complete command or path
+            complete_input(input, history);
             break;
             
         case KEY_UP: // Scroll up
@@ -1345,31 +830,24 @@ int handle_input(InputState *input, HistoryBuffer *history) {
             break;
             
         case KEY_SR: // Shift+Up - command history previous
-            if (input->cmd_history_pos > 0) {
-                input->cmd_history_pos--;
-                strcpy(input->input, input->cmd_history[input->cmd_history_pos]);
-                input->input_len = strlen(input->input);
-                input->cursor_pos = input->input_len;
+            if (recall_cmd_history(input, input->cmd_history_pos + 1)) {
+                input->cmd_history_pos++;
             }
             break;
             
         case KEY_SF: // Shift+Down - command history next
-            if (input->cmd_history_pos < input->cmd_history_count - 1) {
-                input->cmd_history_pos++;
-                strcpy(input->input, input->cmd_history[input->cmd_history_pos]);
-                input->input_len = strlen(input->input);
-                input->cursor_pos = input->input_len;
-            } else if (input->cmd_history_pos == input->cmd_history_count - 1) {
-                input->cmd_history_pos = input->cmd_history_count;
-                input->input[0] = '\0';
-                input->input_len = 0;
-                input->cursor_pos = 0;
+            if (input->cmd_history_pos > 1) {
+                input->cmd_history_pos--;
+                recall_cmd_history(input, input->cmd_history_pos);
+            } else if (input->cmd_history_pos == 1) {
+                input->cmd_history_pos = 0;
+                clear_input(input);
             }
             break;
             
         case 27: // ESC sequences (Alt+keys)
             {
-                int next_ch = getch();
+                int next_ch = read_input_key();
                 if (next_ch == -1) {
                     break;
                 }
@@ -1380,8 +858,20 @@ int handle_input(InputState *input, HistoryBuffer *history) {
                     next_terminal();
                 } else if (next_ch == '-') {
                     prev_terminal();
+                } else if (next_ch == '\n' || next_ch == '\r') { // Alt+Enter - new line
+                    insert_input_text(input, "\n", 1);
+                } else if (next_ch == 'b') { // Alt+B - word left
+                    move_input_cursor(input, find_word_start(input, input->cursor_pos));
+                } else if (next_ch == 'f') { // Alt+F - word right
+                    move_input_cursor(input, find_word_end(input, input->cursor_pos));
+                } else if (next_ch == 'd') { // Alt+D - kill word forward
+                    kill_input_text(input, input->cursor_pos, 
+                                    find_word_end(input, input->cursor_pos));
+                } else if (next_ch == 127 || next_ch == KEY_BACKSPACE) { // Alt+Backspace
+                    kill_input_text(input, find_word_start(input, input->cursor_pos), 
+                                    input->cursor_pos);
                 } else if (next_ch == 91) { // [
-                    next_ch = getch();
+                    next_ch = read_input_key();
                     switch (next_ch) {
                         case 65: // Alt+Up
                         case 66: // Alt+Down  
@@ -1396,75 +886,107 @@ int handle_input(InputState *input, HistoryBuffer *history) {
             
         case '\n': // Enter - execute command
             if (input->input_len > 0) {
-                input->input[input->input_len] = '\0';
+                char *cmd = strdup(get_input_text(input));
+                if (!cmd) break;
                 
-                if (strcmp(input->input, "exit") == 0) {
+                if (strcmp(cmd, "exit") == 0) {
+                    free(cmd);
                     return 1;
                 }
                 
-                execute_command(input->input, history, input);
-                
-                input->input[0] = '\0';
-                input->input_len = 0;
-                input->cursor_pos = 0;
-                input->display_start = 0;
-                input->cmd_history_pos = input->cmd_history_count;
+                clear_input(input);
+                input->cmd_history_pos = 0;
+                execute_command(get_active_terminal(), cmd);
+                free(cmd);
             }
             break;
             
         case KEY_BACKSPACE:
         case 127: // Backspace
-            if (input->cursor_pos > 0) {
-                memmove(&input->input[input->cursor_pos - 1], 
-                       &input->input[input->cursor_pos], 
-                       input->input_len - input->cursor_pos + 1
-                      );
-                input->cursor_pos--;
-                input->input_len--;
-            }
+            delete_input_text(input, input_prev_char(input, input->cursor_pos), input->cursor_pos);
             break;
             
         case KEY_LEFT:
-            if (input->cursor_pos > 0) input->cursor_pos--;
+            move_input_cursor(input, input_prev_char(input, input->cursor_pos));
             break;
             
         case KEY_RIGHT:
-            if (input->cursor_pos < input->input_len) input->cursor_pos++;
+            if (input->cursor_pos < input->input_len) {
+                move_input_cursor(input, input_next_char(input, input->cursor_pos));
+            } else if (get_suggestion_tail(input)) { // Accept suggestion
+                const char *tail = get_suggestion_tail(input);
+                insert_input_text(input, tail, strlen(tail));
+            }
+            break;
+            
+        case KEY_PASTE_START: // Bracketed paste - insert as one block
+            {
+                int length;
+                char *text = read_bracketed_paste(&length);
+                if (text) {
+                    insert_input_text(input, text, length);
+                    free(text);
+                }
+            }
             break;
             
+        case KEY_WORD_LEFT: // Ctrl+Left
+            move_input_cursor(input, find_word_start(input, input->cursor_pos));
+            break;
+            
+        case KEY_WORD_RIGHT: // Ctrl+Right
+            move_input_cursor(input, find_word_end(input, input->cursor_pos));
+            break;
+            
+        case 1: // Ctrl+A - start of line
         case KEY_HOME:
-            input->cursor_pos = 0;
-            input->display_start = 0;
+            move_input_cursor(input, find_line_start(input, input->cursor_pos));
             break;
             
+        case 5: // Ctrl+E - end of line
         case KEY_END:
-            input->cursor_pos = input->input_len;
+            if (input->cursor_pos == input->input_len && get_suggestion_tail(input)) {
+                const char *tail = get_suggestion_tail(input);
+                insert_input_text(input, tail, strlen(tail));
+            }
+            move_input_cursor(input, find_line_end(input, input->cursor_pos));
             break;
             
         case KEY_DC: // Delete
-            if (input->cursor_pos < input->input_len) {
-                memmove(&input->input[input->cursor_pos], 
-                       &input->input[input->cursor_pos + 1], 
-                       input->input_len - input->cursor_pos
-                      );
-                input->input_len--;
+            delete_input_text(input, input->cursor_pos, input_next_char(input, input->cursor_pos));
+            break;
+            
+        case 11: // Ctrl+K - kill to end of line, or the newline at its end
+            {
+                int end = find_line_end(input, input->cursor_pos);
+                if (end == input->cursor_pos) end++;
+                kill_input_text(input, input->cursor_pos, end);
             }
             break;
             
+        case 21: // Ctrl+U - kill to start of line
+            kill_input_text(input, find_line_start(input, input->cursor_pos), 
+                            input->cursor_pos);
+            break;
+            
+        case 25: // Ctrl+Y - yank last killed text
+            yank_input_text(input);
+            break;
+            
         default:
-            if (ch >= 32 && ch <= 126 && input->input_len < MAX_CMD_INPUT - 1) {
-                if (input->cursor_pos < input->input_len) {
-                    memmove(&input->input[input->cursor_pos + 1], 
-                           &input->input[input->cursor_pos], 
-                           input->input_len - input->cursor_pos + 1
-                          );
+            /* Printable ASCII, or one byte of a UTF-8 character */
+            if ((ch >= 32 && ch <= 126) || (ch >= 128 && ch <= 255)) {
+                char c = ch;
+                int at_end = input->cursor_pos == input->input_len;
+                insert_input_text(input, &c, 1);
+                if (at_end) {
+                    extend_suggestion(input, c);
+                    return 0;
                 }
-                input->input[input->cursor_pos] = ch;
-                input->cursor_pos++;
-                input->input_len++;
             }
             break;
     }
     
+    refresh_suggestion(input);
     return 0;
 }
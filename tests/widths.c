@@ -0,0 +1,171 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Longest text and largest misalignment tried against utf8_is_ascii() */
+#define ASCII_MAX_LEN 80
+#define ASCII_MAX_OFFSET 16
+
+static int failures = 0;
+
+/*
+ * Report a failed check
+ * @param ok: Result of the check
+ * @param what: Description printed on failure
+ */
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("widths: FAIL %s\n", what);
+        failures++;
+    }
+}
+
+/*
+ * Check the width of one code point
+ * @param cp: Code point
+ * @param expected: Columns it should take
+ */
+static void check_codepoint(uint32_t cp, int expected) {
+    char what[64];
+    int width = codepoint_width(cp);
+    snprintf(what, sizeof(what), "U+%04X is %d columns, expected %d", cp, width, expected);
+    check(width == expected, what);
+}
+
+/*
+ * Check the width and fitting of a UTF-8 string
+ * @param s: Text
+ * @param width: Expected utf8_width()
+ * @param columns: Columns passed to utf8_fit()
+ * @param fit_bytes: Expected prefix length from utf8_fit()
+ * @param fit_used: Expected columns used by that prefix
+ */
+static void check_text(const char *s, int width, int columns, int fit_bytes, int fit_used) {
+    char what[128];
+    int len = strlen(s);
+    int used = -1;
+
+    int got = utf8_width(s, len);
+    snprintf(what, sizeof(what), "utf8_width(\"%s\") is %d, expected %d", s, got, width);
+    check(got == width, what);
+
+    got = utf8_fit(s, len, columns, &used);
+    snprintf(what, sizeof(what), "utf8_fit(\"%s\", %d) is %d bytes in %d columns, expected %d in %d",
+             s, columns, got, used, fit_bytes, fit_used);
+    check(got == fit_bytes && used == fit_used, what);
+}
+
+/*
+ * Byte at a time reference for utf8_is_ascii()
+ */
+static int scalar_is_ascii(const char *s, int len) {
+    for (int i = 0; i < len; i++) {
+        uint32_t cp;
+        if (utf8_decode(s + i, len - i, &cp) != 1 || cp >= 0x80) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Compare utf8_is_ascii() with the scalar check at every length and
+ * alignment, with no high byte and with one at each position, and with
+ * a high byte just past the end that must not be seen
+ */
+static void check_ascii_scan(void) {
+    char buffer[ASCII_MAX_OFFSET + ASCII_MAX_LEN + 1];
+    char what[96];
+
+    for (int offset = 0; offset < ASCII_MAX_OFFSET; offset++) {
+        for (int len = 0; len <= ASCII_MAX_LEN; len++) {
+            for (int high = -1; high < len; high++) {
+                memset(buffer, 'a', sizeof(buffer));
+                buffer[offset + len] = (char)0xC3;
+                if (high >= 0) buffer[offset + high] = (char)0xE9;
+
+                const char *s = buffer + offset;
+                int expected = scalar_is_ascii(s, len);
+                if (utf8_is_ascii(s, len) != expected ||
+                    (expected && utf8_width(s, len) != len)) {
+                    snprintf(what, sizeof(what), "ASCII scan at offset %d, length %d, high byte at %d",
+                             offset, len, high);
+                    check(0, what);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Check decoding of well-formed, truncated and invalid sequences
+ */
+static void check_decode(void) {
+    uint32_t cp;
+
+    check(utf8_decode("\xC3\xA9", 2, &cp) == 2 && cp == 0xE9, "decode U+00E9");
+    check(utf8_decode("\xE6\x97\xA5", 3, &cp) == 3 && cp == 0x65E5, "decode U+65E5");
+    check(utf8_decode("\xF0\x9F\x98\x80", 4, &cp) == 4 && cp == 0x1F600, "decode U+1F600");
+    check(utf8_decode("\xE6\x97\xA5", 2, &cp) == 1 && cp == 0xE6, "truncated sequence is one byte");
+    check(utf8_decode("\xC3" "A", 2, &cp) == 1 && cp == 0xC3, "missing continuation is one byte");
+    check(utf8_decode("\x80", 1, &cp) == 1 && cp == 0x80, "lone continuation is one byte");
+    check(utf8_decode("\xC0\x80", 2, &cp) == 1 && cp == 0xC0, "overlong lead is one byte");
+    check(utf8_decode("\xF5\x80\x80\x80", 4, &cp) == 1 && cp == 0xF5, "lead above U+10FFFF is one byte");
+}
+
+/*
+ * Check the width functions. The test runs in the C locale, so widths
+ * come from the built-in range tables rather than wcwidth().
+ */
+int main(void) {
+    /* ASCII, controls and Latin-1 */
+    check_codepoint('A', 1);
+    check_codepoint(0x07, 1);
+    check_codepoint(0x7F, 1);
+    check_codepoint(0x85, 1);
+    check_codepoint(0xE9, 1);
+
+    /* Combining marks and format characters */
+    check_codepoint(0x0301, 0);
+    check_codepoint(0x0591, 0);
+    check_codepoint(0x200B, 0);
+    check_codepoint(0xFE0F, 0);
+    check_codepoint(0xFEFF, 0);
+    check_codepoint(0x1F3FB, 0);
+    check_codepoint(0xE0100, 0);
+
+    /* East Asian wide, fullwidth and emoji */
+    check_codepoint(0x1100, 2);
+    check_codepoint(0x4E00, 2);
+    check_codepoint(0x9FFF, 2);
+    check_codepoint(0xAC00, 2);
+    check_codepoint(0xFF21, 2);
+    check_codepoint(0x231A, 2);
+    check_codepoint(0x1F600, 2);
+    check_codepoint(0x1F680, 2);
+    check_codepoint(0x20000, 2);
+
+    /* Narrow neighbours of the wide ranges */
+    check_codepoint(0x0370, 1);
+    check_codepoint(0xD7A4, 1);
+    check_codepoint(0xFF61, 1);
+    check_codepoint(0x1F650, 1);
+    check_codepoint(0x10FFFF, 1);
+
+    check_decode();
+
+    /* Text, columns, then the prefix utf8_fit() should return */
+    check_text("", 0, 5, 0, 0);
+    check_text("hello", 5, 3, 3, 3);
+    check_text("caf\xC3\xA9", 4, 4, 5, 4);
+    check_text("a\xE6\x97\xA5" "b", 4, 2, 1, 1);
+    check_text("a\xE6\x97\xA5" "b", 4, 3, 4, 3);
+    check_text("e\xCC\x81x", 2, 1, 3, 1);
+    check_text("\xF0\x9F\x98\x80!", 3, 2, 4, 2);
+    check_text("\xE6\x97", 2, 1, 1, 1);
+    check_text("\xFF\xC0\x80", 3, 5, 3, 3);
+    check_text("abc", 3, -1, 0, 0);
+
+    check_ascii_scan();
+
+    printf("widths: %d failures\n", failures);
+    return failures > 0;
+}
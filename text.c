@@ -0,0 +1,132 @@
+#include "parrot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * Remove ANSI escape codes from string
+ * @param str: String to clean
+ */
+void strip_escape_codes(char* str) {
+    char* src = str;
+    char* dst = str;
+    int in_escape = 0;
+    
+    while (*src) {
+        if (*src == '\033') {
+            in_escape = 1;
+            src++;
+        } else if (in_escape && *src == 'm') {
+            in_escape = 0;
+            src++;
+        } else if (in_escape) {
+            src++;
+        } else {
+            *dst++ = *src++;
+        }
+    }
+    *dst = '\0';
+}
+
+/*
+ * Shorten path for display (replace home with ~, truncate middle components)
+ * @param path: Full path to shorten
+ * @param output: Buffer for shortened path
+ * @param output_size: Size of output buffer
+ */
+void shorten_path(char *path, char *output, size_t output_size) {
+    if (strlen(path) == 0) {
+        strncpy(output, path, output_size);
+        return;
+    }
+    
+    /* Replace home directory with ~ */
+    const char* home = getenv("HOME");
+    char modified_path[PATH_MAX];
+    if (home && strncmp(path, home, strlen(home)) == 0) {
+        snprintf(modified_path, sizeof(modified_path), 
+                 "~%s", 
+                 path + strlen(home)
+                );
+    } else {
+        strncpy(modified_path, path, sizeof(modified_path));
+    }
+    
+    char *components[64];
+    int count = 0;
+    char *path_copy = strdup(modified_path);
+    char *token = strtok(path_copy, "/");
+    
+    while (token != NULL && count < 63) {
+        components[count++] = token;
+        token = strtok(NULL, "/");
+    }
+    
+    output[0] = '\0';
+    
+    if (modified_path[0] == '/') {
+        strncat(output, "/", output_size - 1);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (i == count - 1) {
+            if (strlen(components[i]) > 12) {
+                char shortened[16];
+                strncpy(shortened, components[i], 12);
+                shortened[12] = '\0';
+                strcat(shortened, "...");
+                strncat(output, shortened, output_size - strlen(output) - 1);
+            } else {
+                strncat(output, components[i], output_size - strlen(output) - 1);
+            }
+        } else {
+            if (strlen(components[i]) > 0) {
+                char first_letter[2] = {components[i][0], '\0'};
+                strncat(output, first_letter, output_size - strlen(output) - 1);
+                if (i < count - 1) {
+                    strncat(output, "/", output_size - strlen(output) - 1);
+                }
+            }
+        }
+    }
+    
+    free(path_copy);
+}
+
+/*
+ * Check if file exists at given path
+ * @param path: Path to check
+ * @return: 1 if file exists, 0 otherwise
+ */
+int is_existing_file(const char *path) {
+    struct stat buffer;
+    return (stat(path, &buffer) == 0);
+}
+
+/*
+ * Classify a word of command output for highlighting. Words that look
+ * like paths are checked against the file system, others for error words.
+ * @param token: Word without spaces
+ * @return: TOKEN_DIRECTORY, TOKEN_FILE, TOKEN_MISSING_PATH, TOKEN_ERROR or TOKEN_TEXT
+ */
+int classify_output_token(const char *token) {
+    struct stat st;
+    
+    if (is_existing_file(token) || 
+        strstr(token, "/") != NULL || 
+        strstr(token, "./") == token ||
+        strstr(token, "../") == token ||
+        strstr(token, "~/") == token) {
+        if (stat(token, &st) != 0) return TOKEN_MISSING_PATH;
+        return S_ISDIR(st.st_mode) ? TOKEN_DIRECTORY : TOKEN_FILE;
+    }
+    
+    if (strstr(token, "error") || strstr(token, "Error") || 
+        strstr(token, "ERROR") || strstr(token, "No such") ||
+        strstr(token, "Permission denied") || strstr(token, "command not found") ||
+        strstr(token, "fail") || strstr(token, "Fail") || strstr(token, "FAIL")) {
+        return TOKEN_ERROR;
+    }
+    return TOKEN_TEXT;
+}
@@ -0,0 +1,274 @@
+#include "parrot.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Inclusive range of code points sharing a display width
+ */
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} WidthRange;
+
+/*
+ * The tables below are only used when the locale has no UTF-8 wcwidth(),
+ * e.g. in a headless run under the C locale. ncurses places cells with
+ * wcwidth(), so widths come from it whenever it knows UTF-8.
+ */
+
+/* Combining marks and format characters that take no column */
+static const WidthRange zero_width_ranges[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
+    {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A},
+    {0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+    {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711}, {0x0730, 0x074A},
+    {0x07A6, 0x07B0}, {0x0900, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C},
+    {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963},
+    {0x0981, 0x0981}, {0x09BC, 0x09BC}, {0x09C1, 0x09C4}, {0x09CD, 0x09CD},
+    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x0EB1, 0x0EB1},
+    {0x0EB4, 0x0EBC}, {0x0EC8, 0x0ECD}, {0x1160, 0x11FF}, {0x1AB0, 0x1AFF},
+    {0x1DC0, 0x1DFF}, {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064},
+    {0x20D0, 0x20FF}, {0x302A, 0x302D}, {0x3099, 0x309A}, {0xFE00, 0xFE0F},
+    {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0x1F3FB, 0x1F3FF}, {0xE0001, 0xE007F},
+    {0xE0100, 0xE01EF}
+};
+
+/* East Asian wide and fullwidth characters and emoji presentation */
+static const WidthRange wide_ranges[] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC},
+    {0x23F0, 0x23F0}, {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615},
+    {0x2648, 0x2653}, {0x267F, 0x267F}, {0x2693, 0x2693}, {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5}, {0x26CE, 0x26CE},
+    {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B},
+    {0x2728, 0x2728}, {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755},
+    {0x2757, 0x2757}, {0x2795, 0x2797}, {0x27B0, 0x27B0}, {0x27BF, 0x27BF},
+    {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55}, {0x2E80, 0x3029},
+    {0x302E, 0x303E}, {0x3041, 0x3098}, {0x309B, 0x33FF}, {0x3400, 0x4DBF},
+    {0x4E00, 0x9FFF}, {0xA000, 0xA4CF}, {0xA960, 0xA97F}, {0xAC00, 0xD7A3},
+    {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F}, {0xFF00, 0xFF60},
+    {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4}, {0x17000, 0x18CFF}, {0x1B000, 0x1B2FF},
+    {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A},
+    {0x1F200, 0x1F202}, {0x1F210, 0x1F23B}, {0x1F240, 0x1F248}, {0x1F250, 0x1F251},
+    {0x1F300, 0x1F320}, {0x1F32D, 0x1F335}, {0x1F337, 0x1F37C}, {0x1F37E, 0x1F393},
+    {0x1F3A0, 0x1F3CA}, {0x1F3CF, 0x1F3D3}, {0x1F3E0, 0x1F3F0}, {0x1F3F4, 0x1F3F4},
+    {0x1F3F8, 0x1F3FA}, {0x1F400, 0x1F43E}, {0x1F440, 0x1F440}, {0x1F442, 0x1F4FC},
+    {0x1F4FF, 0x1F53D}, {0x1F54B, 0x1F54E}, {0x1F550, 0x1F567}, {0x1F57A, 0x1F57A},
+    {0x1F595, 0x1F596}, {0x1F5A4, 0x1F5A4}, {0x1F5FB, 0x1F64F}, {0x1F680, 0x1F6C5},
+    {0x1F6CC, 0x1F6CC}, {0x1F6D0, 0x1F6D2}, {0x1F6D5, 0x1F6D7}, {0x1F6EB, 0x1F6EC},
+    {0x1F6F4, 0x1F6FC}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F93A}, {0x1F93C, 0x1F945},
+    {0x1F947, 0x1F9FF}, {0x1FA70, 0x1FAFF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}
+};
+
+/* Widths of the Basic Multilingual Plane, filled on first use */
+static unsigned char bmp_widths[0x10000];
+static int bmp_widths_ready = 0;
+
+/* Set when the widths come from the locale's wcwidth() */
+static int use_wcwidth = 0;
+
+/*
+ * Check whether a code point lies in a sorted range table
+ * @param ranges: Table to search
+ * @param count: Number of ranges
+ * @param cp: Code point
+ * @return: 1 if found, 0 otherwise
+ */
+static int in_ranges(const WidthRange *ranges, int count, uint32_t cp) {
+    int lo = 0, hi = count - 1;
+    if (cp < ranges[0].first || cp > ranges[hi].last) return 0;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (cp < ranges[mid].first) hi = mid - 1;
+        else if (cp > ranges[mid].last) lo = mid + 1;
+        else return 1;
+    }
+    return 0;
+}
+
+/*
+ * Ask the C library for a code point's width. Non-printable code points
+ * count as one column.
+ * @param cp: Code point
+ * @return: 0, 1 or 2
+ */
+static int library_width(uint32_t cp) {
+    int width = wcwidth((wchar_t)cp);
+    return width < 0 ? 1 : width;
+}
+
+/*
+ * Fill the BMP width table, from wcwidth() if the locale is UTF-8 and
+ * from the range tables otherwise. Called on first use, which is after
+ * the interface has set the locale.
+ */
+static void build_width_table(void) {
+    bmp_widths_ready = 1;
+    use_wcwidth = MB_CUR_MAX > 1 && wcwidth(0x4E00) == 2;
+    if (use_wcwidth) {
+        for (uint32_t cp = 0; cp < 0x10000; cp++) {
+            bmp_widths[cp] = library_width(cp);
+        }
+        return;
+    }
+
+    memset(bmp_widths, 1, sizeof(bmp_widths));
+    for (size_t i = 0; i < sizeof(wide_ranges) / sizeof(wide_ranges[0]); i++) {
+        for (uint32_t cp = wide_ranges[i].first; cp <= wide_ranges[i].last && cp < 0x10000; cp++) {
+            bmp_widths[cp] = 2;
+        }
+    }
+    for (size_t i = 0; i < sizeof(zero_width_ranges) / sizeof(zero_width_ranges[0]); i++) {
+        for (uint32_t cp = zero_width_ranges[i].first;
+             cp <= zero_width_ranges[i].last && cp < 0x10000; cp++) {
+            bmp_widths[cp] = 0;
+        }
+    }
+}
+
+/*
+ * Get the number of columns a code point occupies
+ * @param cp: Code point
+ * @return: 0, 1 or 2
+ */
+int codepoint_width(uint32_t cp) {
+    if (cp < 0x300) return 1;
+    if (!bmp_widths_ready) build_width_table();
+    if (cp < 0x10000) return bmp_widths[cp];
+    if (use_wcwidth) return library_width(cp);
+    if (in_ranges(zero_width_ranges, sizeof(zero_width_ranges) / sizeof(zero_width_ranges[0]), cp)) {
+        return 0;
+    }
+    return in_ranges(wide_ranges, sizeof(wide_ranges) / sizeof(wide_ranges[0]), cp) ? 2 : 1;
+}
+
+/*
+ * Check whether a byte string is pure ASCII, 16 bytes at a time where SSE2
+ * is available
+ * @param s: Bytes to check
+ * @param len: Number of bytes
+ * @return: 1 if no byte has the high bit set, 0 otherwise
+ */
+int utf8_is_ascii(const char *s, int len) {
+    int i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        if (_mm_movemask_epi8(chunk)) return 0;
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, s + i, sizeof(word));
+        if (word & 0x8080808080808080ull) return 0;
+    }
+#endif
+
+    for (; i < len; i++) {
+        if ((unsigned char)s[i] & 0x80) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Decode one UTF-8 sequence. Malformed or truncated sequences decode as
+ * a single byte so the text can always be walked forward.
+ * @param s: Bytes to decode
+ * @param len: Bytes available, at least 1
+ * @param cp: Receives the code point
+ * @return: Length of the sequence in bytes
+ */
+int utf8_decode(const char *s, int len, uint32_t *cp) {
+    const unsigned char *u = (const unsigned char *)s;
+    int need;
+    uint32_t value;
+
+    if (u[0] < 0x80) {
+        *cp = u[0];
+        return 1;
+    } else if (u[0] >= 0xC2 && u[0] <= 0xDF) {
+        need = 1;
+        value = u[0] & 0x1F;
+    } else if (u[0] >= 0xE0 && u[0] <= 0xEF) {
+        need = 2;
+        value = u[0] & 0x0F;
+    } else if (u[0] >= 0xF0 && u[0] <= 0xF4) {
+        need = 3;
+        value = u[0] & 0x07;
+    } else {
+        *cp = u[0];
+        return 1;
+    }
+
+    if (need >= len) {
+        *cp = u[0];
+        return 1;
+    }
+    for (int i = 1; i <= need; i++) {
+        if ((u[i] & 0xC0) != 0x80) {
+            *cp = u[0];
+            return 1;
+        }
+        value = (value << 6) | (u[i] & 0x3F);
+    }
+    *cp = value;
+    return need + 1;
+}
+
+/*
+ * Count the display columns of a UTF-8 string. Pure ASCII text is
+ * measured by its length without decoding.
+ * @param s: Text without control characters
+ * @param len: Number of bytes
+ * @return: Width in columns
+ */
+int utf8_width(const char *s, int len) {
+    if (utf8_is_ascii(s, len)) return len;
+
+    int width = 0;
+    for (int i = 0; i < len; ) {
+        uint32_t cp;
+        i += utf8_decode(s + i, len - i, &cp);
+        width += codepoint_width(cp);
+    }
+    return width;
+}
+
+/*
+ * Find how many bytes of a UTF-8 string fit in a number of columns
+ * without splitting a character
+ * @param s: Text without control characters
+ * @param len: Number of bytes
+ * @param columns: Columns available
+ * @param used: Receives the columns taken by the returned prefix, may be NULL
+ * @return: Length of the prefix in bytes
+ */
+int utf8_fit(const char *s, int len, int columns, int *used) {
+    int width = 0;
+    int i = 0;
+
+    if (columns < 0) columns = 0;
+    if (utf8_is_ascii(s, len)) {
+        i = len < columns ? len : columns;
+        width = i;
+    } else {
+        while (i < len) {
+            uint32_t cp;
+            int n = utf8_decode(s + i, len - i, &cp);
+            int w = codepoint_width(cp);
+            if (width + w > columns) break;
+            width += w;
+            i += n;
+        }
+    }
+
+    if (used) *used = width;
+    return i;
+}